@@ -0,0 +1,292 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef CHACHAPRNG_H
+#define CHACHAPRNG_H
+
+#include "PRNG.h"
+#include "Dispatch.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace prng_detail
+{
+
+// Blocks generated together, one per 32 bit lane of an AVX-512 register
+const std::size_t chachaLanes = 16;
+// Each 64 byte block is eight words of output
+const std::size_t chachaBlockWords = 8;
+
+inline uint32_t rotateLeft32(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+// The ChaCha quarter round on words a, b, c and d of every lane
+PRNG_ALWAYS_INLINE inline void chachaQuarterRound(uint32_t (*x)[chachaLanes], int a, int b, int c, int d)
+{
+    for(std::size_t lane = 0; lane < chachaLanes; lane++)
+    {
+        x[a][lane] += x[b][lane];
+        x[d][lane] = rotateLeft32(x[d][lane] ^ x[a][lane], 16);
+        x[c][lane] += x[d][lane];
+        x[b][lane] = rotateLeft32(x[b][lane] ^ x[c][lane], 12);
+        x[a][lane] += x[b][lane];
+        x[d][lane] = rotateLeft32(x[d][lane] ^ x[a][lane], 8);
+        x[c][lane] += x[d][lane];
+        x[b][lane] = rotateLeft32(x[b][lane] ^ x[c][lane], 7);
+    }
+}
+
+/*
+ * Generates chachaLanes consecutive blocks, starting from the counter in input, into output.
+ * The state is held word major, x[word][lane], so each step of a quarter round is one
+ * operation across every block and the loops become vector instructions on any SIMD level.
+ */
+template <int Rounds>
+PRNG_ALWAYS_INLINE inline void chachaBlocksKernel(std::integral_constant<int, Rounds>, const uint32_t *input,
+                                                  uint64_t *output)
+{
+    uint32_t initial[16][chachaLanes];
+    for(int word = 0; word < 16; word++)
+    {
+        for(std::size_t lane = 0; lane < chachaLanes; lane++)
+        {
+            initial[word][lane] = input[word];
+        }
+    }
+    const uint64_t counter = input[12] | static_cast<uint64_t>(input[13]) << 32;
+    for(std::size_t lane = 0; lane < chachaLanes; lane++)
+    {
+        initial[12][lane] = static_cast<uint32_t>(counter + lane);
+        initial[13][lane] = static_cast<uint32_t>((counter + lane) >> 32);
+    }
+
+    uint32_t x[16][chachaLanes];
+    std::memcpy(x, initial, sizeof(x));
+    for(int round = 0; round < Rounds; round += 2)
+    {
+        chachaQuarterRound(x, 0, 4, 8, 12);
+        chachaQuarterRound(x, 1, 5, 9, 13);
+        chachaQuarterRound(x, 2, 6, 10, 14);
+        chachaQuarterRound(x, 3, 7, 11, 15);
+        chachaQuarterRound(x, 0, 5, 10, 15);
+        chachaQuarterRound(x, 1, 6, 11, 12);
+        chachaQuarterRound(x, 2, 7, 8, 13);
+        chachaQuarterRound(x, 3, 4, 9, 14);
+    }
+
+    // Words are the keystream read as little endian, so output matches other ChaCha implementations
+    for(std::size_t lane = 0; lane < chachaLanes; lane++)
+    {
+        for(std::size_t word = 0; word < chachaBlockWords; word++)
+        {
+            uint32_t low = x[2 * word][lane] + initial[2 * word][lane];
+            uint32_t high = x[2 * word + 1][lane] + initial[2 * word + 1][lane];
+            output[lane * chachaBlockWords + word] = low | static_cast<uint64_t>(high) << 32;
+        }
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(chachaBlocks, chachaBlocksKernel)
+
+}
+
+/**
+ * @brief A generator built on the ChaCha stream cipher, for when xorshift output isn't acceptable.
+ *
+ * The output is the ChaCha keystream, in the original layout with a 64 bit block counter and a
+ * 64 bit nonce, here called the stream. That makes it unpredictable without the key, so it's
+ * suitable where fairness must hold up to scrutiny, like audited shuffles or draws users see.
+ * ChaCha8 is plenty for simulation quality, ChaCha20 is the standard cipher strength.
+ *
+ * Sixteen blocks are generated together, spread across the lanes of the widest vectors the CPU
+ * has (see Dispatch.h), and handed out from a buffer through the same getRandom functions as PRNG.
+ * Because the keystream is counter based, seek() can jump straight to any block.
+ *
+ * Like PRNG, a ChaChaPRNG must only be used by one thread at a time.
+ */
+template <int Rounds>
+class ChaChaPRNG : public PRNGBase<ChaChaPRNG<Rounds> >
+{
+    static_assert(Rounds > 0 && Rounds % 2 == 0, "ChaCha takes an even number of rounds");
+
+public:
+    /**
+     * @brief Constructs a new ChaChaPRNG with a key from std::random_device
+     */
+    ChaChaPRNG() : ChaChaPRNG(PRNG().getState()) {}
+
+    /**
+     * @brief Constructs a new ChaChaPRNG from the same seeds PRNG takes
+     * @param seed - words 0 to 3 are the key and word 4 the stream, ChaCha has no room for the rest
+     */
+    explicit ChaChaPRNG(const std::array<uint64_t, 16> &seed)
+    {
+        setSeed(seed);
+    }
+
+    /**
+     * @brief Constructs a new ChaChaPRNG from a 256 bit key
+     * @param key - the key, the first word holding the lowest key bytes
+     * @param stream - the nonce, different streams of the same key are independent
+     */
+    ChaChaPRNG(const std::array<uint64_t, 4> &key, uint64_t stream)
+    {
+        setKey(key, stream);
+    }
+
+    /**
+     * @brief Moves the generator state into a new ChaChaPRNG
+     *
+     * The moved from ChaChaPRNG is left with the same state, so don't use both.
+     */
+    ChaChaPRNG(ChaChaPRNG &&) = default;
+
+    /**
+     * @brief Moves the generator state from another ChaChaPRNG
+     * @return this ChaChaPRNG
+     */
+    ChaChaPRNG &operator=(ChaChaPRNG &&) = default;
+
+    /**
+     * @brief Rekeys the generator from a seed and starts again at block 0
+     * @param seed - words 0 to 3 are the key and word 4 the stream, ChaCha has no room for the rest
+     */
+    void setSeed(const std::array<uint64_t, 16> &seed)
+    {
+        setKey({{seed[0], seed[1], seed[2], seed[3]}}, seed[4]);
+    }
+
+    /**
+     * @brief Rekeys the generator and starts again at block 0
+     * @param key - the key, the first word holding the lowest key bytes
+     * @param stream - the nonce, different streams of the same key are independent
+     */
+    void setKey(const std::array<uint64_t, 4> &key, uint64_t stream)
+    {
+        // "expand 32-byte k"
+        input[0] = 0x61707865;
+        input[1] = 0x3320646e;
+        input[2] = 0x79622d32;
+        input[3] = 0x6b206574;
+        for(int i = 0; i < 4; i++)
+        {
+            input[4 + 2 * i] = static_cast<uint32_t>(key[i]);
+            input[5 + 2 * i] = static_cast<uint32_t>(key[i] >> 32);
+        }
+        input[14] = static_cast<uint32_t>(stream);
+        input[15] = static_cast<uint32_t>(stream >> 32);
+        seek(0);
+    }
+
+    /**
+     * @brief Moves to the start of a block of the keystream
+     *
+     * Each block is eight words, so after seek(block) the generator gives the same numbers as one
+     * that has drawn 8 * block words since it was keyed. Seeking is constant time.
+     *
+     * @param block - the block to move to
+     */
+    void seek(uint64_t block)
+    {
+        nextBlock = block;
+        position = bufferWords;
+    }
+
+    /**
+     * @brief Fills output with random uint64_ts
+     *
+     * Whole runs of blocks are generated straight into output, so this is faster than calling
+     * getRandomUint64() count times but produces exactly the same numbers.
+     *
+     * @param output - where the random numbers are written
+     * @param count - how many numbers to write
+     */
+    void fillUint64(uint64_t *output, std::size_t count)
+    {
+        PRNG_COUNT_CALL(callFillUint64);
+        fillWords(output, count);
+    }
+
+private:
+    friend class PRNGBase<ChaChaPRNG>;
+
+    static constexpr std::size_t bufferWords = prng_detail::chachaLanes * prng_detail::chachaBlockWords;
+
+    std::array<uint32_t, 16> input;
+    uint64_t nextBlock;
+    std::size_t position;
+    alignas(64) std::array<uint64_t, bufferWords> buffer;
+
+    // Whole runs of blocks straight into output, for fillUint64() and the bulk functions built on it
+    void fillWords(uint64_t *output, std::size_t count)
+    {
+        PRNG_COUNT_STEPS(count);
+        while(position < bufferWords && count > 0)
+        {
+            *output++ = buffer[position++];
+            count--;
+        }
+        while(count >= bufferWords)
+        {
+            generate(output);
+            output += bufferWords;
+            count -= bufferWords;
+        }
+        if(count > 0)
+        {
+            generate(buffer.data());
+            std::memcpy(output, buffer.data(), count * sizeof(uint64_t));
+            position = count;
+        }
+    }
+
+    uint64_t nextUint64()
+    {
+        if(position == bufferWords)
+        {
+            generate(buffer.data());
+            position = 0;
+        }
+        return buffer[position++];
+    }
+
+    // Generates the next chachaLanes blocks into output
+    void generate(uint64_t *output)
+    {
+        input[12] = static_cast<uint32_t>(nextBlock);
+        input[13] = static_cast<uint32_t>(nextBlock >> 32);
+        prng_detail::chachaBlocks(std::integral_constant<int, Rounds>(), input.data(), output);
+        nextBlock += prng_detail::chachaLanes;
+    }
+
+    // As with PRNG, copying would silently repeat the stream
+    ChaChaPRNG(const ChaChaPRNG &) = delete;
+};
+
+typedef ChaChaPRNG<8> ChaCha8PRNG;
+typedef ChaChaPRNG<12> ChaCha12PRNG;
+typedef ChaChaPRNG<20> ChaCha20PRNG;
+
+#endif // CHACHAPRNG_H
@@ -0,0 +1,207 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef CONSTEXPRPRNG_H
+#define CONSTEXPRPRNG_H
+
+#if __cplusplus < 201402L && !(defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#error "ConstexprPRNG.h requires C++14 or later"
+#endif
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+/**
+ * @brief A version of PRNG that can be run at compile time.
+ *
+ * Given the same seed it produces exactly the same sequence as PRNG, so tables built at compile
+ * time match what the run time generator would have made. Use it to move hash salts, Zobrist
+ * tables and test fixtures out of process startup.
+ */
+class ConstexprPRNG
+{
+public:
+    /**
+     * @brief Constructs a new ConstexprPRNG with a set seed
+     * @param seed - the value seed it should start with
+     */
+    constexpr ConstexprPRNG(const std::array<uint64_t, 16> &seed) : state{}, position(0)
+    {
+        for(std::size_t i = 0; i < 16; i++)
+        {
+            state[i] = seed[i];
+        }
+    }
+
+    /**
+     * @brief Generates a random uint64_t
+     * @return a uint64_t containing a random number
+     */
+    constexpr uint64_t getRandomUint64()
+    {
+        return xorshift1024();
+    }
+
+    /**
+     * @brief Generates a random number between 0 and maxValue (inclusive)
+     * @param maxValue - The highest value this should return
+     * @throw cassert ensuring maxValue != 0
+     * @return a uint64_t containing a random number
+     */
+    constexpr uint64_t getRandomUint64(uint64_t maxValue)
+    {
+        assert(maxValue != 0);
+        int leadingZeros = countLeadingZeros64(maxValue);
+
+        uint64_t randomInt = 0;
+        do
+        {
+            randomInt = xorshift1024() >> leadingZeros;
+        } while(randomInt > maxValue);
+
+        return randomInt;
+    }
+
+    /**
+     * @brief Generates a random number between 0 and 1
+     * @return a float containing a random number
+     */
+    constexpr float getRandomFloat()
+    {
+        return getRandomFloatType<float>();
+    }
+
+    /**
+     * @brief Generates a random number between 0 and 1
+     * @return a double containing a random number
+     */
+    constexpr double getRandomDouble()
+    {
+        return getRandomFloatType<double>();
+    }
+
+private:
+    uint64_t state[16];
+    unsigned long position;
+
+    template <class T>
+    constexpr T getRandomFloatType()
+    {
+        constexpr T epsilon = std::numeric_limits<T>::epsilon();
+        constexpr int digitsToKeep = std::numeric_limits<T>::digits-1;
+        constexpr int digitsToLose = std::numeric_limits<uint64_t>::digits - digitsToKeep;
+        return (xorshift1024() >> digitsToLose) * epsilon;
+    }
+
+    constexpr uint64_t xorshift1024()
+    {
+        uint64_t state0 = state[position];
+        position = (position + 1) % 16;
+        uint64_t state1 = state[position];
+        state1 ^= state1 << 31;
+        state1 ^= state1 >> 11;
+        state0 ^= state0 >> 30;
+        state[position] = state0 ^ state1;
+        return state[position] * 1181783497276652981LL;
+    }
+
+    static constexpr int countLeadingZeros64(uint64_t toCount)
+    {
+        int count = 0;
+        for(uint64_t bit = uint64_t(1) << 63; bit != 0 && !(toCount & bit); bit >>= 1)
+        {
+            count++;
+        }
+        return count;
+    }
+};
+
+/**
+ * @brief A fixed size table of random numbers that can be built at compile time.
+ */
+template <std::size_t N>
+struct RandomTable
+{
+    uint64_t values[N];
+
+    constexpr const uint64_t &operator[](std::size_t index) const
+    {
+        return values[index];
+    }
+
+    constexpr std::size_t size() const
+    {
+        return N;
+    }
+
+    constexpr const uint64_t *begin() const
+    {
+        return values;
+    }
+
+    constexpr const uint64_t *end() const
+    {
+        return values + N;
+    }
+};
+
+/**
+ * @brief Builds a table of N random uint64_ts
+ *
+ * Declare the result constexpr and the table is computed by the compiler:
+ * constexpr auto table = makeRandomTable<4096>(seed);
+ *
+ * @param seed - the seed to generate the table from
+ * @return the first N values PRNG would produce from seed
+ */
+template <std::size_t N>
+constexpr RandomTable<N> makeRandomTable(const std::array<uint64_t, 16> &seed)
+{
+    ConstexprPRNG rng(seed);
+    RandomTable<N> table{};
+    for(std::size_t i = 0; i < N; i++)
+    {
+        table.values[i] = rng.getRandomUint64();
+    }
+    return table;
+}
+
+/**
+ * @brief Builds a table of N random numbers between 0 and maxValue (inclusive)
+ * @param seed - the seed to generate the table from
+ * @param maxValue - The highest value the table should contain
+ * @throw cassert ensuring maxValue != 0
+ * @return the first N values PRNG::getRandomUint64(maxValue) would produce from seed
+ */
+template <std::size_t N>
+constexpr RandomTable<N> makeRandomTable(const std::array<uint64_t, 16> &seed, uint64_t maxValue)
+{
+    ConstexprPRNG rng(seed);
+    RandomTable<N> table{};
+    for(std::size_t i = 0; i < N; i++)
+    {
+        table.values[i] = rng.getRandomUint64(maxValue);
+    }
+    return table;
+}
+
+#endif // CONSTEXPRPRNG_H
@@ -0,0 +1,175 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PRNG_DISPATCH_X86
+#define PRNG_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define PRNG_TARGET_AVX512 __attribute__((target("avx512f,avx512dq,avx512vl,avx2,fma")))
+#define PRNG_ALWAYS_INLINE __attribute__((always_inline))
+#else
+#define PRNG_TARGET_AVX2
+#define PRNG_TARGET_AVX512
+#define PRNG_ALWAYS_INLINE
+#endif
+
+/**
+ * Runtime selection of the instruction set the bulk kernels run with.
+ *
+ * Each kernel is compiled three times, for the baseline the library is built with, for AVX2 with
+ * FMA and for AVX-512, and every call is routed to the best one the CPU supports. So one binary
+ * gets wide vectors on machines that have them without being built with -march.
+ *
+ * Set the environment variable PRNG_DISPATCH to generic, avx2 or avx512 to cap the level, e.g.
+ * to test each path on one machine. It can only lower the level, never enable instructions the
+ * CPU doesn't have.
+ */
+namespace prng_dispatch
+{
+
+enum Level
+{
+    generic,
+    avx2,
+    avx512
+};
+
+/**
+ * @brief Finds the best level this CPU supports, with cpuid
+ * @return the highest supported Level
+ */
+inline Level supportedLevel()
+{
+#ifdef PRNG_DISPATCH_X86
+    static const Level level = []() {
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")
+           && __builtin_cpu_supports("avx512vl"))
+        {
+            return avx512;
+        }
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            return avx2;
+        }
+        return generic;
+    }();
+    return level;
+#else
+    return generic;
+#endif
+}
+
+/**
+ * @brief Returns the name of a level, as used by PRNG_DISPATCH
+ * @param level - the level to name
+ * @return generic, avx2 or avx512
+ */
+inline const char *levelName(Level level)
+{
+    return level == avx512 ? "avx512" : level == avx2 ? "avx2" : "generic";
+}
+
+inline std::atomic<int> &currentLevel()
+{
+    static std::atomic<int> level([]() {
+        Level best = supportedLevel();
+        const char *requested = std::getenv("PRNG_DISPATCH");
+        if(requested != nullptr)
+        {
+            for(Level capped : {generic, avx2})
+            {
+                if(std::strcmp(requested, levelName(capped)) == 0 && capped < best)
+                {
+                    best = capped;
+                }
+            }
+        }
+        return static_cast<int>(best);
+    }());
+    return level;
+}
+
+/**
+ * @brief Returns the level the kernels are currently running with
+ * @return the active Level
+ */
+inline Level activeLevel()
+{
+    return static_cast<Level>(currentLevel().load(std::memory_order_relaxed));
+}
+
+/**
+ * @brief Changes the level the kernels run with, mainly so tests can compare the paths
+ * @param level - the level to use, lowered to what the CPU supports
+ * @return the level actually used
+ */
+inline Level setLevel(Level level)
+{
+    Level used = level < supportedLevel() ? level : supportedLevel();
+    currentLevel().store(static_cast<int>(used), std::memory_order_relaxed);
+    return used;
+}
+
+}
+
+/*
+ * Defines name(...) to call kernel(...) compiled for the active level. The kernel must be a
+ * PRNG_ALWAYS_INLINE function template so that each copy is built with its own target's
+ * instructions; whatever it calls should be small enough to be inlined too.
+ */
+#define PRNG_DISPATCHED_KERNEL(name, kernel) \
+    template <class... Args> \
+    void name##Generic(Args... args) \
+    { \
+        kernel(args...); \
+    } \
+    template <class... Args> \
+    PRNG_TARGET_AVX2 void name##Avx2(Args... args) \
+    { \
+        kernel(args...); \
+    } \
+    template <class... Args> \
+    PRNG_TARGET_AVX512 void name##Avx512(Args... args) \
+    { \
+        kernel(args...); \
+    } \
+    template <class... Args> \
+    inline void name(Args... args) \
+    { \
+        switch(prng_dispatch::activeLevel()) \
+        { \
+        case prng_dispatch::avx512: \
+            name##Avx512(args...); \
+            break; \
+        case prng_dispatch::avx2: \
+            name##Avx2(args...); \
+            break; \
+        default: \
+            name##Generic(args...); \
+        } \
+    }
+
+#endif // DISPATCH_H
@@ -0,0 +1,536 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef DISTRIBUTIONS_H
+#define DISTRIBUTIONS_H
+
+#include "PRNG.h"
+#include "Dispatch.h"
+#include "FastMath.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace prng_detail
+{
+
+// Words generated per pass of the bulk samplers, small enough to stay in L1
+const std::size_t bulkWords = 256;
+
+/*
+ * Turns a word into a uniform on [0, 1) by writing its bits straight into the mantissa of a
+ * number in [1, 2), which unlike an integer conversion is a vector operation on every SIMD level.
+ * Floats only need 23 bits so they take two from each word, the top bits when high is set and
+ * the bits below them otherwise.
+ */
+inline float wordToUnit(uint64_t word, float, bool high)
+{
+    uint32_t bits = high ? static_cast<uint32_t>(word >> 41) : static_cast<uint32_t>(word >> 9) & 0x7fffff;
+    return fastmath::fromBits<float>(bits | 0x3f800000) - 1.0f;
+}
+
+inline double wordToUnit(uint64_t word, double, bool)
+{
+    return fastmath::fromBits<double>((word >> 12) | 0x3ff0000000000000ULL) - 1.0;
+}
+
+// The same but on (0, 1], for when the result will be passed to log
+template <class T>
+inline T wordToOpenUnit(uint64_t word, T, bool high)
+{
+    return 1 - wordToUnit(word, T(), high);
+}
+
+/*
+ * Box-Muller on a block of uniform words. The first half of output gets the cosine branch
+ * and the second half the sine branch, so every store is contiguous.
+ */
+template <class T>
+PRNG_ALWAYS_INLINE inline void boxMullerKernel(const uint64_t *words, T *output, std::size_t pairs, T mean, T standardDeviation)
+{
+    // A float pair is made from one word, a double pair from two
+    const bool packed = sizeof(T) == sizeof(float);
+    for(std::size_t i = 0; i < pairs; i++)
+    {
+        uint64_t radiusWord = words[i];
+        uint64_t angleWord = packed ? words[i] : words[pairs + i];
+        T radius = fastmath::sqrt(T(-2) * fastmath::log(wordToOpenUnit(radiusWord, T(), true)));
+        T sine, cosine;
+        fastmath::sinCosTurns(wordToUnit(angleWord, T(), false), sine, cosine);
+        output[i] = mean + standardDeviation * radius * cosine;
+        output[pairs + i] = mean + standardDeviation * radius * sine;
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(boxMuller, boxMullerKernel)
+
+template <class T>
+inline void fillNormal(PRNG &rng, T *output, std::size_t count, T mean, T standardDeviation)
+{
+    const std::size_t wordsPerPair = sizeof(T) == sizeof(float) ? 1 : 2;
+    const std::size_t pairsPerPass = bulkWords / wordsPerPair;
+    uint64_t words[bulkWords];
+    while(count >= 2)
+    {
+        std::size_t pairs = count / 2 < pairsPerPass ? count / 2 : pairsPerPass;
+        rng.fillUint64(words, pairs * wordsPerPair);
+        boxMuller(words, output, pairs, mean, standardDeviation);
+        output += 2 * pairs;
+        count -= 2 * pairs;
+    }
+    if(count == 1)
+    {
+        T pair[2];
+        rng.fillUint64(words, wordsPerPair);
+        boxMuller(words, pair, 1, mean, standardDeviation);
+        output[0] = pair[0];
+    }
+}
+
+template <class T>
+PRNG_ALWAYS_INLINE inline void exponentiateKernel(T *output, std::size_t count)
+{
+    for(std::size_t i = 0; i < count; i++)
+    {
+        output[i] = fastmath::exp(output[i]);
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(exponentiate, exponentiateKernel)
+
+// A uniform on (0, 1], safe to take the log of
+inline double getOpenUnit(PRNG &rng)
+{
+    return 1 - rng.getRandomDouble();
+}
+
+/*
+ * A standard normal for the scalar samplers. Only the cosine branch of Box-Muller is used, as
+ * keeping the sine for the next call would make every sampler stateful.
+ */
+inline double getStandardNormal(PRNG &rng)
+{
+    double radius = std::sqrt(-2 * std::log(getOpenUnit(rng)));
+    return radius * std::cos(6.28318530717958647692 * rng.getRandomDouble());
+}
+
+/*
+ * lgamma(k + 1) minus its Stirling approximation. Hormann's rejection tests are written in terms
+ * of this so they don't lose precision subtracting huge lgammas when n is large.
+ */
+inline double stirlingTail(double k)
+{
+    static const double small[10] = {
+        0.08106146679532733, 0.04134069595540946, 0.027677925684997717, 0.02079067210376584,
+        0.016644691189820815, 0.013876128823072431, 0.01189670994589287, 0.010411265261973224,
+        0.009255462182709007, 0.008330563433359028};
+    if(k < 10)
+    {
+        return small[static_cast<int>(k)];
+    }
+    double squared = (k + 1) * (k + 1);
+    return (1.0 / 12 - (1.0 / 360 - 1.0 / 1260 / squared) / squared) / (k + 1);
+}
+
+/*
+ * Inversion by sequential search of a precomputed CDF, for distributions over 0, 1, 2, ... with
+ * a small mean so the expected search is short. The table stops once the CDF rounds to 1.
+ */
+class InversionTable
+{
+public:
+    InversionTable() = default;
+
+    /*
+     * nextRatio(k) gives P(k + 1) / P(k), last is the largest value that can be returned.
+     */
+    template <class Ratio>
+    InversionTable(double first, uint64_t last, Ratio nextRatio)
+    {
+        double probability = first;
+        double cumulative = first;
+        cdf.push_back(cumulative);
+        for(uint64_t k = 0; k < last && cumulative < 1 && probability > 0; k++)
+        {
+            probability *= nextRatio(static_cast<double>(k));
+            cumulative += probability;
+            cdf.push_back(cumulative);
+        }
+        // Whatever rounding error is left goes to the last value so the search always ends
+        cdf.back() = 1;
+    }
+
+    uint64_t operator()(PRNG &rng) const
+    {
+        double u = rng.getRandomDouble();
+        uint64_t k = 0;
+        while(u >= cdf[k])
+        {
+            k++;
+        }
+        return k;
+    }
+
+private:
+    std::vector<double> cdf;
+};
+
+}
+
+/**
+ * @brief Fills output with normally distributed random numbers
+ *
+ * Uses a branch-free Box-Muller transform over blocks of uniforms from PRNG::fillUint64(), with
+ * the fastmath approximations so the loop vectorises. Each float pair uses 23 bits of uniform
+ * for the radius, so the tails are cut off beyond about 5.6 standard deviations, or 8.5 for doubles.
+ *
+ * @param rng - the generator to draw from
+ * @param output - where count random numbers are written
+ * @param count - how many numbers to write
+ * @param mean - the mean of the distribution
+ * @param standardDeviation - the standard deviation of the distribution
+ */
+inline void fillNormal(PRNG &rng, float *output, std::size_t count, float mean = 0, float standardDeviation = 1)
+{
+    prng_detail::fillNormal(rng, output, count, mean, standardDeviation);
+}
+
+/**
+ * @brief Fills output with normally distributed random numbers
+ * @param rng - the generator to draw from
+ * @param output - where count random numbers are written
+ * @param count - how many numbers to write
+ * @param mean - the mean of the distribution
+ * @param standardDeviation - the standard deviation of the distribution
+ */
+inline void fillNormal(PRNG &rng, double *output, std::size_t count, double mean = 0, double standardDeviation = 1)
+{
+    prng_detail::fillNormal(rng, output, count, mean, standardDeviation);
+}
+
+/**
+ * @brief Fills output with log-normally distributed random numbers, i.e. e^X where X is normal
+ * @param rng - the generator to draw from
+ * @param output - where count random numbers are written
+ * @param count - how many numbers to write
+ * @param mean - the mean of the underlying normal distribution
+ * @param standardDeviation - the standard deviation of the underlying normal distribution
+ */
+inline void fillLogNormal(PRNG &rng, float *output, std::size_t count, float mean = 0, float standardDeviation = 1)
+{
+    prng_detail::fillNormal(rng, output, count, mean, standardDeviation);
+    prng_detail::exponentiate(output, count);
+}
+
+/**
+ * @brief Fills output with log-normally distributed random numbers, i.e. e^X where X is normal
+ * @param rng - the generator to draw from
+ * @param output - where count random numbers are written
+ * @param count - how many numbers to write
+ * @param mean - the mean of the underlying normal distribution
+ * @param standardDeviation - the standard deviation of the underlying normal distribution
+ */
+inline void fillLogNormal(PRNG &rng, double *output, std::size_t count, double mean = 0, double standardDeviation = 1)
+{
+    prng_detail::fillNormal(rng, output, count, mean, standardDeviation);
+    prng_detail::exponentiate(output, count);
+}
+
+/**
+ * @brief Draws Poisson distributed numbers with a fixed mean
+ *
+ * The setup is done once on construction. Means below 10 are drawn by inverting a table of the
+ * CDF, larger ones by Hormann's PTRS transformed rejection. Both take O(1) expected time.
+ */
+class PoissonDistribution
+{
+public:
+    /**
+     * @brief Prepares to draw from a Poisson distribution
+     * @param mean - the mean of the distribution
+     * @throw cassert ensuring mean >= 0
+     */
+    explicit PoissonDistribution(double mean) : mean(mean)
+    {
+        assert(mean >= 0);
+        if(mean < 10)
+        {
+            table = prng_detail::InversionTable(std::exp(-mean), UINT64_MAX,
+                                                [mean](double k) { return mean / (k + 1); });
+            return;
+        }
+        b = 0.931 + 2.53 * std::sqrt(mean);
+        a = -0.059 + 0.02483 * b;
+        logInverseAlpha = std::log(1.1239 + 1.1328 / (b - 3.4));
+        acceptanceLimit = 0.9277 - 3.6224 / (b - 2);
+        logMean = std::log(mean);
+    }
+
+    /**
+     * @brief Draws a random number from the distribution
+     * @param rng - the generator to draw from
+     * @return a Poisson distributed random number
+     */
+    uint64_t operator()(PRNG &rng) const
+    {
+        if(mean < 10)
+        {
+            return table(rng);
+        }
+        while(true)
+        {
+            double u = rng.getRandomDouble() - 0.5;
+            double v = prng_detail::getOpenUnit(rng);
+            double us = 0.5 - std::fabs(u);
+            double k = std::floor((2 * a / us + b) * u + mean + 0.43);
+            if(us >= 0.07 && v <= acceptanceLimit)
+            {
+                return static_cast<uint64_t>(k);
+            }
+            if(k < 0 || (us < 0.013 && v > us))
+            {
+                continue;
+            }
+            if(std::log(v) + logInverseAlpha - std::log(a / (us * us) + b)
+               <= -mean + k * logMean - std::lgamma(k + 1))
+            {
+                return static_cast<uint64_t>(k);
+            }
+        }
+    }
+
+private:
+    double mean;
+    prng_detail::InversionTable table;
+    double a = 0;
+    double b = 0;
+    double logInverseAlpha = 0;
+    double acceptanceLimit = 0;
+    double logMean = 0;
+};
+
+/**
+ * @brief Draws binomially distributed numbers, the number of successes in a fixed number of trials
+ *
+ * The setup is done once on construction. When the expected count of the rarer outcome is below
+ * 10 it's drawn by inverting a table of the CDF, otherwise by Hormann's BTRS transformed
+ * rejection. Both take O(1) expected time however many trials there are.
+ */
+class BinomialDistribution
+{
+public:
+    /**
+     * @brief Prepares to draw from a binomial distribution
+     * @param trials - the number of trials
+     * @param probability - the chance each trial succeeds
+     * @throw cassert ensuring 0 <= probability <= 1
+     */
+    BinomialDistribution(uint64_t trials, double probability)
+        : trials(trials), flipped(probability > 0.5)
+    {
+        assert(probability >= 0 && probability <= 1);
+        // Work with whichever outcome is rarer, then flip the result back
+        double p = flipped ? 1 - probability : probability;
+        double q = 1 - p;
+        double n = static_cast<double>(trials);
+        useTable = n * p < 10;
+        if(useTable)
+        {
+            table = prng_detail::InversionTable(std::exp(n * std::log1p(-p)), trials,
+                                                [n, p, q](double k) { return (n - k) / (k + 1) * p / q; });
+            return;
+        }
+        double deviation = std::sqrt(n * p * q);
+        b = 1.15 + 2.53 * deviation;
+        a = -0.0873 + 0.0248 * b + 0.01 * p;
+        c = n * p + 0.5;
+        acceptanceLimit = 0.92 - 4.2 / b;
+        alpha = (2.83 + 5.1 / b) * deviation;
+        oddsRatio = p / q;
+        mode = std::floor((n + 1) * p);
+        modeTerm = (mode + 0.5) * std::log((mode + 1) / (oddsRatio * (n - mode + 1)))
+                   + prng_detail::stirlingTail(mode) + prng_detail::stirlingTail(n - mode);
+    }
+
+    /**
+     * @brief Draws a random number from the distribution
+     * @param rng - the generator to draw from
+     * @return a random number between 0 and trials (inclusive)
+     */
+    uint64_t operator()(PRNG &rng) const
+    {
+        uint64_t successes = useTable ? table(rng) : rejectionSample(rng);
+        return flipped ? trials - successes : successes;
+    }
+
+private:
+    uint64_t trials;
+    bool flipped;
+    bool useTable;
+    prng_detail::InversionTable table;
+    double a = 0;
+    double b = 0;
+    double c = 0;
+    double acceptanceLimit = 0;
+    double alpha = 0;
+    double oddsRatio = 0;
+    double mode = 0;
+    double modeTerm = 0;
+
+    uint64_t rejectionSample(PRNG &rng) const
+    {
+        double n = static_cast<double>(trials);
+        while(true)
+        {
+            double u = rng.getRandomDouble() - 0.5;
+            double v = prng_detail::getOpenUnit(rng);
+            double us = 0.5 - std::fabs(u);
+            double k = std::floor((2 * a / us + b) * u + c);
+            if(k < 0 || k > n)
+            {
+                continue;
+            }
+            if(us >= 0.07 && v <= acceptanceLimit)
+            {
+                return static_cast<uint64_t>(k);
+            }
+            double logV = std::log(v * alpha / (a / (us * us) + b));
+            double bound = modeTerm + (n + 1) * std::log((n - mode + 1) / (n - k + 1))
+                           + (k + 0.5) * std::log(oddsRatio * (n - k + 1) / (k + 1))
+                           - prng_detail::stirlingTail(k) - prng_detail::stirlingTail(n - k);
+            if(logV <= bound)
+            {
+                return static_cast<uint64_t>(k);
+            }
+        }
+    }
+};
+
+/**
+ * @brief Draws gamma distributed numbers
+ *
+ * Uses Marsaglia and Tsang's method, which accepts about 95% of the time or better for every
+ * shape. Shapes below 1 draw with shape + 1 and scale the result down by a uniform power.
+ */
+class GammaDistribution
+{
+public:
+    /**
+     * @brief Prepares to draw from a gamma distribution
+     * @param shape - the shape parameter, often called k or alpha
+     * @param scale - the scale parameter, often called theta
+     * @throw cassert ensuring shape > 0 and scale > 0
+     */
+    GammaDistribution(double shape, double scale = 1) : scale(scale)
+    {
+        assert(shape > 0 && scale > 0);
+        inverseShape = shape < 1 ? 1 / shape : 0;
+        d = (shape < 1 ? shape + 1 : shape) - 1.0 / 3;
+        c = 1 / std::sqrt(9 * d);
+    }
+
+    /**
+     * @brief Draws a random number from the distribution
+     * @param rng - the generator to draw from
+     * @return a gamma distributed random number
+     */
+    double operator()(PRNG &rng) const
+    {
+        double result = 0;
+        while(true)
+        {
+            double x = prng_detail::getStandardNormal(rng);
+            double v = 1 + c * x;
+            if(v <= 0)
+            {
+                continue;
+            }
+            v = v * v * v;
+            double u = prng_detail::getOpenUnit(rng);
+            double squared = x * x;
+            if(u < 1 - 0.0331 * squared * squared
+               || std::log(u) < 0.5 * squared + d * (1 - v + std::log(v)))
+            {
+                result = d * v;
+                break;
+            }
+        }
+        if(inverseShape != 0)
+        {
+            result *= std::pow(prng_detail::getOpenUnit(rng), inverseShape);
+        }
+        return result * scale;
+    }
+
+private:
+    double scale;
+    double inverseShape;
+    double d;
+    double c;
+};
+
+/**
+ * @brief Generates a Poisson distributed random number
+ *
+ * Prepares the distribution on every call, use PoissonDistribution to draw many with the same mean.
+ *
+ * @param rng - the generator to draw from
+ * @param mean - the mean of the distribution
+ * @throw cassert ensuring mean >= 0
+ * @return a Poisson distributed random number
+ */
+inline uint64_t getRandomPoisson(PRNG &rng, double mean)
+{
+    return PoissonDistribution(mean)(rng);
+}
+
+/**
+ * @brief Generates the number of successes in a fixed number of trials
+ *
+ * Prepares the distribution on every call, use BinomialDistribution to draw many with the same
+ * parameters.
+ *
+ * @param rng - the generator to draw from
+ * @param trials - the number of trials
+ * @param probability - the chance each trial succeeds
+ * @throw cassert ensuring 0 <= probability <= 1
+ * @return a random number between 0 and trials (inclusive)
+ */
+inline uint64_t getRandomBinomial(PRNG &rng, uint64_t trials, double probability)
+{
+    return BinomialDistribution(trials, probability)(rng);
+}
+
+/**
+ * @brief Generates a gamma distributed random number
+ * @param rng - the generator to draw from
+ * @param shape - the shape parameter, often called k or alpha
+ * @param scale - the scale parameter, often called theta
+ * @throw cassert ensuring shape > 0 and scale > 0
+ * @return a gamma distributed random number
+ */
+inline double getRandomGamma(PRNG &rng, double shape, double scale = 1)
+{
+    return GammaDistribution(shape, scale)(rng);
+}
+
+#endif // DISTRIBUTIONS_H
@@ -0,0 +1,238 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+// The series loops have fixed trip counts and must be fully unrolled for the callers to vectorise
+#if defined(__clang__)
+#define FASTMATH_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__)
+#define FASTMATH_UNROLL _Pragma("GCC unroll 16")
+#else
+#define FASTMATH_UNROLL
+#endif
+
+/**
+ * Branch-free approximations of the few transcendental functions the bulk samplers need.
+ *
+ * Unlike the std versions these never set errno or call out to libm, so loops over them
+ * vectorise. They're only accurate over the domains stated, which is all the samplers use:
+ * about 2 ulp for float and 4 ulp for double.
+ */
+namespace fastmath
+{
+
+template <class T>
+struct FloatBits;
+
+template <>
+struct FloatBits<float>
+{
+    typedef uint32_t type;
+    static constexpr int mantissaBits = 23;
+    static constexpr int exponentBias = 127;
+    // Enough terms of each series to reach float precision
+    static constexpr int logTerms = 5;
+    static constexpr int expTerms = 7;
+    static constexpr int sinTerms = 5;
+};
+
+template <>
+struct FloatBits<double>
+{
+    typedef uint64_t type;
+    static constexpr int mantissaBits = 52;
+    static constexpr int exponentBias = 1023;
+    static constexpr int logTerms = 11;
+    static constexpr int expTerms = 13;
+    static constexpr int sinTerms = 9;
+};
+
+template <class T>
+inline typename FloatBits<T>::type toBits(T value)
+{
+    typename FloatBits<T>::type bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+template <class T>
+inline T fromBits(typename FloatBits<T>::type bits)
+{
+    T value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief The natural logarithm of a positive, normal, finite value
+ *
+ * Splits off the exponent and evaluates the atanh series for the mantissa on [sqrt(1/2), sqrt(2)).
+ */
+template <class T>
+inline T log(T x)
+{
+    typedef typename FloatBits<T>::type Bits;
+    const int mantissaBits = FloatBits<T>::mantissaBits;
+    const Bits mantissaMask = (Bits(1) << mantissaBits) - 1;
+
+    // Offsetting by the bits of sqrt(1/2) moves mantissas above sqrt(2) into the next exponent
+    // with integer arithmetic alone, leaving the mantissa in [sqrt(1/2), sqrt(2))
+    const Bits rootHalf = toBits(T(0.707106781186547524401));
+    Bits bits = toBits(x) + (toBits(T(1)) - rootHalf);
+    int exponent = static_cast<int>(bits >> mantissaBits) - FloatBits<T>::exponentBias;
+    T mantissa = fromBits<T>((bits & mantissaMask) + rootHalf);
+
+    T s = (mantissa - 1) / (mantissa + 1);
+    T z = s * s;
+    T series = T(1) / (2 * FloatBits<T>::logTerms - 1);
+    FASTMATH_UNROLL
+    for(int k = FloatBits<T>::logTerms - 2; k >= 0; k--)
+    {
+        series = series * z + T(1) / (2 * k + 1);
+    }
+    return exponent * T(0.693147180559945309417) + 2 * s * series;
+}
+
+/**
+ * @brief e to the power of x
+ *
+ * Accurate for x in [-708, 708] (double) or [-87, 87] (float), above that it returns infinity
+ * and below it zero.
+ */
+template <class T>
+inline T exp(T x)
+{
+    typedef typename FloatBits<T>::type Bits;
+    typedef typename std::make_signed<Bits>::type SignedBits;
+    const Bits signBit = Bits(1) << (sizeof(Bits) * 8 - 1);
+    const SignedBits limit = toBits(std::is_same<T, float>::value ? T(87) : T(708));
+
+    // Range checks are done on the bits as integers. GCC won't evaluate floating point arithmetic
+    // speculatively while it might trap, so clamping with floating point compares would put
+    // branches back into the callers' loops.
+    Bits bits = toBits(x);
+    Bits sign = bits & signBit;
+    SignedBits magnitude = static_cast<SignedBits>(bits ^ sign);
+    bool outOfRange = magnitude > limit;
+    x = fromBits<T>(static_cast<Bits>(outOfRange ? limit : magnitude) | sign);
+
+    // x = n ln2 + r with |r| <= ln2 / 2, ln2 split in two so r keeps full precision
+    int n = static_cast<int>(x * T(1.44269504088896340736) + std::copysign(T(0.5), x));
+    T r = x - n * T(0.693145751953125) - n * T(1.42860682030941723212e-6);
+
+    T series = 1;
+    FASTMATH_UNROLL
+    for(int k = FloatBits<T>::expTerms; k >= 1; k--)
+    {
+        series = series * r * (T(1) / k) + 1;
+    }
+    // The series is always positive, so saturating the scale saturates the result. Selecting the
+    // result itself would let the compiler move the whole calculation under a branch.
+    Bits scale = static_cast<Bits>(n + FloatBits<T>::exponentBias) << FloatBits<T>::mantissaBits;
+    Bits saturated = sign ? Bits(0) : toBits(std::numeric_limits<T>::infinity());
+    return series * fromBits<T>(outOfRange ? saturated : scale);
+}
+
+/**
+ * @brief Computes sin(2 pi turns) and cos(2 pi turns) together, for turns in [0, 1]
+ *
+ * The turn is reduced to an eighth of a circle around the nearest quadrant, where short Taylor
+ * series are accurate, and the quadrant is then applied with selects rather than branches.
+ */
+template <class T>
+inline void sinCosTurns(T turns, T &sine, T &cosine)
+{
+    T quarters = turns * 4;
+    int quadrant = static_cast<int>(quarters + T(0.5));
+    T angle = (quarters - quadrant) * T(1.57079632679489661923);
+    T angleSquared = angle * angle;
+
+    const int terms = FloatBits<T>::sinTerms;
+    T sinSeries = 1;
+    T cosSeries = 1;
+    FASTMATH_UNROLL
+    for(int k = terms - 1; k >= 1; k--)
+    {
+        sinSeries = 1 - sinSeries * angleSquared * (T(1) / ((2 * k) * (2 * k + 1)));
+        cosSeries = 1 - cosSeries * angleSquared * (T(1) / ((2 * k - 1) * (2 * k)));
+    }
+    T s = angle * sinSeries;
+    T c = cosSeries;
+
+    quadrant &= 3;
+    T swappedSin = (quadrant & 1) ? c : s;
+    T swappedCos = (quadrant & 1) ? s : c;
+    sine = (quadrant & 2) ? -swappedSin : swappedSin;
+    cosine = ((quadrant + 1) & 2) ? -swappedCos : swappedCos;
+}
+
+/**
+ * @brief The square root of a non-negative, finite value
+ *
+ * std::sqrt has an errno path that stops loops vectorising, so this refines the classic bit
+ * trick estimate of 1 / sqrt(x) with Newton's method and multiplies back by x.
+ */
+template <class T>
+inline T sqrt(T x)
+{
+    typedef typename FloatBits<T>::type Bits;
+    const Bits magic = sizeof(T) == sizeof(float) ? Bits(0x5f375a86) : Bits(0x5fe6eb50c7b537a9ULL);
+    const int iterations = sizeof(T) == sizeof(float) ? 3 : 4;
+
+    T estimate = fromBits<T>(magic - (toBits(x) >> 1));
+    FASTMATH_UNROLL
+    for(int i = 0; i < iterations; i++)
+    {
+        estimate = estimate * (T(1.5) - T(0.5) * x * estimate * estimate);
+    }
+    return x * estimate;
+}
+
+/**
+ * @brief The cube root of a positive value in the normal range of float
+ *
+ * The same idea as sqrt: a bit trick estimate refined with Newton's method. The estimate is
+ * always made in single precision, where dividing the bits by 3 is still a vector operation.
+ */
+template <class T>
+inline T cbrt(T x)
+{
+    const int iterations = sizeof(T) == sizeof(float) ? 3 : 4;
+
+    T estimate = fromBits<float>(toBits(static_cast<float>(x)) / 3 + 0x2a508935);
+    FASTMATH_UNROLL
+    for(int i = 0; i < iterations; i++)
+    {
+        estimate = estimate - (estimate - x / (estimate * estimate)) * (T(1) / 3);
+    }
+    return estimate;
+}
+
+}
+
+#undef FASTMATH_UNROLL
+#endif // FASTMATH_H
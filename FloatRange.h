@@ -0,0 +1,214 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef FLOATRANGE_H
+#define FLOATRANGE_H
+
+#include "Dispatch.h"
+#include "FastMath.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace prng_detail
+{
+
+/*
+ * A uniform on [0, 1) from the top bits of a word, the same bits getRandomFloat() and
+ * getRandomDouble() use. Writing them into the mantissa of a number in [1, 2) and subtracting 1,
+ * which is exact, avoids an integer conversion and is a vector operation on every SIMD level.
+ */
+inline float unitFromTopBits(uint64_t word, float)
+{
+    return fastmath::fromBits<float>(static_cast<uint32_t>(word >> 41) | 0x3f800000U) - 1.0f;
+}
+
+inline double unitFromTopBits(uint64_t word, double)
+{
+    return fastmath::fromBits<double>((word >> 12) | 0x3ff0000000000000ULL) - 1.0;
+}
+
+/*
+ * Long double's layout varies: it can be the same as double, x87's 64 bit mantissa or a 113 bit
+ * quad. So it's converted, keeping as many top bits as the mantissa holds, up to the whole word.
+ */
+template <class T>
+inline T unitFromConvertedBits(uint64_t word)
+{
+    const int keep = std::numeric_limits<T>::digits - 1 < 64 ? std::numeric_limits<T>::digits - 1 : 64;
+    return static_cast<T>(word >> ((64 - keep) % 64)) * std::ldexp(T(1), -keep);
+}
+
+inline long double unitFromTopBits(uint64_t word, long double)
+{
+    return unitFromConvertedBits<long double>(word);
+}
+
+template <class T>
+PRNG_ALWAYS_INLINE inline void floatRangeKernel(const uint64_t *words, T *output, std::size_t count, T lowest,
+                                                T scale)
+{
+    for(std::size_t i = 0; i < count; i++)
+    {
+        output[i] = unitFromTopBits(words[i], T()) * scale + lowest;
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(floatRange, floatRangeKernel)
+
+}
+
+/**
+ * @brief Draws floating point numbers uniformly between two bounds, with the setup done once.
+ *
+ * A draw is the top bits of a word written into a mantissa, then a single multiply and add,
+ * which compilers fuse into an FMA where the target has one.
+ *
+ * Results never leave [min(), max()], even when max() - min() rounds up. The scale is taken
+ * down until min() + scale rounds to at most max(), and because a unit below 1 times the scale
+ * can round to at most the scale, rounded either separately or in an FMA, the sum can't pass it.
+ *
+ * Where max() - min() overflows, e.g. from -DBL_MAX to DBL_MAX, half the scale is added twice
+ * instead, which is slower but stays finite.
+ */
+template <class T>
+class FloatRange
+{
+public:
+    /**
+     * @brief Prepares to draw numbers between minValue and maxValue (inclusive), in either order
+     * @param minValue - one bound
+     * @param maxValue - the other bound
+     * @throw cassert ensuring the bounds are finite
+     */
+    FloatRange(T minValue, T maxValue)
+        : lowest(minValue < maxValue ? minValue : maxValue), highest(minValue < maxValue ? maxValue : minValue),
+          scale(highest - lowest), wide(!std::isfinite(scale))
+    {
+        static_assert(std::is_floating_point<T>::value, "FloatRange requires a floating point type");
+        assert(std::isfinite(lowest) && std::isfinite(highest));
+        if(wide)
+        {
+            // Rounding is monotonic, so if the largest unit's halves can't pass highest no unit's can
+            scale = highest / 2 - lowest / 2;
+            while((lowest + scale) + scale > highest)
+            {
+                scale = std::nextafter(scale, T(0));
+            }
+            return;
+        }
+        while(lowest + scale > highest)
+        {
+            scale = std::nextafter(scale, T(0));
+        }
+    }
+
+    /**
+     * @brief Draws a number
+     * @param rng - any of the library's generators
+     * @return a uniformly distributed number in [min(), max()]
+     */
+    template <class Engine>
+    T operator()(Engine &rng) const
+    {
+        return fromWord(rng.getRandomUint64());
+    }
+
+    /**
+     * @brief Maps a random word to a number in the range, for words from elsewhere
+     * @param word - a uniformly distributed word
+     * @return a uniformly distributed number in [min(), max()]
+     */
+    T fromWord(uint64_t word) const
+    {
+        if(wide)
+        {
+            T half = prng_detail::unitFromTopBits(word, T()) * scale;
+            return (lowest + half) + half;
+        }
+        return prng_detail::unitFromTopBits(word, T()) * scale + lowest;
+    }
+
+    /**
+     * @brief Fills output with numbers in the range
+     *
+     * Each number takes a word, in the same order as calling operator() count times. The
+     * generic kernel gives exactly the same numbers; the AVX2 and AVX-512 ones use FMA, so may
+     * differ in the last bit, but stay in range.
+     *
+     * @param rng - any of the library's generators
+     * @param output - where the numbers are written
+     * @param count - how many numbers to write
+     */
+    template <class Engine>
+    void fill(Engine &rng, T *output, std::size_t count) const
+    {
+        const std::size_t blockWords = 256;
+        uint64_t words[blockWords];
+        while(count > 0)
+        {
+            std::size_t block = count < blockWords ? count : blockWords;
+            rng.fillUint64(words, block);
+            if(wide)
+            {
+                for(std::size_t i = 0; i < block; i++)
+                {
+                    output[i] = fromWord(words[i]);
+                }
+            }
+            else
+            {
+                prng_detail::floatRange(static_cast<const uint64_t *>(words), output, block, lowest, scale);
+            }
+            output += block;
+            count -= block;
+        }
+    }
+
+    /**
+     * @brief Returns the lower bound
+     * @return the smaller of the bounds the range was made with
+     */
+    T min() const
+    {
+        return lowest;
+    }
+
+    /**
+     * @brief Returns the upper bound
+     * @return the larger of the bounds the range was made with
+     */
+    T max() const
+    {
+        return highest;
+    }
+
+private:
+    T lowest;
+    T highest;
+    // Half the range when the range overflows
+    T scale;
+    bool wide;
+};
+
+#endif // FLOATRANGE_H
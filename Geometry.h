@@ -0,0 +1,259 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include "Distributions.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace prng_detail
+{
+
+template <class T>
+inline void assertFloatingPoint()
+{
+    static_assert(std::is_same<T, float>::value || std::is_same<T, double>::value,
+                  "only float and double are supported");
+}
+
+// Words needed for each point that uses the given number of uniforms, floats pack two per word
+template <class T>
+inline std::size_t wordsPerPoint(std::size_t uniforms)
+{
+    return sizeof(T) == sizeof(float) ? (uniforms + 1) / 2 : uniforms;
+}
+
+/*
+ * The uniform-th uniform of point i in a block laid out by fillPoints. Each uniform has its own
+ * run of words so that every load in the kernels is contiguous.
+ */
+template <class T>
+inline T blockUnit(const uint64_t *words, std::size_t points, std::size_t uniform, std::size_t i)
+{
+    if(sizeof(T) == sizeof(float))
+    {
+        return wordToUnit(words[(uniform / 2) * points + i], T(), uniform % 2 == 0);
+    }
+    return wordToUnit(words[uniform * points + i], T(), false);
+}
+
+/*
+ * Calls kernel(words, first, points) for successive blocks of points, each with enough random
+ * words for the given number of uniforms per point.
+ */
+template <class T, class Kernel>
+inline void fillPoints(PRNG &rng, std::size_t count, std::size_t uniforms, Kernel kernel)
+{
+    uint64_t words[bulkWords];
+    const std::size_t pointsPerPass = bulkWords / wordsPerPoint<T>(uniforms);
+    for(std::size_t first = 0; first < count; first += pointsPerPass)
+    {
+        std::size_t points = count - first < pointsPerPass ? count - first : pointsPerPass;
+        rng.fillUint64(words, points * wordsPerPoint<T>(uniforms));
+        kernel(words, first, points);
+    }
+}
+
+template <class T>
+PRNG_ALWAYS_INLINE inline void sphereKernel(const uint64_t *words, std::size_t points, T *x, T *y, T *z)
+{
+    for(std::size_t i = 0; i < points; i++)
+    {
+        T height = 1 - 2 * blockUnit<T>(words, points, 0, i);
+        T radius = fastmath::sqrt(1 - height * height);
+        T sine, cosine;
+        fastmath::sinCosTurns(blockUnit<T>(words, points, 1, i), sine, cosine);
+        x[i] = radius * cosine;
+        y[i] = radius * sine;
+        z[i] = height;
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(sphere, sphereKernel)
+
+template <class T>
+PRNG_ALWAYS_INLINE inline void discKernel(const uint64_t *words, std::size_t points, T *x, T *y)
+{
+    for(std::size_t i = 0; i < points; i++)
+    {
+        T radius = fastmath::sqrt(blockUnit<T>(words, points, 0, i));
+        T sine, cosine;
+        fastmath::sinCosTurns(blockUnit<T>(words, points, 1, i), sine, cosine);
+        x[i] = radius * cosine;
+        y[i] = radius * sine;
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(disc, discKernel)
+
+template <class T>
+PRNG_ALWAYS_INLINE inline void ballKernel(const uint64_t *words, std::size_t points, T *x, T *y, T *z)
+{
+    for(std::size_t i = 0; i < points; i++)
+    {
+        T height = 1 - 2 * blockUnit<T>(words, points, 0, i);
+        T sine, cosine;
+        fastmath::sinCosTurns(blockUnit<T>(words, points, 1, i), sine, cosine);
+        // 1 - u is never 0, which the cube root approximation can't handle
+        T scale = fastmath::cbrt(1 - blockUnit<T>(words, points, 2, i));
+        T radius = scale * fastmath::sqrt(1 - height * height);
+        x[i] = radius * cosine;
+        y[i] = radius * sine;
+        z[i] = scale * height;
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(ball, ballKernel)
+
+// Writes an exponential for each word to output and adds it to that point's sum
+template <class T>
+PRNG_ALWAYS_INLINE inline void exponentialsKernel(const uint64_t *words, std::size_t points, T *output, T *sums)
+{
+    for(std::size_t i = 0; i < points; i++)
+    {
+        // Centred in its interval so the uniform is never 0 or 1 and no exponential is 0
+        T unit = wordToUnit(words[i], T(), true) + std::numeric_limits<T>::epsilon() / 2;
+        T exponential = -fastmath::log(unit);
+        output[i] = exponential;
+        sums[i] += exponential;
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(exponentials, exponentialsKernel)
+
+}
+
+/**
+ * @brief Fills x, y and z with points uniformly distributed on the surface of the unit sphere
+ *
+ * Uses Archimedes' result that z is uniform on [-1, 1], with a uniform angle around the z axis,
+ * so there is no rejection loop and the transform vectorises.
+ *
+ * @param rng - the generator to draw from
+ * @param x - where count x coordinates are written
+ * @param y - where count y coordinates are written
+ * @param z - where count z coordinates are written
+ * @param count - how many points to write
+ */
+template <class T>
+inline void fillUnitSphere3(PRNG &rng, T *x, T *y, T *z, std::size_t count)
+{
+    prng_detail::assertFloatingPoint<T>();
+    prng_detail::fillPoints<T>(rng, count, 2, [=](const uint64_t *words, std::size_t first, std::size_t points)
+    {
+        prng_detail::sphere(words, points, x + first, y + first, z + first);
+    });
+}
+
+/**
+ * @brief Fills x and y with points uniformly distributed inside the unit disc
+ *
+ * Takes the square root of a uniform for the radius, which spreads points evenly by area.
+ *
+ * @param rng - the generator to draw from
+ * @param x - where count x coordinates are written
+ * @param y - where count y coordinates are written
+ * @param count - how many points to write
+ */
+template <class T>
+inline void fillUnitDisc(PRNG &rng, T *x, T *y, std::size_t count)
+{
+    prng_detail::assertFloatingPoint<T>();
+    prng_detail::fillPoints<T>(rng, count, 2, [=](const uint64_t *words, std::size_t first, std::size_t points)
+    {
+        prng_detail::disc(words, points, x + first, y + first);
+    });
+}
+
+/**
+ * @brief Fills x, y and z with points uniformly distributed inside the unit ball
+ *
+ * A point on the sphere scaled by the cube root of a uniform, which spreads points evenly by volume.
+ *
+ * @param rng - the generator to draw from
+ * @param x - where count x coordinates are written
+ * @param y - where count y coordinates are written
+ * @param z - where count z coordinates are written
+ * @param count - how many points to write
+ */
+template <class T>
+inline void fillUnitBall3(PRNG &rng, T *x, T *y, T *z, std::size_t count)
+{
+    prng_detail::assertFloatingPoint<T>();
+    prng_detail::fillPoints<T>(rng, count, 3, [=](const uint64_t *words, std::size_t first, std::size_t points)
+    {
+        prng_detail::ball(words, points, x + first, y + first, z + first);
+    });
+}
+
+/**
+ * @brief Fills coordinates with points uniformly distributed on the standard simplex
+ *
+ * Each point has dimensions non-negative coordinates summing to 1, e.g. random mixture weights.
+ * They're made by normalising independent exponentials, which is exactly uniform on the simplex.
+ *
+ * @param rng - the generator to draw from
+ * @param coordinates - dimensions arrays, coordinates[d] is where count values of coordinate d are written
+ * @param dimensions - the number of coordinates in each point
+ * @param count - how many points to write
+ * @throw cassert ensuring dimensions > 0
+ */
+template <class T>
+inline void fillSimplex(PRNG &rng, T *const *coordinates, std::size_t dimensions, std::size_t count)
+{
+    prng_detail::assertFloatingPoint<T>();
+    assert(dimensions > 0);
+    const std::size_t pointsPerPass = prng_detail::bulkWords;
+    uint64_t words[prng_detail::bulkWords];
+    T sums[prng_detail::bulkWords];
+    for(std::size_t first = 0; first < count; first += pointsPerPass)
+    {
+        std::size_t points = count - first < pointsPerPass ? count - first : pointsPerPass;
+        for(std::size_t i = 0; i < points; i++)
+        {
+            sums[i] = 0;
+        }
+        // One coordinate at a time, so each pass only streams through one output array
+        for(std::size_t d = 0; d < dimensions; d++)
+        {
+            rng.fillUint64(words, points);
+            prng_detail::exponentials(words, points, coordinates[d] + first, sums);
+        }
+        for(std::size_t i = 0; i < points; i++)
+        {
+            sums[i] = 1 / sums[i];
+        }
+        for(std::size_t d = 0; d < dimensions; d++)
+        {
+            T *output = coordinates[d] + first;
+            for(std::size_t i = 0; i < points; i++)
+            {
+                output[i] *= sums[i];
+            }
+        }
+    }
+}
+
+#endif // GEOMETRY_H
@@ -0,0 +1,321 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+/*
+ * Optional counters on the generators' hot paths: engine steps, calls to each typed getRandom
+ * overload, and draws of the bounded rejection loops by the bit width of their range, which
+ * shows how many words a bounded call really costs.
+ *
+ * They're only compiled in when PRNG_INSTRUMENTATION is defined. Otherwise the PRNG_COUNT macros
+ * below are empty and the generators are exactly as they would be without them.
+ */
+#ifndef PRNG_INSTRUMENTATION
+
+#define PRNG_COUNT_CALL(call)
+#define PRNG_COUNT_STEPS(words)
+#define PRNG_COUNT_BOUNDED_CALL(bits)
+#define PRNG_COUNT_BOUNDED_DRAW(bits)
+
+#else
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace prng_instrumentation
+{
+
+// One for each public getRandom overload, Range for (min, max) and Max for (max)
+enum Call
+{
+    callOperator,
+    callGetRandomChar,
+    callGetRandomCharRange,
+    callGetRandomUnsignedChar,
+    callGetRandomUnsignedCharMax,
+    callGetRandomUnsignedCharRange,
+    callGetRandomInt,
+    callGetRandomIntRange,
+    callGetRandomUnsignedInt,
+    callGetRandomUnsignedIntMax,
+    callGetRandomUnsignedIntRange,
+    callGetRandomLong,
+    callGetRandomLongRange,
+    callGetRandomUnsignedLong,
+    callGetRandomUnsignedLongMax,
+    callGetRandomUnsignedLongRange,
+    callGetRandomLongLong,
+    callGetRandomLongLongRange,
+    callGetRandomUnsignedLongLong,
+    callGetRandomUnsignedLongLongMax,
+    callGetRandomUnsignedLongLongRange,
+    callGetRandomFloat,
+    callGetRandomFloatMax,
+    callGetRandomFloatRange,
+    callGetRandomDouble,
+    callGetRandomDoubleMax,
+    callGetRandomDoubleRange,
+    callGetRandomLongDouble,
+    callGetRandomLongDoubleMax,
+    callGetRandomLongDoubleRange,
+    callGetRandomUint64,
+    callGetRandomUint64Max,
+    callGetRandomUint128,
+    callGetRandomUint128Max,
+    callGetRandomUint128Range,
+    callGetRandomInt128Range,
+    callFillUint64,
+    callFillBytes,
+    callFillUint128,
+    callUniform,
+    callCount
+};
+
+/**
+ * @brief The name of each Call, as used in the JSON export
+ * @param call - the call to name
+ * @return its name, e.g. "getRandomInt(min, max)"
+ */
+inline const char *callName(Call call)
+{
+    static const char *const names[callCount] = {
+        "operator()",
+        "getRandomChar()", "getRandomChar(min, max)",
+        "getRandomUnsignedChar()", "getRandomUnsignedChar(max)", "getRandomUnsignedChar(min, max)",
+        "getRandomInt()", "getRandomInt(min, max)",
+        "getRandomUnsignedInt()", "getRandomUnsignedInt(max)", "getRandomUnsignedInt(min, max)",
+        "getRandomLong()", "getRandomLong(min, max)",
+        "getRandomUnsignedLong()", "getRandomUnsignedLong(max)", "getRandomUnsignedLong(min, max)",
+        "getRandomLongLong()", "getRandomLongLong(min, max)",
+        "getRandomUnsignedLongLong()", "getRandomUnsignedLongLong(max)", "getRandomUnsignedLongLong(min, max)",
+        "getRandomFloat()", "getRandomFloat(max)", "getRandomFloat(min, max)",
+        "getRandomDouble()", "getRandomDouble(max)", "getRandomDouble(min, max)",
+        "getRandomLongDouble()", "getRandomLongDouble(max)", "getRandomLongDouble(min, max)",
+        "getRandomUint64()", "getRandomUint64(max)",
+        "getRandomUint128()", "getRandomUint128(max)", "getRandomUint128(min, max)", "getRandomInt128(min, max)",
+        "fillUint64",
+        "fillBytes",
+        "fillUint128",
+        "uniform"};
+    return names[call];
+}
+
+// Bounded draws are bucketed by the bit width of their range, 1 to 64
+const std::size_t rangeBuckets = 65;
+
+/**
+ * @brief Totals of the counters, summed over threads.
+ */
+struct Snapshot
+{
+    uint64_t steps;
+    uint64_t calls[callCount];
+    // Calls to the rejection loops, by the bit width of the range
+    uint64_t boundedCalls[rangeBuckets];
+    // Words drawn by the rejection loops, so boundedDraws - boundedCalls were rejected
+    uint64_t boundedDraws[rangeBuckets];
+
+    /**
+     * @brief Formats the totals as a JSON object, leaving out anything that is zero
+     * @return {"steps": n, "calls": {name: n, ...}, "bounded": [{"bits": b, "calls": n, "draws": n, "rejections": n}, ...]}
+     */
+    std::string toJson() const
+    {
+        std::string json = "{\"steps\": " + std::to_string(steps) + ", \"calls\": {";
+        const char *separator = "";
+        for(int call = 0; call < callCount; call++)
+        {
+            if(calls[call] != 0)
+            {
+                json += separator;
+                json += "\"" + std::string(callName(static_cast<Call>(call))) + "\": " + std::to_string(calls[call]);
+                separator = ", ";
+            }
+        }
+        json += "}, \"bounded\": [";
+        separator = "";
+        for(std::size_t bits = 0; bits < rangeBuckets; bits++)
+        {
+            if(boundedCalls[bits] != 0)
+            {
+                json += separator;
+                json += "{\"bits\": " + std::to_string(bits) + ", \"calls\": " + std::to_string(boundedCalls[bits])
+                        + ", \"draws\": " + std::to_string(boundedDraws[bits])
+                        + ", \"rejections\": " + std::to_string(boundedDraws[bits] - boundedCalls[bits]) + "}";
+                separator = ", ";
+            }
+        }
+        return json + "]}";
+    }
+};
+
+/*
+ * One thread's counters, on cache lines of their own. Only the owning thread writes them, so an
+ * increment is a relaxed load and store rather than a locked read-modify-write, but other threads
+ * can still read them safely.
+ */
+struct alignas(64) Counters
+{
+    std::atomic<uint64_t> steps;
+    std::atomic<uint64_t> calls[callCount];
+    std::atomic<uint64_t> boundedCalls[rangeBuckets];
+    std::atomic<uint64_t> boundedDraws[rangeBuckets];
+
+    static void add(std::atomic<uint64_t> &counter, uint64_t amount)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void addTo(Snapshot &totals) const
+    {
+        totals.steps += steps.load(std::memory_order_relaxed);
+        for(int call = 0; call < callCount; call++)
+        {
+            totals.calls[call] += calls[call].load(std::memory_order_relaxed);
+        }
+        for(std::size_t bits = 0; bits < rangeBuckets; bits++)
+        {
+            totals.boundedCalls[bits] += boundedCalls[bits].load(std::memory_order_relaxed);
+            totals.boundedDraws[bits] += boundedDraws[bits].load(std::memory_order_relaxed);
+        }
+    }
+
+    void clear()
+    {
+        steps.store(0, std::memory_order_relaxed);
+        for(std::atomic<uint64_t> &counter : calls)
+        {
+            counter.store(0, std::memory_order_relaxed);
+        }
+        for(std::size_t bits = 0; bits < rangeBuckets; bits++)
+        {
+            boundedCalls[bits].store(0, std::memory_order_relaxed);
+            boundedDraws[bits].store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+// Every thread's counters, plus the totals of threads that have exited
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<Counters *> live;
+    Snapshot exited;
+
+    static Registry &instance()
+    {
+        // Never destroyed, so threads exiting during static destruction can still fold their counts in
+        static Registry *registry = new Registry();
+        return *registry;
+    }
+
+private:
+    Registry() : exited() {}
+};
+
+// Registers the thread's counters on first use and folds them into the exited totals at thread exit
+struct ThreadCounters
+{
+    Counters counters;
+
+    ThreadCounters()
+    {
+        counters.clear();
+        Registry &registry = Registry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.live.push_back(&counters);
+    }
+
+    ~ThreadCounters()
+    {
+        Registry &registry = Registry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        counters.addTo(registry.exited);
+        for(std::size_t i = 0; i < registry.live.size(); i++)
+        {
+            if(registry.live[i] == &counters)
+            {
+                registry.live.erase(registry.live.begin() + static_cast<std::ptrdiff_t>(i));
+                break;
+            }
+        }
+    }
+};
+
+/**
+ * @brief Returns the calling thread's counters
+ * @return the counters the PRNG_COUNT macros add to
+ */
+inline Counters &local()
+{
+    static thread_local ThreadCounters counters;
+    return counters.counters;
+}
+
+/**
+ * @brief Sums the counters of every thread, including those that have exited
+ * @return the totals since the program started or reset() was last called
+ */
+inline Snapshot snapshot()
+{
+    Registry &registry = Registry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    Snapshot totals = registry.exited;
+    for(const Counters *counters : registry.live)
+    {
+        counters->addTo(totals);
+    }
+    return totals;
+}
+
+/**
+ * @brief Zeroes every thread's counters
+ *
+ * Counts made by other threads while this runs may survive it.
+ */
+inline void reset()
+{
+    Registry &registry = Registry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.exited = Snapshot();
+    for(Counters *counters : registry.live)
+    {
+        counters->clear();
+    }
+}
+
+}
+
+#define PRNG_COUNT_CALL(call) \
+    prng_instrumentation::Counters::add(prng_instrumentation::local().calls[prng_instrumentation::call], 1)
+#define PRNG_COUNT_STEPS(words) \
+    prng_instrumentation::Counters::add(prng_instrumentation::local().steps, (words))
+#define PRNG_COUNT_BOUNDED_CALL(bits) \
+    prng_instrumentation::Counters::add(prng_instrumentation::local().boundedCalls[(bits)], 1)
+#define PRNG_COUNT_BOUNDED_DRAW(bits) \
+    prng_instrumentation::Counters::add(prng_instrumentation::local().boundedDraws[(bits)], 1)
+
+#endif // PRNG_INSTRUMENTATION
+#endif // INSTRUMENTATION_H
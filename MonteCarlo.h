@@ -0,0 +1,316 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef MONTECARLO_H
+#define MONTECARLO_H
+
+#include "PRNG.h"
+#include "Substreams.h"
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief What monteCarlo() found: the mean of the samples, how far it's likely to be out, and how fast it ran.
+ */
+struct MonteCarloResult
+{
+    double mean;
+    // The sample variance, with n - 1 in the denominator
+    double variance;
+    // sqrt(variance / samples), the standard deviation of the mean
+    double standardError;
+    uint64_t samples;
+    double seconds;
+    double samplesPerSecond;
+};
+
+namespace prng_detail
+{
+
+// A chunk's samples as a count, mean and sum of squared differences from the mean
+struct MonteCarloMoments
+{
+    uint64_t count;
+    double mean;
+    double squares;
+};
+
+// Combines two sets of moments, as in Chan, Golub and LeVeque
+inline MonteCarloMoments mergeMoments(const MonteCarloMoments &a, const MonteCarloMoments &b)
+{
+    if(a.count == 0 || b.count == 0)
+    {
+        return a.count == 0 ? b : a;
+    }
+    double count = static_cast<double>(a.count + b.count);
+    double difference = b.mean - a.mean;
+    double weight = static_cast<double>(b.count) / count;
+    MonteCarloMoments merged;
+    merged.count = a.count + b.count;
+    merged.mean = a.mean + difference * weight;
+    merged.squares = a.squares + b.squares + difference * difference * static_cast<double>(a.count) * weight;
+    return merged;
+}
+
+// Pairwise, in an order fixed by the number of chunks alone, so the result doesn't depend on which thread ran what
+inline MonteCarloMoments reduceMoments(const MonteCarloMoments *moments, std::size_t count)
+{
+    if(count == 1)
+    {
+        return moments[0];
+    }
+    std::size_t half = count / 2;
+    return mergeMoments(reduceMoments(moments, half), reduceMoments(moments + half, count - half));
+}
+
+/*
+ * Runs f on one chunk. The values are summed with Kahan summation after subtracting the first, so
+ * the sum of squares doesn't lose the variance to cancellation when it's small beside the mean.
+ */
+template <class F>
+MonteCarloMoments runChunk(PRNG &rng, uint64_t samples, F &f)
+{
+    double shift = static_cast<double>(f(rng));
+    double sum = 0;
+    double sumCompensation = 0;
+    double squares = 0;
+    double squaresCompensation = 0;
+    for(uint64_t i = 1; i < samples; i++)
+    {
+        double value = static_cast<double>(f(rng)) - shift;
+
+        double term = value - sumCompensation;
+        double total = sum + term;
+        sumCompensation = (total - sum) - term;
+        sum = total;
+
+        term = value * value - squaresCompensation;
+        total = squares + term;
+        squaresCompensation = (total - squares) - term;
+        squares = total;
+    }
+    double count = static_cast<double>(samples);
+    MonteCarloMoments moments;
+    moments.count = samples;
+    moments.mean = shift + sum / count;
+    moments.squares = squares - sum * sum / count;
+    if(moments.squares < 0)
+    {
+        moments.squares = 0;
+    }
+    return moments;
+}
+
+/*
+ * Each worker owns a contiguous range of chunks and runs them front to back, so it can get from
+ * one chunk's stream to the next with a single jump(). A worker that runs out steals the back
+ * half of the largest range left and derives its first stream with substream().
+ */
+struct MonteCarloRange
+{
+    std::mutex mutex;
+    uint64_t next;
+    uint64_t end;
+};
+
+// Moves the back half of the largest other range to worker's own and claims its first chunk
+inline bool steal(std::size_t worker, MonteCarloRange *ranges, std::size_t workers, uint64_t &chunk)
+{
+    for(;;)
+    {
+        std::size_t victim = workers;
+        uint64_t largest = 0;
+        for(std::size_t i = 0; i < workers; i++)
+        {
+            std::lock_guard<std::mutex> lock(ranges[i].mutex);
+            if(i != worker && ranges[i].end - ranges[i].next > largest)
+            {
+                largest = ranges[i].end - ranges[i].next;
+                victim = i;
+            }
+        }
+        if(victim == workers)
+        {
+            return false;
+        }
+        uint64_t start;
+        uint64_t end;
+        {
+            std::lock_guard<std::mutex> lock(ranges[victim].mutex);
+            uint64_t remaining = ranges[victim].end - ranges[victim].next;
+            if(remaining == 0)
+            {
+                // Finished since it was looked at
+                continue;
+            }
+            end = ranges[victim].end;
+            start = end - (remaining + 1) / 2;
+            ranges[victim].end = start;
+        }
+        std::lock_guard<std::mutex> lock(ranges[worker].mutex);
+        ranges[worker].next = start + 1;
+        ranges[worker].end = end;
+        chunk = start;
+        return true;
+    }
+}
+
+template <class F>
+void monteCarloWorker(std::size_t worker, MonteCarloRange *ranges, std::size_t workers,
+                      const std::array<uint64_t, 16> &seed, uint64_t samples, uint64_t chunkSamples, F &f,
+                      MonteCarloMoments *moments, std::atomic<bool> &failed, std::exception_ptr &error,
+                      std::mutex &errorMutex)
+{
+    std::unique_ptr<PRNG> stream;
+    uint64_t streamChunk = 0;
+    MonteCarloRange &own = ranges[worker];
+    try
+    {
+        while(!failed.load(std::memory_order_relaxed))
+        {
+            uint64_t chunk = 0;
+            bool claimed = false;
+            {
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if(own.next < own.end)
+                {
+                    chunk = own.next++;
+                    claimed = true;
+                }
+            }
+            if(!claimed && !steal(worker, ranges, workers, chunk))
+            {
+                return;
+            }
+
+            if(stream == nullptr || streamChunk != chunk)
+            {
+                stream.reset(new PRNG(substream(seed, StreamId{0, 0, static_cast<uint32_t>(chunk)})));
+            }
+            // Streams start at position 0, so the state alone reproduces them
+            PRNG rng(stream->getState());
+            stream->jump();
+            streamChunk = chunk + 1;
+
+            uint64_t first = chunk * chunkSamples;
+            uint64_t count = samples - first < chunkSamples ? samples - first : chunkSamples;
+            moments[chunk] = runChunk(rng, count, f);
+        }
+    }
+    catch(...)
+    {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if(!failed.exchange(true))
+        {
+            error = std::current_exception();
+        }
+    }
+}
+
+}
+
+/**
+ * @brief Runs f(rng) samples times across threads and returns the mean and its standard error
+ *
+ * The samples are split into chunks of chunkSamples, and chunk k is run sequentially with the
+ * generator substream(seed, StreamId{0, 0, k}) gives, i.e. PRNG(seed) jumped k times. The chunks'
+ * moments are combined pairwise in chunk order, so for a given seed and chunk size the result is
+ * bit for bit the same whatever the number of threads or the order they ran in.
+ *
+ * Threads run contiguous ranges of chunks, moving between streams with one jump() each, and steal
+ * half of another thread's remaining range when they finish their own. f is called concurrently
+ * from several threads, each with its own PRNG, so it mustn't modify shared state unsynchronised.
+ *
+ * If f throws, the remaining chunks are abandoned and the first exception is rethrown.
+ *
+ * @param samples - how many times to call f
+ * @param seed - the seed the chunks' streams are derived from
+ * @param f - called as f(rng) with a PRNG &, returning a value convertible to double
+ * @param threads - how many threads to run, or 0 for std::thread::hardware_concurrency()
+ * @param chunkSamples - the samples in each chunk, which changes the result and should be large enough to make a jump() per chunk cheap
+ * @throw cassert ensuring samples > 0, chunkSamples > 0 and there are at most 2^32 chunks
+ * @return the mean and standard error of the samples, and the time taken
+ */
+template <class F>
+MonteCarloResult monteCarlo(uint64_t samples, const std::array<uint64_t, 16> &seed, F f, unsigned threads = 0,
+                            uint64_t chunkSamples = 65536)
+{
+    assert(samples > 0 && chunkSamples > 0);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t chunks = (samples - 1) / chunkSamples + 1;
+    assert(chunks <= uint64_t(1) << 32);
+    if(threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+    std::size_t workers = threads == 0 ? 1 : threads < chunks ? threads : static_cast<std::size_t>(chunks);
+
+    std::vector<prng_detail::MonteCarloMoments> moments(static_cast<std::size_t>(chunks));
+    std::unique_ptr<prng_detail::MonteCarloRange[]> ranges(new prng_detail::MonteCarloRange[workers]);
+    for(std::size_t i = 0; i < workers; i++)
+    {
+        ranges[i].next = chunks * i / workers;
+        ranges[i].end = chunks * (i + 1) / workers;
+    }
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    std::vector<std::thread> pool;
+    for(std::size_t i = 1; i < workers; i++)
+    {
+        pool.emplace_back([&, i]() {
+            prng_detail::monteCarloWorker(i, ranges.get(), workers, seed, samples, chunkSamples, f, moments.data(),
+                                          failed, error, errorMutex);
+        });
+    }
+    prng_detail::monteCarloWorker(0, ranges.get(), workers, seed, samples, chunkSamples, f, moments.data(), failed,
+                                  error, errorMutex);
+    for(std::thread &thread : pool)
+    {
+        thread.join();
+    }
+    if(error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    prng_detail::MonteCarloMoments total = prng_detail::reduceMoments(moments.data(), moments.size());
+    MonteCarloResult result;
+    result.mean = total.mean;
+    result.variance = samples > 1 ? total.squares / static_cast<double>(samples - 1) : 0;
+    result.standardError = std::sqrt(result.variance / static_cast<double>(samples));
+    result.samples = samples;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.samplesPerSecond = result.seconds > 0 ? static_cast<double>(samples) / result.seconds : 0;
+    return result;
+}
+
+#endif // MONTECARLO_H
@@ -29,70 +29,82 @@
 #include <mutex>
 #include <random>
 #include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
 #include <cmath>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
 #include <limits>
+#include <new>
+#include <type_traits>
+#if __cplusplus > 201703L
+#include <ranges>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
 
-class PRNG
+#include "Instrumentation.h"
+#include "FloatRange.h"
+
+/**
+ * @brief The typed interface shared by the generators in this library.
+ *
+ * A generator derives from PRNGBase<itself> and provides a private uint64_t nextUint64(),
+ * befriending PRNGBase. All of the getRandom functions, views and bounded draws are then built
+ * on those words, so every generator can be used in place of another. A generator with a faster
+ * way to make many words can also provide a private fillWords(uint64_t *, std::size_t), which
+ * fillUint64() and the other bulk functions use instead of calling nextUint64() in turn.
+ */
+template <class Derived>
+class PRNGBase
 {
 public:
-    PRNG() : position(0)
-    {
-        static std::random_device rd;
-        static std::mutex rngMutex;
-        std::lock_guard<std::mutex> lock(rngMutex);
-        for(uint64_t &s : state)
-        {
-            // Unfortunately random_device returns unsigned ints rather than uint64_ts
-            if(std::numeric_limits<unsigned int>::digits >= 64)
-            {
-                s = rd();
-            }
-            else if(std::numeric_limits<unsigned int>::digits >= 32) {
-                s = rd() & 0xffffffff;
-                s |= static_cast<uint64_t>(rd()) << 32;
-            }
-            else // Not sure what hardware/compiler you're coding for but I guess it's in the standards
-            {
-                s = rd() & 0xffff;
-                s |= (static_cast<uint64_t>(rd()) << 16) & 0xffffffff;
-                s |= (static_cast<uint64_t>(rd()) << 32) & 0xffffffffffff;
-                s |= (static_cast<uint64_t>(rd()) << 48);
-            }
-        }
-    }
+    TEST_VIRTUAL ~PRNGBase() {}
 
-    TEST_VIRTUAL ~PRNG() {}
+    /**
+     * @brief The type of number returned by operator(), as required by UniformRandomBitGenerator
+     */
+    typedef uint64_t result_type;
 
+#ifdef __SIZEOF_INT128__
     /**
-     * @brief Constructs a new PRNG with a set seed
-     * @param seed - the value seed it should start with
+     * @brief The 128 bit types of getRandomUint128() and getRandomInt128(), where the compiler has them
      */
-    PRNG(const std::array<uint64_t, 16> &seed) : state(seed), position(0) {}
+    __extension__ typedef unsigned __int128 uint128;
+    __extension__ typedef __int128 int128;
+#endif
 
     /**
-     * @brief Sets the internal state to a new seed.
-     *
-     * PRNG will produce the same pseudo-random results every time after being provided with a fixed seed.
-     *
-     * @param seed - the value to change the internal state to
+     * @brief The smallest value operator() can return
+     * @return 0
      */
-    TEST_VIRTUAL void setSeed(const std::array<uint64_t, 16> &seed)
+    static constexpr result_type min()
     {
-        state = seed;
+        return 0;
     }
 
     /**
-     * @brief Returns the internal state.
-     *
-     * You might want to do this to find out what the current state is so you can seed with it again
-     * to reproduce your results.
-     *
-     * @param seed - the value to change the internal state to
+     * @brief The largest value operator() can return
+     * @return the maximum uint64_t
      */
-    TEST_VIRTUAL const std::array<uint64_t, 16> &getState() const
+    static constexpr result_type max()
     {
-        return state;
+        return std::numeric_limits<result_type>::max();
+    }
+
+    /**
+     * @brief Generates a random uint64_t, so PRNG can drive std::shuffle and the std distributions directly
+     * @return a uint64_t containing a random number
+     */
+    TEST_VIRTUAL result_type operator()()
+    {
+        PRNG_COUNT_CALL(callOperator);
+        return next();
     }
 
     /**
@@ -101,7 +113,8 @@ public:
      */
     TEST_VIRTUAL char getRandomChar()
     {
-        return static_cast<char>(xorshift1024());
+        PRNG_COUNT_CALL(callGetRandomChar);
+        return static_cast<char>(next());
     }
 
     /**
@@ -110,7 +123,8 @@ public:
      */
     TEST_VIRTUAL unsigned char getRandomUnsignedChar()
     {
-        return static_cast<unsigned char>(xorshift1024());
+        PRNG_COUNT_CALL(callGetRandomUnsignedChar);
+        return static_cast<unsigned char>(next());
     }
 
     /**
@@ -122,6 +136,7 @@ public:
      */
     TEST_VIRTUAL char getRandomChar(const char &minValue, const char &maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomCharRange);
         return getRandomIntType(minValue, maxValue);
     }
 
@@ -132,6 +147,7 @@ public:
      */
     TEST_VIRTUAL unsigned char getRandomUnsignedChar(const unsigned char &maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomUnsignedCharMax);
         return getRandomIntType(maxValue);
     }
 
@@ -144,6 +160,7 @@ public:
      */
     TEST_VIRTUAL unsigned char getRandomUnsignedChar(const unsigned char &minValue, const unsigned char &maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomUnsignedCharRange);
         return getRandomIntType(minValue, maxValue);
     }
 
@@ -153,7 +170,8 @@ public:
      */
     TEST_VIRTUAL int getRandomInt()
     {
-        return static_cast<int>(xorshift1024());
+        PRNG_COUNT_CALL(callGetRandomInt);
+        return static_cast<int>(next());
     }
 
     /**
@@ -162,7 +180,8 @@ public:
      */
     TEST_VIRTUAL unsigned int getRandomUnsignedInt()
     {
-        return static_cast<unsigned int>(xorshift1024());
+        PRNG_COUNT_CALL(callGetRandomUnsignedInt);
+        return static_cast<unsigned int>(next());
     }
 
     /**
@@ -174,6 +193,7 @@ public:
      */
     TEST_VIRTUAL int getRandomInt(const int &minValue, const int &maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomIntRange);
         return getRandomIntType(minValue, maxValue);
     }
 
@@ -184,6 +204,7 @@ public:
      */
     TEST_VIRTUAL unsigned int getRandomUnsignedInt(const unsigned int &maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomUnsignedIntMax);
         return getRandomIntType(maxValue);
     }
 
@@ -196,6 +217,7 @@ public:
      */
     TEST_VIRTUAL unsigned int getRandomUnsignedInt(const unsigned int &minValue, const unsigned int &maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomUnsignedIntRange);
         return getRandomIntType(minValue, maxValue);
     }
 
@@ -205,7 +227,8 @@ public:
      */
     TEST_VIRTUAL long getRandomLong()
     {
-        return static_cast<long>(xorshift1024());
+        PRNG_COUNT_CALL(callGetRandomLong);
+        return static_cast<long>(next());
     }
 
     /**
@@ -214,7 +237,8 @@ public:
      */
     TEST_VIRTUAL unsigned long getRandomUnsignedLong()
     {
-        return static_cast<unsigned long>(xorshift1024());
+        PRNG_COUNT_CALL(callGetRandomUnsignedLong);
+        return static_cast<unsigned long>(next());
     }
 
     /**
@@ -226,6 +250,7 @@ public:
      */
     TEST_VIRTUAL long getRandomLong(const long &minValue, const long &maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomLongRange);
         return getRandomIntType(minValue, maxValue);
     }
 
@@ -236,6 +261,7 @@ public:
      */
     TEST_VIRTUAL unsigned long getRandomUnsignedLong(const unsigned long &maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomUnsignedLongMax);
         return getRandomIntType(maxValue);
     }
 
@@ -248,6 +274,7 @@ public:
      */
     TEST_VIRTUAL unsigned long getRandomUnsignedLong(const unsigned long &minValue, const unsigned long &maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomUnsignedLongRange);
         return getRandomIntType(minValue, maxValue);
     }
 
@@ -257,7 +284,8 @@ public:
      */
     TEST_VIRTUAL long long getRandomLongLong()
     {
-        return static_cast<long long>(xorshift1024());
+        PRNG_COUNT_CALL(callGetRandomLongLong);
+        return static_cast<long long>(next());
     }
 
     /**
@@ -266,7 +294,8 @@ public:
      */
     TEST_VIRTUAL unsigned long long getRandomUnsignedLongLong()
     {
-        return static_cast<unsigned long long>(xorshift1024());
+        PRNG_COUNT_CALL(callGetRandomUnsignedLongLong);
+        return static_cast<unsigned long long>(next());
     }
 
     /**
@@ -278,6 +307,7 @@ public:
      */
     TEST_VIRTUAL long long getRandomLongLong(const long long &minValue, const long long &maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomLongLongRange);
         return getRandomIntType(minValue, maxValue);
     }
 
@@ -288,6 +318,7 @@ public:
      */
     TEST_VIRTUAL unsigned long long getRandomUnsignedLongLong(const unsigned long long &maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomUnsignedLongLongMax);
         return getRandomIntType(maxValue);
     }
 
@@ -300,6 +331,7 @@ public:
      */
     TEST_VIRTUAL unsigned long long getRandomUnsignedLongLong(const unsigned long long &minValue, const unsigned long long &maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomUnsignedLongLongRange);
         return getRandomIntType(minValue, maxValue);
     }
 
@@ -309,6 +341,7 @@ public:
      */
     TEST_VIRTUAL float getRandomFloat()
     {
+        PRNG_COUNT_CALL(callGetRandomFloat);
         return getRandomFloatType<float>();
     }
 
@@ -319,17 +352,23 @@ public:
      */
     TEST_VIRTUAL float getRandomFloat(float maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomFloatMax);
         return getRandomFloatType(maxValue);
     }
 
     /**
      * @brief Generates a random number between minValue and maxValue (inclusive)
+     *
+     * The result is never outside the bounds. Use a FloatRange to draw many numbers from one range.
+     *
      * @param minValue - The lowest value this should return
      * @param maxValue - The highest value this should return
+     * @throw cassert ensuring the bounds are finite
      * @return a float containing a random number
      */
     TEST_VIRTUAL float getRandomFloat(float minValue, float maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomFloatRange);
         return getRandomFloatType(minValue, maxValue);
     }
 
@@ -339,6 +378,7 @@ public:
      */
     TEST_VIRTUAL double getRandomDouble()
     {
+        PRNG_COUNT_CALL(callGetRandomDouble);
         return getRandomFloatType<double>();
     }
 
@@ -349,17 +389,23 @@ public:
      */
     TEST_VIRTUAL double getRandomDouble(double maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomDoubleMax);
         return getRandomFloatType(maxValue);
     }
 
     /**
      * @brief Generates a random number between minValue and maxValue (inclusive)
+     *
+     * The result is never outside the bounds. Use a FloatRange to draw many numbers from one range.
+     *
      * @param minValue - The lowest value this should return
      * @param maxValue - The highest value this should return
+     * @throw cassert ensuring the bounds are finite
      * @return a double containing a random number
      */
     TEST_VIRTUAL double getRandomDouble(double minValue, double maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomDoubleRange);
         return getRandomFloatType(minValue, maxValue);
     }
 
@@ -369,6 +415,7 @@ public:
      */
     TEST_VIRTUAL long double getRandomLongDouble()
     {
+        PRNG_COUNT_CALL(callGetRandomLongDouble);
         return getRandomFloatType<long double>();
     }
 
@@ -379,17 +426,23 @@ public:
      */
     TEST_VIRTUAL long double getRandomLongDouble(long double maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomLongDoubleMax);
         return getRandomFloatType(maxValue);
     }
 
     /**
      * @brief Generates a random number between minValue and maxValue (inclusive)
+     *
+     * The result is never outside the bounds. Use a FloatRange to draw many numbers from one range.
+     *
      * @param minValue - The lowest value this should return
      * @param maxValue - The highest value this should return
+     * @throw cassert ensuring the bounds are finite
      * @return a long double containing a random number
      */
     TEST_VIRTUAL long double getRandomLongDouble(long double minValue, long double maxValue)
     {
+        PRNG_COUNT_CALL(callGetRandomLongDoubleRange);
         return getRandomFloatType(minValue, maxValue);
     }
 
@@ -399,7 +452,8 @@ public:
      */
     TEST_VIRTUAL uint64_t getRandomUint64()
     {
-        return xorshift1024();
+        PRNG_COUNT_CALL(callGetRandomUint64);
+        return next();
     }
 
     /**
@@ -409,104 +463,994 @@ public:
      */
     TEST_VIRTUAL uint64_t getRandomUint64(const uint64_t &maxValue)
     {
-        assert(maxValue != 0);
-        int leadingZeros = countLeadingZeros64(maxValue);
+        PRNG_COUNT_CALL(callGetRandomUint64Max);
+        return boundedNext(maxValue);
+    }
 
-        uint64_t randomInt;
-        do
+#ifdef __SIZEOF_INT128__
+    /**
+     * @brief Generates a random 128 bit number from two words, the first its low half
+     * @return a uint128 containing a random number
+     */
+    TEST_VIRTUAL uint128 getRandomUint128()
+    {
+        PRNG_COUNT_CALL(callGetRandomUint128);
+        return next128();
+    }
+
+    /**
+     * @brief Generates a random number between 0 and maxValue (inclusive)
+     *
+     * This is Lemire's multiply and reject widened to 128 bits, so it's unbiased and takes two
+     * words unless the rare rejection check fails. Ranges that fit in 64 bits only need a 128x64
+     * multiply.
+     *
+     * @param maxValue - The highest value this should return
+     * @return a uint128 containing a random number
+     */
+    TEST_VIRTUAL uint128 getRandomUint128(const uint128 &maxValue)
+    {
+        PRNG_COUNT_CALL(callGetRandomUint128Max);
+        return boundedNext128(maxValue);
+    }
+
+    /**
+     * @brief Generates a random number between minValue and maxValue (inclusive)
+     * @param minValue - The lowest value this should return
+     * @param maxValue - The highest value this should return
+     * @throw cassert ensuring minValue <= maxValue
+     * @return a uint128 containing a random number
+     */
+    TEST_VIRTUAL uint128 getRandomUint128(const uint128 &minValue, const uint128 &maxValue)
+    {
+        PRNG_COUNT_CALL(callGetRandomUint128Range);
+        assert(minValue <= maxValue);
+        return minValue + boundedNext128(maxValue - minValue);
+    }
+
+    /**
+     * @brief Generates a random number between minValue and maxValue (inclusive)
+     * @param minValue - The lowest value this should return
+     * @param maxValue - The highest value this should return
+     * @throw cassert ensuring minValue <= maxValue
+     * @return an int128 containing a random number
+     */
+    TEST_VIRTUAL int128 getRandomInt128(const int128 &minValue, const int128 &maxValue)
+    {
+        PRNG_COUNT_CALL(callGetRandomInt128Range);
+        assert(minValue <= maxValue);
+        uint128 range = static_cast<uint128>(maxValue) - static_cast<uint128>(minValue);
+        return static_cast<int128>(static_cast<uint128>(minValue) + boundedNext128(range));
+    }
+#endif
+
+    /**
+     * @brief Fills output with random uint64_ts
+     *
+     * Produces exactly the same numbers as calling getRandomUint64() count times. Generators
+     * that can do better, like PRNG, provide their own.
+     *
+     * @param output - where the random numbers are written
+     * @param count - how many numbers to write
+     */
+    TEST_VIRTUAL void fillUint64(uint64_t *output, std::size_t count)
+    {
+        PRNG_COUNT_CALL(callFillUint64);
+        derived().fillWords(output, count);
+    }
+
+    /**
+     * @brief Fills a buffer with random bytes
+     *
+     * The bytes are those of the words fillUint64() would give, in memory order, so every bit of
+     * every word is used apart from the end of the last. When the buffer is aligned for uint64_t
+     * the words are generated straight into it.
+     *
+     * @param output - where the random bytes are written
+     * @param count - how many bytes to write
+     */
+    TEST_VIRTUAL void fillBytes(void *output, std::size_t count)
+    {
+        PRNG_COUNT_CALL(callFillBytes);
+        unsigned char *bytes = static_cast<unsigned char *>(output);
+        std::size_t words = count / sizeof(uint64_t);
+        if(reinterpret_cast<std::uintptr_t>(bytes) % alignof(uint64_t) == 0)
         {
-            randomInt = xorshift1024() >> leadingZeros;
-        } while(randomInt > maxValue);
+            derived().fillWords(reinterpret_cast<uint64_t *>(bytes), words);
+        }
+        else
+        {
+            uint64_t block[16];
+            for(std::size_t done = 0; done < words; done += 16)
+            {
+                std::size_t blockWords = words - done < 16 ? words - done : 16;
+                derived().fillWords(block, blockWords);
+                std::memcpy(bytes + done * sizeof(uint64_t), block, blockWords * sizeof(uint64_t));
+            }
+        }
+        std::size_t tail = count % sizeof(uint64_t);
+        if(tail != 0)
+        {
+            uint64_t last;
+            derived().fillWords(&last, 1);
+            std::memcpy(bytes + words * sizeof(uint64_t), &last, tail);
+        }
+    }
 
-        return randomInt;
+#ifdef __SIZEOF_INT128__
+    /**
+     * @brief Fills output with random 128 bit numbers
+     *
+     * Produces exactly the same numbers as calling getRandomUint128() count times, from
+     * fillUint64() in blocks.
+     *
+     * @param output - where the random numbers are written
+     * @param count - how many numbers to write
+     */
+    TEST_VIRTUAL void fillUint128(uint128 *output, std::size_t count)
+    {
+        PRNG_COUNT_CALL(callFillUint128);
+        uint64_t block[64];
+        for(std::size_t done = 0; done < count; done += 32)
+        {
+            std::size_t blockCount = count - done < 32 ? count - done : 32;
+            derived().fillWords(block, 2 * blockCount);
+            for(std::size_t i = 0; i < blockCount; i++)
+            {
+                output[done + i] = static_cast<uint128>(block[2 * i + 1]) << 64 | block[2 * i];
+            }
+        }
     }
+#endif
 
 private:
-    std::array<uint64_t, 16> state;
-    unsigned long position;
+#ifdef __cpp_lib_ranges
+    template <class ViewType>
+    using ViewBase = std::ranges::view_interface<ViewType>;
+#else
+    template <class ViewType>
+    struct ViewBase {};
+#endif
 
     template <class T>
-    T getRandomIntType(const T &minValue, const T &maxValue)
+    struct IntDistribution
     {
-        assert(minValue < maxValue);
-        uint64_t range = static_cast<uint64_t>(maxValue - minValue);
-        T rand = static_cast<T>(getRandomUint64(range));
-        return rand + minValue;
-    }
+        typedef T result_type;
+
+        T minValue;
+        uint64_t range;
+
+        template <class WordSource>
+        T operator()(WordSource &source) const
+        {
+            return static_cast<T>(boundedUint64(source, range)) + minValue;
+        }
+    };
 
     template <class T>
-    T getRandomIntType(const T &maxValue)
+    struct FloatDistribution
     {
-        assert(maxValue <= std::numeric_limits<uint64_t>::max());
-        return static_cast<T>(getRandomUint64(maxValue));
-    }
+        typedef T result_type;
 
-    template <class T>
-    T getRandomFloatType(const T &minValue, const T &maxValue)
+        template <class WordSource>
+        T operator()(WordSource &source) const
+        {
+            return wordToFloat<T>(source());
+        }
+    };
+
+public:
+    /**
+     * @brief An endless input range of random numbers drawn from a generator.
+     *
+     * The view pulls words from the generator sixteen at a time with fillUint64() and hands them out
+     * one by one, so its elements are exactly what the matching getRandom function would have
+     * returned. The generator is only ever advanced in whole blocks though, so once you stop reading
+     * from a view the rest of its last block is thrown away.
+     *
+     * Under C++20 it's a std::ranges::view, so rng.ints(1, 6) | std::views::take(n) works.
+     */
+    template <class Distribution>
+    class View : public ViewBase<View<Distribution> >
     {
-        T range = std::abs(maxValue - minValue);
-        return getRandomFloatType<T>(range) + minValue;
-    }
+    public:
+        typedef typename Distribution::result_type value_type;
+
+        struct sentinel {};
+
+        class iterator
+        {
+        public:
+            typedef std::input_iterator_tag iterator_category;
+            typedef std::input_iterator_tag iterator_concept;
+            typedef typename View::value_type value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const value_type *pointer;
+            typedef value_type reference;
+
+            iterator() : view(nullptr) {}
+
+            value_type operator*() const
+            {
+                return view->current();
+            }
+
+            iterator &operator++()
+            {
+                view->advance();
+                return *this;
+            }
+
+            void operator++(int)
+            {
+                view->advance();
+            }
+
+            friend bool operator==(const iterator &, const sentinel &) { return false; }
+            friend bool operator==(const sentinel &, const iterator &) { return false; }
+            friend bool operator!=(const iterator &, const sentinel &) { return true; }
+            friend bool operator!=(const sentinel &, const iterator &) { return true; }
+
+        private:
+            friend class View;
+
+            explicit iterator(View *view) : view(view) {}
+
+            View *view;
+        };
+
+        View() : rng(nullptr), distribution(), index(16), hasValue(false), value() {}
+
+        View(Derived &rng, const Distribution &distribution)
+            : rng(&rng), distribution(distribution), index(16), hasValue(false), value() {}
+
+        iterator begin()
+        {
+            return iterator(this);
+        }
+
+        sentinel end() const
+        {
+            return sentinel();
+        }
+
+        /**
+         * @brief Returns the next raw word from the block buffer, refilling it when it runs out
+         * @return a uint64_t containing a random number
+         */
+        uint64_t operator()()
+        {
+            if(index == 16)
+            {
+                rng->fillUint64(block.data(), 16);
+                index = 0;
+            }
+            return block[index++];
+        }
+
+    private:
+        Derived *rng;
+        Distribution distribution;
+        std::array<uint64_t, 16> block;
+        unsigned int index;
+        bool hasValue;
+        value_type value;
+
+        value_type current()
+        {
+            if(!hasValue)
+            {
+                value = distribution(*this);
+                hasValue = true;
+            }
+            return value;
+        }
+
+        void advance()
+        {
+            current();
+            hasValue = false;
+        }
+    };
 
+    /**
+     * @brief Returns an endless view of random numbers between minValue and maxValue (inclusive)
+     *
+     * The values are the same as repeated calls to the matching getRandom function, e.g. getRandomInt(minValue, maxValue).
+     *
+     * @param minValue - The lowest value the view should contain
+     * @param maxValue - The highest value the view should contain
+     * @throw cassert ensuring minValue < maxValue
+     * @return a View of random numbers
+     */
     template <class T>
-    T getRandomFloatType(const T &maxValue)
+    View<IntDistribution<T> > ints(const T &minValue, const T &maxValue)
     {
-        return getRandomFloatType<T>() * maxValue;
+        static_assert(std::is_integral<T>::value, "ints requires an integral type");
+        assert(minValue < maxValue);
+        IntDistribution<T> distribution = {minValue, static_cast<uint64_t>(maxValue - minValue)};
+        return View<IntDistribution<T> >(derived(), distribution);
     }
 
-    template <class T>
-    T getRandomFloatType()
+    /**
+     * @brief Returns an endless view of random doubles between 0 and 1, the same values as getRandomDouble()
+     * @return a View of random numbers
+     */
+    View<FloatDistribution<double> > doubles()
     {
-        constexpr T epsilon = std::numeric_limits<T>::epsilon();
-        constexpr int digitsToKeep = std::numeric_limits<T>::digits-1;
-        constexpr int digitsToLose = std::numeric_limits<uint64_t>::digits - digitsToKeep;
-        T rand = (xorshift1024() >> digitsToLose) * epsilon;
-        return rand;
+        return View<FloatDistribution<double> >(derived(), FloatDistribution<double>());
     }
 
-    uint64_t xorshift1024()
+    /**
+     * @brief Returns an endless view of random floats between 0 and 1, the same values as getRandomFloat()
+     * @return a View of random numbers
+     */
+    View<FloatDistribution<float> > floats()
     {
-        uint64_t state0 = state[position];
-        position = (position + 1) % 16;
-        uint64_t state1 = state[position];
-        state1 ^= state1 << 31;
-        state1 ^= state1 >> 11;
-        state0 ^= state0 >> 30;
-        state[position] = state0 ^ state1;
-        return state[position] * 1181783497276652981LL;
+        return View<FloatDistribution<float> >(derived(), FloatDistribution<float>());
     }
 
-    int countLeadingZeros64(const uint64_t &toCount)
+    /**
+     * @brief Generates a random number between Min and Max (inclusive) where the bounds are known at compile time
+     *
+     * The strategy is picked at compile time: a range whose size is a power of two is a single shift,
+     * any other range is a multiply with a precomputed rejection threshold and a range of one value
+     * doesn't draw at all. For dice style calls like uniform<int, 1, 6>() that's a couple of instructions.
+     *
+     * These produce a different sequence to the run time bounded functions.
+     *
+     * @tparam T - an integral type of at most 64 bits
+     * @tparam Min - The lowest value this should return
+     * @tparam Max - The highest value this should return
+     * @return a T containing a random number
+     */
+    template <class T, T Min, T Max>
+    T uniform()
     {
-    #ifdef __GNUC__
-        return __builtin_clzll(toCount) - (std::numeric_limits<unsigned long long>::digits - 64);
-    #elif defined(_MSC_VER)
-        return __lzcnt(toCount);
-    #else
-        static const int clz64Index[64] = {
-            63, 16, 62,  7, 15, 36, 61,  3,
-             6, 14, 22, 26, 35, 47, 60,  2,
-             9,  5, 28, 11, 13, 21, 42, 19,
-            25, 31, 34, 40, 46, 52, 59,  1,
-            17,  8, 37,  4, 23, 27, 48, 10,
-            29, 12, 43, 20, 32, 41, 53, 18,
-            38, 24, 49, 30, 44, 33, 54, 39,
-            50, 45, 55, 51, 56, 57, 58,  0
-        };
-        uint64_t bitset = toCount;
-        bitset |= bitset >> 1;
-        bitset |= bitset >> 2;
-        bitset |= bitset >> 4;
-        bitset |= bitset >> 8;
-        bitset |= bitset >> 16;
-        bitset |= bitset >> 32;
-        return clz64Index[(bitset * 0x03f79d71b4cb0a89ULL) >> 58];
-    #endif
+        static_assert(std::is_integral<T>::value, "uniform requires an integral type");
+        static_assert(std::numeric_limits<T>::digits <= 64, "uniform supports types of at most 64 bits");
+        static_assert(Min <= Max, "uniform requires Min <= Max");
+        PRNG_COUNT_CALL(callUniform);
+        typedef UniformStrategy<static_cast<uint64_t>(Max) - static_cast<uint64_t>(Min)> Strategy;
+        return static_cast<T>(static_cast<uint64_t>(Min) + uniformOffset<Strategy::range>(Strategy()));
     }
 
-    // You really shouldn't copy this class.
-    PRNG(PRNG const&) = delete;
+protected:
+    PRNGBase() {}
+
+    // The words of fillUint64() without counting a call, for the bulk functions built on it
+    void fillWords(uint64_t *output, std::size_t count)
+    {
+        for(std::size_t i = 0; i < count; i++)
+        {
+            output[i] = next();
+        }
+    }
+
+private:
+    uint64_t next()
+    {
+        PRNG_COUNT_STEPS(1);
+        return static_cast<Derived *>(this)->nextUint64();
+    }
+
+    uint64_t boundedNext(const uint64_t &maxValue)
+    {
+        auto source = [this]() { return next(); };
+        return boundedUint64(source, maxValue);
+    }
+
+#ifdef __SIZEOF_INT128__
+    uint128 next128()
+    {
+        uint64_t low = next();
+        return static_cast<uint128>(next()) << 64 | low;
+    }
+
+    /*
+     * The high 128 bits of a random 128 bit number times maxValue + 1 are uniform on [0, maxValue]
+     * once products whose low 128 bits fall below 2^128 mod (maxValue + 1) are rejected. That
+     * remainder is a slow 128 bit division, but it's only needed when the low bits are below
+     * maxValue + 1, which almost never happens for a wide range.
+     */
+    uint128 boundedNext128(const uint128 &maxValue)
+    {
+        uint128 range = maxValue + 1;
+        if(range == 0)
+        {
+            return next128();
+        }
+        uint128 low;
+        uint128 high = multiplyHigh128(next128(), range, low);
+        if(low < range)
+        {
+            uint128 threshold = (0 - range) % range;
+            while(low < threshold)
+            {
+                high = multiplyHigh128(next128(), range, low);
+            }
+        }
+        return high;
+    }
+
+    static uint128 multiplyHigh128(const uint128 &a, const uint128 &b, uint128 &low)
+    {
+        uint64_t aLow = static_cast<uint64_t>(a), aHigh = static_cast<uint64_t>(a >> 64);
+        uint64_t bLow = static_cast<uint64_t>(b), bHigh = static_cast<uint64_t>(b >> 64);
+        uint128 lowLow = static_cast<uint128>(aLow) * bLow;
+        uint128 highLow = static_cast<uint128>(aHigh) * bLow;
+        if(bHigh == 0)
+        {
+            // A range that fits in 64 bits needs only the 128x64 product
+            uint128 middle = (lowLow >> 64) + highLow;
+            low = middle << 64 | static_cast<uint64_t>(lowLow);
+            return middle >> 64;
+        }
+        uint128 lowHigh = static_cast<uint128>(aLow) * bHigh;
+        uint128 middle = (lowLow >> 64) + static_cast<uint64_t>(highLow) + static_cast<uint64_t>(lowHigh);
+        low = middle << 64 | static_cast<uint64_t>(lowLow);
+        return static_cast<uint128>(aHigh) * bHigh + (highLow >> 64) + (lowHigh >> 64) + (middle >> 64);
+    }
+#endif
+
+    Derived &derived()
+    {
+        return static_cast<Derived &>(*this);
+    }
+
+    template <class T>
+    T getRandomIntType(const T &minValue, const T &maxValue)
+    {
+        assert(minValue < maxValue);
+        uint64_t range = static_cast<uint64_t>(maxValue - minValue);
+        T rand = static_cast<T>(boundedNext(range));
+        return rand + minValue;
+    }
+
+    template <class T>
+    T getRandomIntType(const T &maxValue)
+    {
+        assert(maxValue <= std::numeric_limits<uint64_t>::max());
+        return static_cast<T>(boundedNext(maxValue));
+    }
+
+    enum
+    {
+        uniformConstant,
+        uniformMask,
+        uniformMultiply
+    };
+
+    template <uint64_t Range>
+    struct UniformStrategy : std::integral_constant<int, Range == 0 ? uniformConstant
+                                                         : (Range & (Range + 1)) == 0 ? uniformMask
+                                                         : uniformMultiply>
+    {
+        static constexpr uint64_t range = Range;
+        // Lemire's rejection threshold, 2^64 mod (range + 1)
+        static constexpr uint64_t threshold = Range + 1 == 0 ? 0 : (0 - (Range + 1)) % (Range + 1);
+    };
+
+    template <uint64_t Range>
+    uint64_t uniformOffset(std::integral_constant<int, uniformConstant>)
+    {
+        return 0;
+    }
+
+    template <uint64_t Range>
+    uint64_t uniformOffset(std::integral_constant<int, uniformMask>)
+    {
+        return next() >> constantLeadingZeros64(Range);
+    }
+
+    template <uint64_t Range>
+    uint64_t uniformOffset(std::integral_constant<int, uniformMultiply>)
+    {
+        uint64_t low;
+        uint64_t high;
+        PRNG_COUNT_BOUNDED_CALL(64 - constantLeadingZeros64(Range));
+        do
+        {
+            PRNG_COUNT_BOUNDED_DRAW(64 - constantLeadingZeros64(Range));
+            high = multiplyHigh64(next(), Range + 1, low);
+        } while(low < UniformStrategy<Range>::threshold);
+        return high;
+    }
+
+    template <class T>
+    T getRandomFloatType(const T &minValue, const T &maxValue)
+    {
+        return FloatRange<T>(minValue, maxValue).fromWord(next());
+    }
+
+    template <class T>
+    T getRandomFloatType(const T &maxValue)
+    {
+        return getRandomFloatType<T>() * maxValue;
+    }
+
+    template <class T>
+    T getRandomFloatType()
+    {
+        return wordToFloat<T>(next());
+    }
+
+    template <class T>
+    static T wordToFloat(const uint64_t &word)
+    {
+        constexpr T epsilon = std::numeric_limits<T>::epsilon();
+        constexpr int digitsToKeep = std::numeric_limits<T>::digits-1;
+        constexpr int digitsToLose = std::numeric_limits<uint64_t>::digits - digitsToKeep;
+        T rand = (word >> digitsToLose) * epsilon;
+        return rand;
+    }
+
+    template <class WordSource>
+    static uint64_t boundedUint64(WordSource &source, const uint64_t &maxValue)
+    {
+        assert(maxValue != 0);
+        int leadingZeros = countLeadingZeros64(maxValue);
+
+        uint64_t randomInt;
+        PRNG_COUNT_BOUNDED_CALL(64 - leadingZeros);
+        do
+        {
+            PRNG_COUNT_BOUNDED_DRAW(64 - leadingZeros);
+            randomInt = source() >> leadingZeros;
+        } while(randomInt > maxValue);
+
+        return randomInt;
+    }
+
+    static int countLeadingZeros64(const uint64_t &toCount)
+    {
+    #ifdef __GNUC__
+        return __builtin_clzll(toCount) - (std::numeric_limits<unsigned long long>::digits - 64);
+    #elif defined(_MSC_VER)
+        return __lzcnt(toCount);
+    #else
+        static const int clz64Index[64] = {
+            63, 16, 62,  7, 15, 36, 61,  3,
+             6, 14, 22, 26, 35, 47, 60,  2,
+             9,  5, 28, 11, 13, 21, 42, 19,
+            25, 31, 34, 40, 46, 52, 59,  1,
+            17,  8, 37,  4, 23, 27, 48, 10,
+            29, 12, 43, 20, 32, 41, 53, 18,
+            38, 24, 49, 30, 44, 33, 54, 39,
+            50, 45, 55, 51, 56, 57, 58,  0
+        };
+        uint64_t bitset = toCount;
+        bitset |= bitset >> 1;
+        bitset |= bitset >> 2;
+        bitset |= bitset >> 4;
+        bitset |= bitset >> 8;
+        bitset |= bitset >> 16;
+        bitset |= bitset >> 32;
+        return clz64Index[(bitset * 0x03f79d71b4cb0a89ULL) >> 58];
+    #endif
+    }
+
+    static constexpr int constantLeadingZeros64(uint64_t toCount, int counted = 0)
+    {
+        return counted == 64 || (toCount >> 63) ? counted : constantLeadingZeros64(toCount << 1, counted + 1);
+    }
+
+    static uint64_t multiplyHigh64(const uint64_t &a, const uint64_t &b, uint64_t &low)
+    {
+    #ifdef __SIZEOF_INT128__
+        __extension__ typedef unsigned __int128 uint128;
+        uint128 product = static_cast<uint128>(a) * b;
+        low = static_cast<uint64_t>(product);
+        return static_cast<uint64_t>(product >> 64);
+    #elif defined(_MSC_VER) && defined(_M_X64)
+        uint64_t high;
+        low = _umul128(a, b, &high);
+        return high;
+    #else
+        uint64_t aLow = a & 0xffffffff, aHigh = a >> 32;
+        uint64_t bLow = b & 0xffffffff, bHigh = b >> 32;
+        uint64_t lowLow = aLow * bLow;
+        uint64_t highLow = aHigh * bLow;
+        uint64_t lowHigh = aLow * bHigh;
+        uint64_t middle = (lowLow >> 32) + (highLow & 0xffffffff) + lowHigh;
+        low = (middle << 32) | (lowLow & 0xffffffff);
+        return aHigh * bHigh + (highLow >> 32) + (middle >> 32);
+    #endif
+    }
 };
 
+class PRNG : public PRNGBase<PRNG>
+{
+public:
+    PRNG() : position(0)
+    {
+        static std::random_device rd;
+        static std::mutex rngMutex;
+        std::lock_guard<std::mutex> lock(rngMutex);
+        for(uint64_t &s : state)
+        {
+            // Unfortunately random_device returns unsigned ints rather than uint64_ts
+            if(std::numeric_limits<unsigned int>::digits >= 64)
+            {
+                s = rd();
+            }
+            else if(std::numeric_limits<unsigned int>::digits >= 32) {
+                s = rd() & 0xffffffff;
+                s |= static_cast<uint64_t>(rd()) << 32;
+            }
+            else // Not sure what hardware/compiler you're coding for but I guess it's in the standards
+            {
+                s = rd() & 0xffff;
+                s |= (static_cast<uint64_t>(rd()) << 16) & 0xffffffff;
+                s |= (static_cast<uint64_t>(rd()) << 32) & 0xffffffffffff;
+                s |= (static_cast<uint64_t>(rd()) << 48);
+            }
+        }
+    }
+
+    TEST_VIRTUAL ~PRNG() {}
+
+    /**
+     * @brief Moves the generator state into a new PRNG so generators can be kept in containers
+     *
+     * The moved from PRNG is left with the same state, so don't use both.
+     */
+    PRNG(PRNG &&) = default;
+
+    /**
+     * @brief Moves the generator state from another PRNG
+     * @return this PRNG
+     */
+    PRNG &operator=(PRNG &&) = default;
+
+    /**
+     * @brief Constructs a new PRNG with a set seed
+     * @param seed - the value seed it should start with
+     */
+    PRNG(const std::array<uint64_t, 16> &seed) : state(seed), position(0) {}
+
+    /**
+     * @brief Sets the internal state to a new seed.
+     *
+     * PRNG will produce the same pseudo-random results every time after being provided with a fixed seed.
+     *
+     * @param seed - the value to change the internal state to
+     */
+    TEST_VIRTUAL void setSeed(const std::array<uint64_t, 16> &seed)
+    {
+        state = seed;
+    }
+
+    /**
+     * @brief Returns the internal state.
+     *
+     * You might want to do this to find out what the current state is so you can seed with it again
+     * to reproduce your results.
+     *
+     * @param seed - the value to change the internal state to
+     */
+    TEST_VIRTUAL const std::array<uint64_t, 16> &getState() const
+    {
+        return state;
+    }
+
+    /**
+     * @brief Fills output with random uint64_ts
+     *
+     * This makes a single pass over the state, so it's faster than calling getRandomUint64()
+     * count times but produces exactly the same numbers.
+     *
+     * @param output - where the random numbers are written
+     * @param count - how many numbers to write
+     */
+    TEST_VIRTUAL void fillUint64(uint64_t *output, std::size_t count)
+    {
+        PRNG_COUNT_CALL(callFillUint64);
+        fillWords(output, count);
+    }
+
+    /**
+     * @brief Advances the generator by 2^512 steps
+     *
+     * Jumping copies of one seed by different numbers of times gives streams that can't overlap
+     * for any practical length, which is safer than seeding each stream independently.
+     */
+    TEST_VIRTUAL void jump()
+    {
+        jump(jumpPolynomial());
+    }
+
+    /**
+     * @brief Advances the generator by n steps, given x^n modulo its characteristic polynomial
+     *
+     * Costs 1024 steps whatever n is. See Substreams.h for building these polynomials.
+     *
+     * @param polynomial - x^n modulo the characteristic polynomial, bit k of word i the coefficient of x^(64i + k)
+     */
+    TEST_VIRTUAL void jump(const std::array<uint64_t, 16> &polynomial)
+    {
+        std::array<uint64_t, 16> jumped = {};
+        for(uint64_t word : polynomial)
+        {
+            for(int bit = 0; bit < 64; bit++)
+            {
+                if(word & (uint64_t(1) << bit))
+                {
+                    for(unsigned long i = 0; i < 16; i++)
+                    {
+                        jumped[i] ^= state[(i + position) % 16];
+                    }
+                }
+                xorshift1024();
+            }
+        }
+        for(unsigned long i = 0; i < 16; i++)
+        {
+            state[(i + position) % 16] = jumped[i];
+        }
+    }
+
+    /**
+     * @brief Returns the polynomial jump() uses
+     * @return x^(2^512) modulo the characteristic polynomial of xorshift1024
+     */
+    static const std::array<uint64_t, 16> &jumpPolynomial()
+    {
+        static const std::array<uint64_t, 16> polynomial = {{
+            0x84242f96eca9c41dULL, 0xa3c65b8776f96855ULL, 0x5b34a39f070b5837ULL, 0x4489affce4f31a1eULL,
+            0x2ffeeb0a48316f40ULL, 0xdc2d9891fe68c022ULL, 0x3659132bb12fea70ULL, 0xaac17d8efa43cab8ULL,
+            0xc4cb815590989b13ULL, 0x5ee975283d71c93bULL, 0x691548c86c1bd540ULL, 0x7910c41d10a1e6a5ULL,
+            0x0b5fc64563b3e2a8ULL, 0x047f7684e9fc949dULL, 0xb99181f2d8f685caULL, 0x284600e3f30e38c3ULL}};
+        return polynomial;
+    }
+
+    class Shared;
+
+    /**
+     * @brief Returns a generator shared by the whole process, which any thread can use safely
+     *
+     * For code on short-lived or borrowed threads where giving each thread its own PRNG isn't
+     * practical. See PRNG::Shared.
+     *
+     * @return the process wide generator
+     */
+    static Shared &shared();
+
+private:
+    friend class PRNGBase<PRNG>;
+
+    std::array<uint64_t, 16> state;
+    unsigned long position;
+
+    uint64_t nextUint64()
+    {
+        return xorshift1024();
+    }
+
+    // A single pass over the state, for fillUint64() and the bulk functions built on it
+    void fillWords(uint64_t *output, std::size_t count)
+    {
+        PRNG_COUNT_STEPS(count);
+        unsigned long p = position;
+        uint64_t state0 = state[p];
+        for(std::size_t i = 0; i < count; i++)
+        {
+            p = (p + 1) % 16;
+            uint64_t state1 = state[p];
+            state1 ^= state1 << 31;
+            state1 ^= state1 >> 11;
+            state0 ^= state0 >> 30;
+            state0 ^= state1;
+            state[p] = state0;
+            output[i] = state0 * 1181783497276652981LL;
+        }
+        position = p;
+    }
+
+    uint64_t xorshift1024()
+    {
+        uint64_t state0 = state[position];
+        position = (position + 1) % 16;
+        uint64_t state1 = state[position];
+        state1 ^= state1 << 31;
+        state1 ^= state1 >> 11;
+        state0 ^= state0 >> 30;
+        state[position] = state0 ^ state1;
+        return state[position] * 1181783497276652981LL;
+    }
+
+    // You really shouldn't copy this class.
+    PRNG(PRNG const&) = delete;
+};
+
+/**
+ * @brief A process wide generator, split into one PRNG per CPU.
+ *
+ * A draw uses the shard for the CPU the calling thread is running on, found with sched_getcpu()
+ * where it's available, so threads rarely touch the same shard and never share a cache line.
+ * Each shard has a spinlock that is almost always uncontended. If a thread is moved or
+ * preempted mid-draw and the shard is busy, the next thread moves on to the following shard
+ * rather than waiting.
+ *
+ * The shards are seeded once from std::random_device and then jump()ed apart, so they never
+ * produce overlapping streams. Seed a PRNG of your own if you need reproducible results.
+ */
+class PRNG::Shared
+{
+public:
+    typedef uint64_t result_type;
+
+    static constexpr result_type min()
+    {
+        return PRNG::min();
+    }
+
+    static constexpr result_type max()
+    {
+        return PRNG::max();
+    }
+
+    /**
+     * @brief Calls draw with exclusive use of one of the shards
+     *
+     * Use this to make several draws for the price of one lock, e.g.
+     * PRNG::shared().draw([](PRNG &rng) { return rng.getRandomInt(1, 6) + rng.getRandomInt(1, 6); });
+     *
+     * @param draw - a function taking a PRNG &, it shouldn't keep the reference
+     * @return whatever draw returns
+     */
+    template <class Draw>
+    auto draw(Draw draw) -> decltype(draw(std::declval<PRNG &>()))
+    {
+        Shard &shard = lock();
+        ShardGuard guard(shard);
+        return draw(shard.rng);
+    }
+
+    /**
+     * @brief Generates a random uint64_t, so the shared generator can drive the standard algorithms
+     * @return a uint64_t containing a random number
+     */
+    result_type operator()()
+    {
+        return getRandomUint64();
+    }
+
+    /**
+     * @brief Generates a random uint64_t
+     * @return a uint64_t containing a random number
+     */
+    uint64_t getRandomUint64()
+    {
+        return draw([](PRNG &rng) { return rng.getRandomUint64(); });
+    }
+
+    /**
+     * @brief Generates a random number between 0 and maxValue (inclusive)
+     * @param maxValue - The highest value this should return
+     * @return a uint64_t containing a random number
+     */
+    uint64_t getRandomUint64(uint64_t maxValue)
+    {
+        return draw([maxValue](PRNG &rng) { return rng.getRandomUint64(maxValue); });
+    }
+
+    /**
+     * @brief Generates a random number between 0 and 1
+     * @return a double containing a random number
+     */
+    double getRandomDouble()
+    {
+        return draw([](PRNG &rng) { return rng.getRandomDouble(); });
+    }
+
+    /**
+     * @brief Returns how many shards the generator is split into
+     * @return the number of shards, at least 1
+     */
+    std::size_t shardCount() const
+    {
+        return count;
+    }
+
+private:
+    friend class PRNG;
+
+    static constexpr std::size_t cacheLine = 64;
+
+    struct Shard
+    {
+        explicit Shard(const std::array<uint64_t, 16> &seed) : rng(seed)
+        {
+            busy.clear();
+        }
+
+        std::atomic_flag busy;
+        PRNG rng;
+    };
+
+    // Every shard starts on its own cache line and the padding keeps the next one off it
+    static constexpr std::size_t shardStride = (sizeof(Shard) + cacheLine - 1) / cacheLine * cacheLine;
+
+    struct ShardGuard
+    {
+        explicit ShardGuard(Shard &shard) : shard(shard) {}
+
+        ~ShardGuard()
+        {
+            shard.busy.clear(std::memory_order_release);
+        }
+
+        Shard &shard;
+    };
+
+    std::size_t count;
+    std::unique_ptr<unsigned char[]> memory;
+    Shard *first;
+
+    Shared() : count(std::thread::hardware_concurrency())
+    {
+        if(count == 0)
+        {
+            count = 1;
+        }
+        memory.reset(new unsigned char[count * shardStride + cacheLine]);
+        uintptr_t address = reinterpret_cast<uintptr_t>(memory.get());
+        first = reinterpret_cast<Shard *>((address + cacheLine - 1) / cacheLine * cacheLine);
+
+        PRNG seeder;
+        for(std::size_t i = 0; i < count; i++)
+        {
+            new (&shard(i)) Shard(seeder.getState());
+            seeder.jump();
+        }
+    }
+
+    ~Shared()
+    {
+        for(std::size_t i = 0; i < count; i++)
+        {
+            shard(i).~Shard();
+        }
+    }
+
+    Shared(const Shared &) = delete;
+    Shared &operator=(const Shared &) = delete;
+
+    Shard &shard(std::size_t index)
+    {
+        return *reinterpret_cast<Shard *>(reinterpret_cast<unsigned char *>(first) + index * shardStride);
+    }
+
+    Shard &lock()
+    {
+        std::size_t index = currentCpu() % count;
+        while(shard(index).busy.test_and_set(std::memory_order_acquire))
+        {
+            index = (index + 1) % count;
+        }
+        return shard(index);
+    }
+
+    static std::size_t currentCpu()
+    {
+    #ifdef __linux__
+        int cpu = sched_getcpu();
+        if(cpu >= 0)
+        {
+            return static_cast<std::size_t>(cpu);
+        }
+    #endif
+        // Without a CPU number spread threads over the shards by their id instead
+        return std::hash<std::thread::id>()(std::this_thread::get_id());
+    }
+};
+
+inline PRNG::Shared &PRNG::shared()
+{
+    static Shared instance;
+    return instance;
+}
+
 #undef TEST_VIRTUAL
 #endif // PRNG_H
@@ -0,0 +1,204 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef PRNGENSEMBLE_H
+#define PRNGENSEMBLE_H
+
+#include "PRNG.h"
+#include "Dispatch.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace prng_detail
+{
+
+inline uint64_t rotateLeft(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// One step of xoroshiro128++, advancing the state in place
+inline uint64_t xoroshiroStep(uint64_t &state0, uint64_t &state1)
+{
+    uint64_t s0 = state0;
+    uint64_t s1 = state1;
+    uint64_t result = rotateLeft(s0 + s1, 17) + s0;
+    s1 ^= s0;
+    state0 = rotateLeft(s0, 49) ^ s1 ^ (s1 << 21);
+    state1 = rotateLeft(s1, 28);
+    return result;
+}
+
+PRNG_ALWAYS_INLINE inline void stepStreamsKernel(uint64_t *low, uint64_t *high, std::size_t count, uint64_t *output)
+{
+    for(std::size_t i = 0; i < count; i++)
+    {
+        output[i] = xoroshiroStep(low[i], high[i]);
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(stepStreams, stepStreamsKernel)
+
+PRNG_ALWAYS_INLINE inline void stepMaskedKernel(uint64_t *low, uint64_t *high, std::size_t count,
+                                                const uint8_t *active, uint64_t *output)
+{
+    for(std::size_t i = 0; i < count; i++)
+    {
+        uint64_t nextLow = low[i];
+        uint64_t nextHigh = high[i];
+        uint64_t result = xoroshiroStep(nextLow, nextHigh);
+        // All ones for an active stream, zero otherwise
+        uint64_t keep = uint64_t(0) - (active[i] != 0);
+        low[i] = (nextLow & keep) | (low[i] & ~keep);
+        high[i] = (nextHigh & keep) | (high[i] & ~keep);
+        output[i] = (result & keep) | (output[i] & ~keep);
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(stepMasked, stepMaskedKernel)
+
+}
+
+/**
+ * @brief A generator for each of a large number of entities, all stepped together.
+ *
+ * Each entity gets its own xoroshiro128++ stream, which needs 16 bytes of state rather than
+ * PRNG's 136. The states are kept as two arrays rather than an array of structs, so stepping
+ * every entity at once is a single pass over contiguous memory that the compiler vectorises.
+ *
+ * An entity's stream depends only on the ensemble's seed and the entity's index, never on how
+ * many entities there are or how they're stepped, so results stay reproducible as a
+ * simulation is resized or split into batches.
+ */
+class PRNGEnsemble
+{
+public:
+    /**
+     * @brief Constructs an ensemble of streams from a seed
+     * @param size - the number of streams
+     * @param seed - the same seed always gives each index the same stream
+     */
+    PRNGEnsemble(std::size_t size, uint64_t seed) : low(size), high(size)
+    {
+        seedStreams(seed);
+    }
+
+    /**
+     * @brief Constructs an ensemble of streams seeded from rng
+     * @param size - the number of streams
+     * @param rng - the generator the seed is drawn from
+     */
+    PRNGEnsemble(std::size_t size, PRNG &rng) : low(size), high(size)
+    {
+        seedStreams(rng.getRandomUint64());
+    }
+
+    /**
+     * @brief Returns the number of streams
+     * @return the size given on construction
+     */
+    std::size_t size() const
+    {
+        return low.size();
+    }
+
+    /**
+     * @brief Generates the next random uint64_t of one stream
+     * @param index - which stream to advance
+     * @throw cassert ensuring index < size()
+     * @return a uint64_t containing a random number
+     */
+    uint64_t getRandomUint64(std::size_t index)
+    {
+        assert(index < size());
+        return prng_detail::xoroshiroStep(low[index], high[index]);
+    }
+
+    /**
+     * @brief Advances every stream once
+     * @param output - where size() random numbers are written, output[i] from stream i
+     */
+    void stepAll(uint64_t *output)
+    {
+        stepRange(0, size(), output);
+    }
+
+    /**
+     * @brief Advances streams first to first + count - 1 once each
+     *
+     * Stepping the ensemble in batches gives exactly the same numbers as stepAll().
+     *
+     * @param first - the first stream to advance
+     * @param count - how many streams to advance
+     * @param output - where count random numbers are written, output[i] from stream first + i
+     * @throw cassert ensuring first + count <= size()
+     */
+    void stepRange(std::size_t first, std::size_t count, uint64_t *output)
+    {
+        assert(first + count <= size());
+        prng_detail::stepStreams(low.data() + first, high.data() + first, count, output);
+    }
+
+    /**
+     * @brief Advances only the streams whose entry in active is non-zero
+     *
+     * Every stream is computed and the results blended in, so there is no branch per entity.
+     * Inactive streams are left where they were and their output entries aren't changed.
+     *
+     * @param active - size() flags, one for each stream
+     * @param output - where the random numbers of the active streams are written
+     */
+    void stepMasked(const uint8_t *active, uint64_t *output)
+    {
+        prng_detail::stepMasked(low.data(), high.data(), size(), active, output);
+    }
+
+private:
+    std::vector<uint64_t> low;
+    std::vector<uint64_t> high;
+
+    static uint64_t splitMix64(uint64_t value)
+    {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+
+    // Each stream's state is hashed from the seed and its index alone
+    void seedStreams(uint64_t seed)
+    {
+        const uint64_t golden = 0x9e3779b97f4a7c15ULL;
+        for(std::size_t i = 0; i < size(); i++)
+        {
+            uint64_t counter = seed + 2 * static_cast<uint64_t>(i) * golden;
+            low[i] = splitMix64(counter + golden);
+            high[i] = splitMix64(counter + 2 * golden);
+            // xoroshiro can't leave the all zero state
+            if(low[i] == 0 && high[i] == 0)
+            {
+                low[i] = 1;
+            }
+        }
+    }
+};
+
+#endif // PRNGENSEMBLE_H
@@ -0,0 +1,228 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef PREFETCHINGPRNG_H
+#define PREFETCHINGPRNG_H
+
+#include "PRNG.h"
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief A generator whose words are made ahead of time by a background thread.
+ *
+ * The producer thread fills a lock-free single producer, single consumer ring with fillUint64(),
+ * so the getRandom functions just pop a word that is already in cache. The producer fills the
+ * ring up then sleeps until the consumer has drained it to the refill threshold.
+ *
+ * If the ring ever runs dry the consumer generates the word itself from a second, jump()ed apart
+ * PRNG rather than waiting, so a burst never blocks. That means the sequence is only the same as
+ * PRNG's from the same seed while the producer keeps up.
+ *
+ * Like PRNG, a PrefetchingPRNG must only be used by one thread at a time.
+ */
+class PrefetchingPRNG : public PRNGBase<PrefetchingPRNG>
+{
+public:
+    /**
+     * @brief Constructs a new PrefetchingPRNG seeded from std::random_device and starts its producer
+     * @param capacity - the number of words the ring holds, rounded up to a power of two
+     * @param refillThreshold - the producer wakes when this many words or fewer are left
+     * @throw cassert ensuring capacity > 0 and refillThreshold < capacity
+     */
+    explicit PrefetchingPRNG(std::size_t capacity = 4096, std::size_t refillThreshold = 2048)
+        : PrefetchingPRNG(PRNG().getState(), capacity, refillThreshold) {}
+
+    /**
+     * @brief Constructs a new PrefetchingPRNG with a set seed and starts its producer
+     * @param seed - the value seed it should start with
+     * @param capacity - the number of words the ring holds, rounded up to a power of two
+     * @param refillThreshold - the producer wakes when this many words or fewer are left
+     * @throw cassert ensuring capacity > 0 and refillThreshold < capacity
+     */
+    explicit PrefetchingPRNG(const std::array<uint64_t, 16> &seed, std::size_t capacity = 4096,
+                             std::size_t refillThreshold = 2048)
+        : fallback(seed), producerEngine(seed)
+    {
+        start(capacity, refillThreshold);
+    }
+
+    /**
+     * @brief Stops and joins the producer thread
+     */
+    ~PrefetchingPRNG()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        producer.join();
+    }
+
+    /**
+     * @brief Returns how many words are waiting in the ring
+     * @return the number of words the next draws can take without generating inline
+     */
+    std::size_t available() const
+    {
+        return head.load(std::memory_order_acquire) - consumerTail;
+    }
+
+    /**
+     * @brief Returns how many words the ring can hold
+     * @return the capacity, a power of two
+     */
+    std::size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    friend class PRNGBase<PrefetchingPRNG>;
+
+    static constexpr std::size_t cacheLine = 64;
+
+    // Written by the producer, read by the consumer
+    alignas(cacheLine) std::atomic<std::size_t> head;
+    // Written by the consumer, read by the producer
+    alignas(cacheLine) std::atomic<std::size_t> tail;
+    // The consumer's own copies, so most draws don't touch the shared lines at all
+    alignas(cacheLine) std::size_t consumerTail;
+    std::size_t knownHead;
+    std::size_t mask;
+    std::size_t threshold;
+    std::unique_ptr<uint64_t[]> ring;
+    PRNG fallback;
+
+    alignas(cacheLine) PRNG producerEngine;
+    std::atomic<bool> sleeping;
+    bool stopping;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::thread producer;
+
+    void start(std::size_t requestedCapacity, std::size_t refillThreshold)
+    {
+        assert(requestedCapacity > 0);
+        std::size_t size = 1;
+        while(size < requestedCapacity)
+        {
+            size *= 2;
+        }
+        assert(refillThreshold < size);
+
+        head.store(0);
+        tail.store(0);
+        consumerTail = 0;
+        knownHead = 0;
+        mask = size - 1;
+        threshold = refillThreshold;
+        ring.reset(new uint64_t[size]);
+        // The fallback starts from the same seed, so it's jumped to keep the streams apart
+        fallback.jump();
+        sleeping.store(false);
+        stopping = false;
+        producer = std::thread(&PrefetchingPRNG::produce, this);
+    }
+
+    uint64_t nextUint64()
+    {
+        if(consumerTail == knownHead)
+        {
+            knownHead = head.load(std::memory_order_acquire);
+            if(consumerTail == knownHead)
+            {
+                wakeProducer();
+                return fallback.getRandomUint64();
+            }
+        }
+        uint64_t word = ring[consumerTail & mask];
+        consumerTail++;
+        tail.store(consumerTail, std::memory_order_release);
+        if(knownHead - consumerTail <= threshold)
+        {
+            knownHead = head.load(std::memory_order_acquire);
+            if(knownHead - consumerTail <= threshold)
+            {
+                wakeProducer();
+            }
+        }
+        return word;
+    }
+
+    void wakeProducer()
+    {
+        // Pairs with the producer setting sleeping before it rechecks tail, so a wake up can't be lost
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(sleeping.load(std::memory_order_relaxed) && sleeping.exchange(false))
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            wake.notify_one();
+        }
+    }
+
+    void produce()
+    {
+        std::size_t produced = 0;
+        while(true)
+        {
+            std::size_t space = mask + 1 - (produced - tail.load(std::memory_order_acquire));
+            if(space == 0)
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                // The consumer clears sleeping when it wakes us, so it's set again before every wait
+                while(true)
+                {
+                    sleeping.store(true);
+                    if(stopping || produced - tail.load() <= threshold)
+                    {
+                        break;
+                    }
+                    wake.wait(lock);
+                }
+                sleeping.store(false, std::memory_order_relaxed);
+                if(stopping)
+                {
+                    return;
+                }
+                continue;
+            }
+            // Fill up to the end of the ring, the next pass wraps round to the start
+            std::size_t offset = produced & mask;
+            std::size_t count = space < mask + 1 - offset ? space : mask + 1 - offset;
+            producerEngine.fillUint64(&ring[offset], count);
+            produced += count;
+            head.store(produced, std::memory_order_release);
+        }
+    }
+
+    PrefetchingPRNG(const PrefetchingPRNG &) = delete;
+    PrefetchingPRNG &operator=(const PrefetchingPRNG &) = delete;
+};
+
+#endif // PREFETCHINGPRNG_H
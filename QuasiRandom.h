@@ -0,0 +1,510 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef QUASIRANDOM_H
+#define QUASIRANDOM_H
+
+#include "PRNG.h"
+#include "SobolDirections.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace prng_detail
+{
+
+inline uint32_t reverseBits32(uint32_t value)
+{
+    value = ((value >> 1) & 0x55555555) | ((value & 0x55555555) << 1);
+    value = ((value >> 2) & 0x33333333) | ((value & 0x33333333) << 2);
+    value = ((value >> 4) & 0x0f0f0f0f) | ((value & 0x0f0f0f0f) << 4);
+    value = ((value >> 8) & 0x00ff00ff) | ((value & 0x00ff00ff) << 8);
+    return (value >> 16) | (value << 16);
+}
+
+/*
+ * Burley's hash based Owen scramble. After reversing the bits, each bit of the hash depends only on
+ * the bits below it, so every digit of the result is flipped according to the digits before it.
+ */
+inline uint32_t owenScramble(uint32_t value, uint32_t seed)
+{
+    value = reverseBits32(value);
+    value ^= value * 0x3d20adea;
+    value += seed;
+    value *= (seed >> 16) | 1;
+    value ^= value * 0x05526c56;
+    value ^= value * 0x53a22864;
+    return reverseBits32(value);
+}
+
+inline uint64_t mix64(uint64_t value)
+{
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+// The largest value below 1, so conversions from double can't round up to 1
+template <class T>
+inline T belowOne(double value)
+{
+    T converted = static_cast<T>(value);
+    return converted < 1 ? converted : 1 - std::numeric_limits<T>::epsilon() / 2;
+}
+
+}
+
+/**
+ * @brief The interface shared by the low discrepancy sequences.
+ *
+ * The getRandom functions hand out the coordinates of one point after another, so code written
+ * against PRNG's getRandomDouble() that draws dimensions() numbers per sample works unchanged,
+ * but converges like a quasi-Monte Carlo integration. Any coordinates of a point left unread
+ * when seek() or fillPoints() is called are skipped.
+ *
+ * A sequence provides a private void generate(uint64_t index, double *point), which may keep
+ * state for the next index, and a const pointAt(uint64_t index, double *point) for random access.
+ */
+template <class Derived>
+class QuasiRandomBase
+{
+public:
+    /**
+     * @brief Returns the number of coordinates in each point
+     * @return the dimensions given on construction
+     */
+    std::size_t dimensions() const
+    {
+        return current.size();
+    }
+
+    /**
+     * @brief Returns the index of the point the next coordinate is taken from
+     * @return the number of points started since the sequence began or was last seeked
+     */
+    uint64_t index() const
+    {
+        return coordinate == current.size() ? position : position - 1;
+    }
+
+    /**
+     * @brief Moves to the start of a point, so the next draw is its first coordinate
+     * @param index - the point to move to
+     */
+    void seek(uint64_t index)
+    {
+        position = index;
+        coordinate = current.size();
+    }
+
+    /**
+     * @brief Returns the next coordinate, in [0, 1)
+     * @return a float coordinate
+     */
+    float getRandomFloat()
+    {
+        return prng_detail::belowOne<float>(nextCoordinate());
+    }
+
+    /**
+     * @brief Returns the next coordinate scaled to [0, maxValue)
+     * @param maxValue - the scale of the coordinate
+     * @return a float coordinate
+     */
+    float getRandomFloat(float maxValue)
+    {
+        return getRandomFloat() * maxValue;
+    }
+
+    /**
+     * @brief Returns the next coordinate scaled to [minValue, maxValue)
+     * @param minValue - the lowest value this should return
+     * @param maxValue - the upper end of the range
+     * @return a float coordinate
+     */
+    float getRandomFloat(float minValue, float maxValue)
+    {
+        return minValue + getRandomFloat() * (maxValue - minValue);
+    }
+
+    /**
+     * @brief Returns the next coordinate, in [0, 1)
+     * @return a double coordinate
+     */
+    double getRandomDouble()
+    {
+        return nextCoordinate();
+    }
+
+    /**
+     * @brief Returns the next coordinate scaled to [0, maxValue)
+     * @param maxValue - the scale of the coordinate
+     * @return a double coordinate
+     */
+    double getRandomDouble(double maxValue)
+    {
+        return getRandomDouble() * maxValue;
+    }
+
+    /**
+     * @brief Returns the next coordinate scaled to [minValue, maxValue)
+     * @param minValue - the lowest value this should return
+     * @param maxValue - the upper end of the range
+     * @return a double coordinate
+     */
+    double getRandomDouble(double minValue, double maxValue)
+    {
+        return minValue + getRandomDouble() * (maxValue - minValue);
+    }
+
+    /**
+     * @brief Computes any point of the sequence without moving it on
+     * @param index - which point to compute
+     * @param point - where dimensions() coordinates are written
+     */
+    template <class T>
+    void getPoint(uint64_t index, T *point) const
+    {
+        std::vector<double> coordinates(current.size());
+        derived().pointAt(index, coordinates.data());
+        for(std::size_t d = 0; d < coordinates.size(); d++)
+        {
+            point[d] = prng_detail::belowOne<T>(coordinates[d]);
+        }
+    }
+
+    /**
+     * @brief Writes the next count points and moves past them
+     * @param coordinates - dimensions() arrays, coordinates[d] is where count values of coordinate d are written
+     * @param count - how many points to write
+     */
+    template <class T>
+    void fillPoints(T *const *coordinates, std::size_t count)
+    {
+        std::vector<double> point(current.size());
+        for(std::size_t i = 0; i < count; i++)
+        {
+            derived().generate(position++, point.data());
+            for(std::size_t d = 0; d < point.size(); d++)
+            {
+                coordinates[d][i] = prng_detail::belowOne<T>(point[d]);
+            }
+        }
+        coordinate = current.size();
+    }
+
+protected:
+    explicit QuasiRandomBase(std::size_t dimensions) : position(0), coordinate(dimensions), current(dimensions)
+    {
+        assert(dimensions > 0);
+    }
+
+private:
+    uint64_t position;
+    std::size_t coordinate;
+    std::vector<double> current;
+
+    double nextCoordinate()
+    {
+        if(coordinate == current.size())
+        {
+            static_cast<Derived *>(this)->generate(position++, current.data());
+            coordinate = 0;
+        }
+        return current[coordinate++];
+    }
+
+    Derived &derived()
+    {
+        return *static_cast<Derived *>(this);
+    }
+
+    const Derived &derived() const
+    {
+        return *static_cast<const Derived *>(this);
+    }
+};
+
+/**
+ * @brief The Sobol low discrepancy sequence, with Joe and Kuo's direction numbers.
+ *
+ * Consecutive points are made in Gray code order, each from the last with one xor per
+ * coordinate. Up to 1024 dimensions and 2^32 points are supported, with 32 bits per coordinate.
+ *
+ * Unscrambled, the first point is all zeros and the sequence is the same every time. Constructing
+ * it from a PRNG applies an Owen scramble, which keeps the stratification of the points but
+ * randomises them, so independent scrambles give an unbiased error estimate.
+ */
+class SobolSequence : public QuasiRandomBase<SobolSequence>
+{
+public:
+    /**
+     * @brief Constructs an unscrambled Sobol sequence
+     * @param dimensions - the number of coordinates in each point
+     * @throw cassert ensuring 0 < dimensions <= 1024
+     */
+    explicit SobolSequence(std::size_t dimensions) : QuasiRandomBase<SobolSequence>(dimensions)
+    {
+        initialise();
+    }
+
+    /**
+     * @brief Constructs an Owen scrambled Sobol sequence
+     * @param dimensions - the number of coordinates in each point
+     * @param rng - the generator the scramble of each dimension is drawn from
+     * @throw cassert ensuring 0 < dimensions <= 1024
+     */
+    SobolSequence(std::size_t dimensions, PRNG &rng) : QuasiRandomBase<SobolSequence>(dimensions)
+    {
+        initialise();
+        for(std::size_t d = 0; d < dimensions; d++)
+        {
+            scrambleSeeds.push_back(static_cast<uint32_t>(rng.getRandomUint64()));
+        }
+    }
+
+private:
+    friend class QuasiRandomBase<SobolSequence>;
+
+    static constexpr int bits = 32;
+
+    // directions[d * bits + k] is direction number k of dimension d, scaled to 32 bits
+    std::vector<uint32_t> directions;
+    std::vector<uint32_t> scrambleSeeds;
+    // The unscrambled integer coordinates of point stateIndex
+    std::vector<uint32_t> state;
+    uint64_t stateIndex;
+
+    void initialise()
+    {
+        const std::size_t count = dimensions();
+        assert(count <= prng_detail::sobolMaxDimensions);
+        directions.resize(count * bits);
+        state.assign(count, 0);
+        stateIndex = 0;
+        for(int k = 0; k < bits; k++)
+        {
+            directions[k] = uint32_t(1) << (bits - 1 - k);
+        }
+        const uint16_t *initial = prng_detail::sobolInitialNumbers;
+        for(std::size_t d = 1; d < count; d++)
+        {
+            uint32_t polynomial = prng_detail::sobolPolynomials[d - 1];
+            int degree = 0;
+            while(polynomial >> (degree + 1))
+            {
+                degree++;
+            }
+            uint32_t *v = &directions[d * bits];
+            for(int k = 0; k < degree && k < bits; k++)
+            {
+                v[k] = static_cast<uint32_t>(initial[k]) << (bits - 1 - k);
+            }
+            // The recurrence the polynomial defines, v[k] from the degree before it
+            for(int k = degree; k < bits; k++)
+            {
+                v[k] = v[k - degree] ^ (v[k - degree] >> degree);
+                for(int j = 1; j < degree; j++)
+                {
+                    if((polynomial >> (degree - j)) & 1)
+                    {
+                        v[k] ^= v[k - j];
+                    }
+                }
+            }
+            initial += degree;
+        }
+    }
+
+    // The unscrambled coordinates of a point, from the bits of its Gray code
+    void integersAt(uint64_t index, uint32_t *output) const
+    {
+        assert(index >> bits == 0);
+        uint64_t gray = index ^ (index >> 1);
+        for(std::size_t d = 0; d < dimensions(); d++)
+        {
+            uint32_t value = 0;
+            for(int k = 0; k < bits; k++)
+            {
+                if((gray >> k) & 1)
+                {
+                    value ^= directions[d * bits + k];
+                }
+            }
+            output[d] = value;
+        }
+    }
+
+    void toUnits(const uint32_t *integers, double *point) const
+    {
+        for(std::size_t d = 0; d < dimensions(); d++)
+        {
+            uint32_t value = scrambleSeeds.empty() ? integers[d] : prng_detail::owenScramble(integers[d], scrambleSeeds[d]);
+            point[d] = value * (1.0 / 4294967296.0);
+        }
+    }
+
+    void pointAt(uint64_t index, double *point) const
+    {
+        std::vector<uint32_t> integers(dimensions());
+        integersAt(index, integers.data());
+        toUnits(integers.data(), point);
+    }
+
+    void generate(uint64_t index, double *point)
+    {
+        if(index == stateIndex + 1)
+        {
+            assert(index >> bits == 0);
+            // Gray codes of consecutive indices differ only in the lowest set bit of the index
+            int bit = 0;
+            while(((index >> bit) & 1) == 0)
+            {
+                bit++;
+            }
+            for(std::size_t d = 0; d < dimensions(); d++)
+            {
+                state[d] ^= directions[d * bits + bit];
+            }
+        }
+        else if(index != stateIndex)
+        {
+            integersAt(index, state.data());
+        }
+        stateIndex = index;
+        toUnits(state.data(), point);
+    }
+};
+
+/**
+ * @brief The Halton low discrepancy sequence, the radical inverses of the index in prime bases.
+ *
+ * Dimension d uses the (d + 1)th prime as its base, so there is no limit on dimensions, but the
+ * unscrambled sequence is badly correlated between the higher dimensions. Prefer Sobol there, or
+ * scramble it: constructing it from a PRNG shifts each digit by a random amount chosen from the
+ * digits before it, Owen's nested scrambling with shifts rather than full permutations.
+ */
+class HaltonSequence : public QuasiRandomBase<HaltonSequence>
+{
+public:
+    /**
+     * @brief Constructs an unscrambled Halton sequence
+     * @param dimensions - the number of coordinates in each point
+     * @throw cassert ensuring dimensions > 0
+     */
+    explicit HaltonSequence(std::size_t dimensions) : QuasiRandomBase<HaltonSequence>(dimensions)
+    {
+        initialise();
+    }
+
+    /**
+     * @brief Constructs a scrambled Halton sequence
+     * @param dimensions - the number of coordinates in each point
+     * @param rng - the generator the scramble of each dimension is drawn from
+     * @throw cassert ensuring dimensions > 0
+     */
+    HaltonSequence(std::size_t dimensions, PRNG &rng) : QuasiRandomBase<HaltonSequence>(dimensions)
+    {
+        initialise();
+        for(std::size_t d = 0; d < dimensions; d++)
+        {
+            scrambleSeeds.push_back(rng.getRandomUint64());
+        }
+    }
+
+private:
+    friend class QuasiRandomBase<HaltonSequence>;
+
+    std::vector<uint32_t> bases;
+    // Each coordinate has digits[d] digits, base^digits being the largest power within 2^53
+    std::vector<int> digits;
+    std::vector<uint64_t> scale;
+    std::vector<uint64_t> scrambleSeeds;
+
+    void initialise()
+    {
+        for(uint32_t candidate = 2; bases.size() < dimensions(); candidate++)
+        {
+            bool prime = true;
+            for(std::size_t i = 0; i < bases.size() && bases[i] * bases[i] <= candidate; i++)
+            {
+                prime = prime && candidate % bases[i] != 0;
+            }
+            if(prime)
+            {
+                bases.push_back(candidate);
+            }
+        }
+        for(uint32_t base : bases)
+        {
+            int count = 0;
+            uint64_t power = 1;
+            while(power <= (uint64_t(1) << 53) / base)
+            {
+                power *= base;
+                count++;
+            }
+            digits.push_back(count);
+            scale.push_back(power);
+        }
+    }
+
+    void pointAt(uint64_t index, double *point) const
+    {
+        for(std::size_t d = 0; d < dimensions(); d++)
+        {
+            const uint64_t base = bases[d];
+            uint64_t remaining = index;
+            uint64_t numerator = 0;
+            uint64_t place = scale[d];
+            uint64_t node = scrambleSeeds.empty() ? 0 : scrambleSeeds[d];
+            // The digits of the index, least significant first, become the digits after the point
+            for(int j = 0; j < digits[d]; j++)
+            {
+                if(remaining == 0 && scrambleSeeds.empty())
+                {
+                    break;
+                }
+                uint64_t digit = remaining % base;
+                remaining /= base;
+                if(!scrambleSeeds.empty())
+                {
+                    // Each node of the digit tree gets its own shift, hashed from the path to it
+                    node = prng_detail::mix64(node + 0x9e3779b97f4a7c15ULL);
+                    uint64_t shift = ((node >> 32) * base) >> 32;
+                    node ^= digit;
+                    digit = (digit + shift) % base;
+                }
+                place /= base;
+                numerator += digit * place;
+            }
+            point[d] = static_cast<double>(numerator) / static_cast<double>(scale[d]);
+        }
+    }
+
+    void generate(uint64_t index, double *point)
+    {
+        pointAt(index, point);
+    }
+};
+
+#endif // QUASIRANDOM_H
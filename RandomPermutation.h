@@ -0,0 +1,236 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef RANDOMPERMUTATION_H
+#define RANDOMPERMUTATION_H
+
+#include "PRNG.h"
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+/**
+ * @brief A random permutation of [0, size) that takes O(1) memory.
+ *
+ * Rather than storing a shuffled array the permutation is a keyed bijection: an alternating
+ * Feistel network over the smallest power of two covering size, with cycle-walking to stay
+ * inside [0, size). As the power of two is at most twice size, a lookup averages fewer than two
+ * passes through the network.
+ *
+ * The keys are drawn from a PRNG so the same seed always gives the same permutation.
+ */
+class RandomPermutation
+{
+public:
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef uint64_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const uint64_t *pointer;
+        typedef uint64_t reference;
+
+        const_iterator() : permutation(nullptr), index(0) {}
+
+        uint64_t operator*() const
+        {
+            return (*permutation)[index];
+        }
+
+        const_iterator &operator++()
+        {
+            index++;
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator previous = *this;
+            index++;
+            return previous;
+        }
+
+        bool operator==(const const_iterator &other) const
+        {
+            return index == other.index && permutation == other.permutation;
+        }
+
+        bool operator!=(const const_iterator &other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        friend class RandomPermutation;
+
+        const_iterator(const RandomPermutation *permutation, uint64_t index)
+            : permutation(permutation), index(index) {}
+
+        const RandomPermutation *permutation;
+        uint64_t index;
+    };
+
+    /**
+     * @brief Constructs a permutation of [0, size) keyed from rng
+     * @param size - the number of elements being permuted
+     * @param rng - the generator the keys are drawn from
+     * @throw cassert ensuring size > 0
+     */
+    RandomPermutation(uint64_t size, PRNG &rng) : permutationSize(size)
+    {
+        setKeys(rng);
+    }
+
+    /**
+     * @brief Constructs a permutation of [0, size) keyed from a PRNG seed
+     *
+     * The same seed and size will always produce the same permutation.
+     *
+     * @param size - the number of elements being permuted
+     * @param seed - the seed of the PRNG the keys are drawn from
+     * @throw cassert ensuring size > 0
+     */
+    RandomPermutation(uint64_t size, const std::array<uint64_t, 16> &seed) : permutationSize(size)
+    {
+        PRNG rng(seed);
+        setKeys(rng);
+    }
+
+    /**
+     * @brief Returns the position index is mapped to
+     * @param index - a value in [0, size)
+     * @throw cassert ensuring index < size
+     * @return a value in [0, size)
+     */
+    uint64_t operator[](uint64_t index) const
+    {
+        assert(index < permutationSize);
+        uint64_t mapped = encrypt(index);
+        while(mapped >= permutationSize)
+        {
+            mapped = encrypt(mapped);
+        }
+        return mapped;
+    }
+
+    /**
+     * @brief Maps count indices at once
+     *
+     * The whole batch goes through the network in one branch-free pass so the compiler can
+     * vectorise it, and only the few results that land outside [0, size) are walked again.
+     *
+     * @param indices - count values in [0, size)
+     * @param output - where the count mapped values are written, may alias indices
+     * @param count - the number of values to map
+     */
+    void map(const uint64_t *indices, uint64_t *output, std::size_t count) const
+    {
+        for(std::size_t i = 0; i < count; i++)
+        {
+            assert(indices[i] < permutationSize);
+            output[i] = encrypt(indices[i]);
+        }
+        for(std::size_t i = 0; i < count; i++)
+        {
+            while(output[i] >= permutationSize)
+            {
+                output[i] = encrypt(output[i]);
+            }
+        }
+    }
+
+    /**
+     * @brief Returns the number of elements being permuted
+     * @return the size given on construction
+     */
+    uint64_t size() const
+    {
+        return permutationSize;
+    }
+
+    /**
+     * @brief Returns an iterator over the permuted order, i.e. (*this)[0], (*this)[1], ...
+     * @return an iterator to the first element
+     */
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+
+    /**
+     * @brief Returns the end of the permuted order
+     * @return an iterator one past the last element
+     */
+    const_iterator end() const
+    {
+        return const_iterator(this, permutationSize);
+    }
+
+private:
+    static constexpr int rounds = 6;
+
+    uint64_t permutationSize;
+    std::array<uint64_t, rounds> keys;
+    int lowBits;
+    int highBits;
+    uint64_t lowMask;
+
+    void setKeys(PRNG &rng)
+    {
+        assert(permutationSize > 0);
+        int bits = 2;
+        while(bits < 64 && (uint64_t(1) << bits) < permutationSize)
+        {
+            bits++;
+        }
+        // Odd widths are split unevenly, the network alternates which half it updates anyway
+        highBits = (bits + 1) / 2;
+        lowBits = bits - highBits;
+        lowMask = (uint64_t(1) << lowBits) - 1;
+        for(uint64_t &key : keys)
+        {
+            key = rng.getRandomUint64();
+        }
+    }
+
+    static uint64_t roundFunction(uint64_t half, uint64_t key, int outputBits)
+    {
+        uint64_t mixed = (half ^ key) * 0xbf58476d1ce4e5b9ULL;
+        mixed ^= mixed >> 31;
+        return (mixed * 0x94d049bb133111ebULL) >> (64 - outputBits);
+    }
+
+    uint64_t encrypt(uint64_t value) const
+    {
+        uint64_t high = value >> lowBits;
+        uint64_t low = value & lowMask;
+        for(int i = 0; i < rounds; i += 2)
+        {
+            high ^= roundFunction(low, keys[i], highBits);
+            low ^= roundFunction(high, keys[i + 1], lowBits);
+        }
+        return (high << lowBits) | low;
+    }
+};
+
+#endif // RANDOMPERMUTATION_H
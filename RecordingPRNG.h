@@ -0,0 +1,479 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef RECORDINGPRNG_H
+#define RECORDINGPRNG_H
+
+#include "PRNG.h"
+
+/*
+ * Recording and replay of every word a generator hands out, for finding where two runs of a
+ * simulation diverge. Everything here only exists when PRNG_RECORDING is defined. Otherwise
+ * RecordingPRNG is just PRNG and PRNG_DRAW is a plain call, so production builds pay nothing.
+ *
+ * Tag the draws you want attributed with the id of the call site:
+ *
+ *     double u = PRNG_DRAW(rng, 12, getRandomDouble());
+ *
+ * Draws made without PRNG_DRAW are recorded against site 0.
+ */
+#ifndef PRNG_RECORDING
+
+typedef PRNG RecordingPRNG;
+
+#define PRNG_DRAW(generator, site, call) ((generator).call)
+
+#else
+
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief One word drawn from a RecordingPRNG and where it went.
+ */
+struct DrawRecord
+{
+    // The raw word from the underlying PRNG
+    uint64_t word;
+    // The id given to PRNG_DRAW, 0 for untagged draws
+    uint32_t site;
+    // prng_detail::methodId() of the function called
+    uint16_t method;
+    // The number of words the same call drew before this one, e.g. for rejection sampling
+    uint16_t draw;
+};
+
+namespace prng_detail
+{
+
+/*
+ * A 16 bit FNV-1a hash of a call's name, up to its argument list, so
+ * methodId("getRandomDouble(0, 1)") == methodId("getRandomDouble").
+ */
+constexpr uint16_t methodId(const char *call, uint32_t hash = 2166136261u)
+{
+    return *call == '\0' || *call == '(' ? static_cast<uint16_t>(hash ^ (hash >> 16))
+                                         : methodId(call + 1, (hash ^ static_cast<unsigned char>(*call)) * 16777619u);
+}
+
+// Generators that don't record, like PRNG itself, just ignore the tags
+template <class Engine>
+auto setDrawSite(Engine &engine, uint32_t site, uint16_t method, int) -> decltype(engine.setSite(site, method))
+{
+    engine.setSite(site, method);
+}
+
+template <class Engine>
+void setDrawSite(Engine &, uint32_t, uint16_t, long) {}
+
+// Tags the draws of one full expression with a call site, and untags them at its end
+template <class Engine>
+struct DrawScope
+{
+    Engine &engine;
+
+    DrawScope(Engine &generator, uint32_t site, uint16_t method) : engine(generator)
+    {
+        setDrawSite(engine, site, method, 0);
+    }
+
+    ~DrawScope()
+    {
+        setDrawSite(engine, 0, 0, 0);
+    }
+};
+
+}
+
+#define PRNG_DRAW(generator, site, call) \
+    (prng_detail::DrawScope<typename std::decay<decltype(generator)>::type>((generator), (site), \
+                                                                           prng_detail::methodId(#call)).engine.call)
+
+/**
+ * @brief A preallocated ring of DrawRecords, in memory or in a memory mapped file.
+ *
+ * Appending is a single store into memory that already exists, with no locking or system calls.
+ * A DrawLog belongs to one RecordingPRNG. Once full it overwrites its oldest records, so it
+ * always holds the most recent capacity() draws.
+ *
+ * A file backed log is written straight into the page cache, so the records survive the process
+ * crashing and can be opened for replay by another process.
+ */
+class DrawLog
+{
+public:
+    /**
+     * @brief Constructs an in memory log
+     * @param capacity - the number of records kept, rounded up to a power of two
+     * @throw cassert ensuring capacity > 0
+     */
+    explicit DrawLog(std::size_t capacity) : header(&localHeader), mapped(nullptr), mappedBytes(0)
+    {
+        setCapacity(capacity);
+        owned.reset(new DrawRecord[mask + 1]);
+        records = owned.get();
+    }
+
+#ifdef __unix__
+    /**
+     * @brief Creates a file backed log, replacing any file already at path
+     * @param path - the file to create
+     * @param capacity - the number of records kept, rounded up to a power of two
+     * @throw std::system_error if the file can't be created or mapped
+     * @throw cassert ensuring capacity > 0
+     */
+    DrawLog(const std::string &path, std::size_t capacity) : header(nullptr), mapped(nullptr), mappedBytes(0)
+    {
+        setCapacity(capacity);
+        int file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(file < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "can't create " + path);
+        }
+        mappedBytes = sizeof(Header) + (mask + 1) * sizeof(DrawRecord);
+        if(::ftruncate(file, static_cast<off_t>(mappedBytes)) != 0)
+        {
+            int error = errno;
+            ::close(file);
+            throw std::system_error(error, std::generic_category(), "can't size " + path);
+        }
+        map(file, PROT_READ | PROT_WRITE, path);
+        std::memcpy(header->magic, magic(), sizeof(header->magic));
+        header->capacity = mask + 1;
+        header->written = 0;
+    }
+
+    /**
+     * @brief Opens a log file written by another DrawLog, read only, for replay
+     * @param path - the file to open
+     * @throw std::system_error if the file can't be opened or isn't a log
+     */
+    explicit DrawLog(const std::string &path) : header(nullptr), mapped(nullptr), mappedBytes(0)
+    {
+        int file = ::open(path.c_str(), O_RDONLY);
+        if(file < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "can't open " + path);
+        }
+        struct stat status;
+        if(::fstat(file, &status) != 0 || static_cast<std::size_t>(status.st_size) < sizeof(Header))
+        {
+            ::close(file);
+            throw std::system_error(EINVAL, std::generic_category(), path + " isn't a draw log");
+        }
+        mappedBytes = static_cast<std::size_t>(status.st_size);
+        map(file, PROT_READ, path);
+        uint64_t capacity = header->capacity;
+        if(std::memcmp(header->magic, magic(), sizeof(header->magic)) != 0 || capacity == 0
+           || (capacity & (capacity - 1)) != 0 || sizeof(Header) + capacity * sizeof(DrawRecord) != mappedBytes)
+        {
+            ::munmap(mapped, mappedBytes);
+            throw std::system_error(EINVAL, std::generic_category(), path + " isn't a draw log");
+        }
+        mask = static_cast<std::size_t>(capacity - 1);
+    }
+#endif
+
+    ~DrawLog()
+    {
+#ifdef __unix__
+        if(mapped != nullptr)
+        {
+            ::munmap(mapped, mappedBytes);
+        }
+#endif
+    }
+
+    /**
+     * @brief Adds a record, overwriting the oldest once the log is full
+     * @param record - the record to add
+     */
+    void append(const DrawRecord &record)
+    {
+        uint64_t written = header->written;
+        records[written & mask] = record;
+        header->written = written + 1;
+    }
+
+    /**
+     * @brief Returns how many records the log can hold
+     * @return the capacity, a power of two
+     */
+    std::size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+    /**
+     * @brief Returns how many records have ever been appended, including overwritten ones
+     * @return the number of draws recorded
+     */
+    uint64_t written() const
+    {
+        return header->written;
+    }
+
+    /**
+     * @brief Returns how many records are held
+     * @return the lesser of written() and capacity()
+     */
+    std::size_t size() const
+    {
+        return header->written < capacity() ? static_cast<std::size_t>(header->written) : capacity();
+    }
+
+    /**
+     * @brief Returns a held record
+     * @param index - 0 for the oldest record still held, up to size() - 1 for the newest
+     * @throw cassert ensuring index < size()
+     * @return the record
+     */
+    const DrawRecord &operator[](std::size_t index) const
+    {
+        assert(index < size());
+        return records[(header->written - size() + index) & mask];
+    }
+
+private:
+    struct Header
+    {
+        char magic[8];
+        uint64_t capacity;
+        uint64_t written;
+        // Keeps the records on their own cache lines
+        char padding[40];
+    };
+
+    Header localHeader;
+    Header *header;
+    DrawRecord *records;
+    std::unique_ptr<DrawRecord[]> owned;
+    void *mapped;
+    std::size_t mappedBytes;
+    std::size_t mask;
+
+    // Eight bytes with the terminator, identifying a log file
+    static const char *magic()
+    {
+        return "PRNGLOG";
+    }
+
+    void setCapacity(std::size_t requested)
+    {
+        assert(requested > 0);
+        std::size_t size = 1;
+        while(size < requested)
+        {
+            size *= 2;
+        }
+        mask = size - 1;
+        localHeader.written = 0;
+    }
+
+#ifdef __unix__
+    void map(int file, int protection, const std::string &path)
+    {
+        mapped = ::mmap(nullptr, mappedBytes, protection, MAP_SHARED, file, 0);
+        int error = errno;
+        ::close(file);
+        if(mapped == MAP_FAILED)
+        {
+            mapped = nullptr;
+            throw std::system_error(error, std::generic_category(), "can't map " + path);
+        }
+        header = static_cast<Header *>(mapped);
+        records = reinterpret_cast<DrawRecord *>(header + 1);
+    }
+#endif
+
+    DrawLog(const DrawLog &) = delete;
+    DrawLog &operator=(const DrawLog &) = delete;
+};
+
+/**
+ * @brief A PRNG that appends every word it draws to a DrawLog.
+ *
+ * It produces exactly the same numbers as a PRNG with the same seed. Recording costs one record
+ * store per word, and nothing at all until a log is attached.
+ */
+class RecordingPRNG : public PRNGBase<RecordingPRNG>
+{
+public:
+    /**
+     * @brief Constructs a new RecordingPRNG seeded from std::random_device
+     */
+    RecordingPRNG() : log(nullptr), site(0), method(0), draw(0) {}
+
+    /**
+     * @brief Constructs a new RecordingPRNG with a set seed
+     * @param seed - the value seed it should start with
+     */
+    RecordingPRNG(const std::array<uint64_t, 16> &seed) : engine(seed), log(nullptr), site(0), method(0), draw(0) {}
+
+    /**
+     * @brief Starts recording to a log, or stops recording
+     * @param drawLog - where records are appended, nullptr to stop recording
+     */
+    void attach(DrawLog *drawLog)
+    {
+        log = drawLog;
+    }
+
+    /**
+     * @brief Sets the call site the following draws are recorded against, as PRNG_DRAW does
+     * @param callSite - the id of the call site, 0 for none
+     * @param callMethod - prng_detail::methodId() of the function being called
+     */
+    void setSite(uint32_t callSite, uint16_t callMethod)
+    {
+        site = callSite;
+        method = callMethod;
+        draw = 0;
+    }
+
+    /**
+     * @brief Returns the internal state of the underlying PRNG
+     * @return the state, which would seed a PRNG to continue the same sequence
+     */
+    const std::array<uint64_t, 16> &getState() const
+    {
+        return engine.getState();
+    }
+
+private:
+    friend class PRNGBase<RecordingPRNG>;
+
+    PRNG engine;
+    DrawLog *log;
+    uint32_t site;
+    uint16_t method;
+    uint16_t draw;
+
+    uint64_t nextUint64()
+    {
+        uint64_t word = engine.getRandomUint64();
+        if(log != nullptr)
+        {
+            log->append(DrawRecord{word, site, method, draw});
+        }
+        draw++;
+        return word;
+    }
+
+    RecordingPRNG(const RecordingPRNG &) = delete;
+};
+
+/**
+ * @brief Feeds the words of a DrawLog back through the getRandom functions.
+ *
+ * Running the same code against a ReplayPRNG reproduces the recorded run exactly, as long as the
+ * log never filled up and overwrote its oldest records (written() <= capacity()). Each draw is
+ * checked against the call site and function it was recorded from, so the first point at which
+ * the code takes a different path is caught.
+ */
+class ReplayPRNG : public PRNGBase<ReplayPRNG>
+{
+public:
+    /**
+     * @brief Constructs a replay of a log
+     * @param drawLog - the log to replay, which must outlive the ReplayPRNG
+     */
+    explicit ReplayPRNG(const DrawLog &drawLog)
+        : log(drawLog), position(0), divergence(0), diverged(false), site(0), method(0), draw(0) {}
+
+    /**
+     * @brief Sets the call site the following draws are expected from, as PRNG_DRAW does
+     * @param callSite - the id of the call site, 0 for none
+     * @param callMethod - prng_detail::methodId() of the function being called
+     */
+    void setSite(uint32_t callSite, uint16_t callMethod)
+    {
+        site = callSite;
+        method = callMethod;
+        draw = 0;
+    }
+
+    /**
+     * @brief Returns how many recorded words are left
+     * @return the number of words that can still be drawn
+     */
+    std::size_t remaining() const
+    {
+        return log.size() - position;
+    }
+
+    /**
+     * @brief Returns whether a draw has come from a different call site than it was recorded at
+     * @return true once the replay has diverged from the recording
+     */
+    bool hasDiverged() const
+    {
+        return diverged;
+    }
+
+    /**
+     * @brief Returns the first record drawn from a different call site or function
+     * @return its index in the log, only meaningful if hasDiverged()
+     */
+    std::size_t firstDivergence() const
+    {
+        return divergence;
+    }
+
+private:
+    friend class PRNGBase<ReplayPRNG>;
+
+    const DrawLog &log;
+    std::size_t position;
+    std::size_t divergence;
+    bool diverged;
+    uint32_t site;
+    uint16_t method;
+    uint16_t draw;
+
+    uint64_t nextUint64()
+    {
+        assert(position < log.size());
+        const DrawRecord &record = log[position];
+        if(!diverged && (record.site != site || record.method != method || record.draw != draw))
+        {
+            diverged = true;
+            divergence = position;
+        }
+        position++;
+        draw++;
+        return record.word;
+    }
+};
+
+#endif // PRNG_RECORDING
+#endif // RECORDINGPRNG_H
@@ -0,0 +1,372 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef SHAREDPOOL_H
+#define SHAREDPOOL_H
+
+#include "PRNG.h"
+#include "Substreams.h"
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __unix__
+/**
+ * @brief A ring of pre-generated words in a memory mapped file, shared by the processes on a machine.
+ *
+ * One producer process generates chunks of a single PRNG stream into the ring and any number of
+ * consumer processes read them in place. Each acquire() claims the next chunk with an atomic
+ * cursor, so consumers get disjoint chunks without copying or locking, and the data costs one
+ * core however many processes use it.
+ *
+ * Chunk n is always words offset + n * chunkWords onwards of PRNG(seed)'s stream, where the seed
+ * and offset are recorded in the file. So a consumer that logs the indices of the chunks it got
+ * can reproduce its numbers later with streamAt(), without the pool.
+ *
+ * Put the file on hugetlbfs, e.g. /dev/hugepages, to back the ring with huge pages. On tmpfs,
+ * e.g. /dev/shm, transparent huge pages are requested where the kernel allows it.
+ */
+class SharedRandomPool
+{
+public:
+    /**
+     * @brief A claimed chunk, readable in place until it's destroyed and its slot handed back to the producer.
+     *
+     * Moving a chunk hands over its slot and leaves the original empty, with no words.
+     */
+    class Chunk
+    {
+    public:
+        Chunk(Chunk &&other)
+            : pool(other.pool), chunkIndex(other.chunkIndex), words(other.words), wordCount(other.wordCount)
+        {
+            other.pool = nullptr;
+            other.words = nullptr;
+            other.wordCount = 0;
+        }
+
+        ~Chunk()
+        {
+            if(pool != nullptr)
+            {
+                pool->release(chunkIndex);
+            }
+        }
+
+        /**
+         * @brief Returns the chunk's words
+         * @return a pointer to size() random words
+         */
+        const uint64_t *data() const
+        {
+            return words;
+        }
+
+        /**
+         * @brief Returns the number of words in the chunk
+         * @return the pool's chunk size, or 0 once the chunk has been moved from
+         */
+        std::size_t size() const
+        {
+            return wordCount;
+        }
+
+        /**
+         * @brief Returns which chunk of the stream this is, to reproduce it with streamAt()
+         * @return the chunk's index, counting from 0 for the first chunk produced
+         */
+        uint64_t index() const
+        {
+            return chunkIndex;
+        }
+
+    private:
+        friend class SharedRandomPool;
+
+        Chunk(SharedRandomPool *pool, uint64_t chunkIndex, const uint64_t *words)
+            : pool(pool), chunkIndex(chunkIndex), words(words), wordCount(pool->chunkWords()) {}
+
+        SharedRandomPool *pool;
+        uint64_t chunkIndex;
+        const uint64_t *words;
+        std::size_t wordCount;
+
+        Chunk(const Chunk &) = delete;
+        Chunk &operator=(const Chunk &) = delete;
+        Chunk &operator=(Chunk &&) = delete;
+    };
+
+    /**
+     * @brief Creates a pool file for a producer, replacing any file already at path
+     * @param path - the file to create
+     * @param seed - the seed of the stream the chunks are taken from
+     * @param chunkWords - the number of words in each chunk
+     * @param slots - the number of chunks the ring holds
+     * @param offset - the position in the stream of chunk 0's first word
+     * @throw std::system_error if the file can't be created or mapped
+     * @throw cassert ensuring chunkWords > 0 and slots > 0
+     */
+    SharedRandomPool(const std::string &path, const std::array<uint64_t, 16> &seed, std::size_t chunkWords,
+                     std::size_t slots, uint64_t offset = 0)
+        : mapped(nullptr), mappedBytes(0), producer(new PRNG(streamAt(seed, offset)))
+    {
+        assert(chunkWords > 0 && slots > 0);
+        int file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(file < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "can't create " + path);
+        }
+        mappedBytes = layoutBytes(chunkWords, slots);
+        if(::ftruncate(file, static_cast<off_t>(mappedBytes)) != 0)
+        {
+            int error = errno;
+            ::close(file);
+            throw std::system_error(error, std::generic_category(), "can't size " + path);
+        }
+        map(file, path);
+        header->seed = seed;
+        header->offset = offset;
+        header->chunkWords = chunkWords;
+        header->slots = slots;
+        header->produced = 0;
+        data = slotsStart();
+        header->cursor.store(0, std::memory_order_relaxed);
+        for(std::size_t slot = 0; slot < slots; slot++)
+        {
+            sequences[slot].value.store(slot, std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header->magic, magic(), sizeof(header->magic));
+    }
+
+    /**
+     * @brief Attaches a consumer to a pool file created by a producer
+     * @param path - the file to open
+     * @throw std::system_error if the file can't be opened or isn't a pool
+     */
+    explicit SharedRandomPool(const std::string &path) : mapped(nullptr), mappedBytes(0)
+    {
+        int file = ::open(path.c_str(), O_RDWR);
+        if(file < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "can't open " + path);
+        }
+        struct stat status;
+        if(::fstat(file, &status) != 0 || static_cast<std::size_t>(status.st_size) < sizeof(Header))
+        {
+            ::close(file);
+            throw std::system_error(EINVAL, std::generic_category(), path + " isn't a random pool");
+        }
+        mappedBytes = static_cast<std::size_t>(status.st_size);
+        map(file, path);
+        if(std::memcmp(header->magic, magic(), sizeof(header->magic)) != 0 || header->chunkWords == 0
+           || header->slots == 0 || layoutBytes(header->chunkWords, header->slots) != mappedBytes)
+        {
+            ::munmap(mapped, mappedBytes);
+            throw std::system_error(EINVAL, std::generic_category(), path + " isn't a random pool");
+        }
+        data = slotsStart();
+    }
+
+    ~SharedRandomPool()
+    {
+        ::munmap(mapped, mappedBytes);
+    }
+
+    /**
+     * @brief Generates the next chunks into the ring, waiting for consumers to free their slots
+     *
+     * Only the SharedRandomPool that created the pool may call this.
+     *
+     * @param chunks - how many chunks to produce
+     * @throw cassert ensuring this SharedRandomPool created the pool
+     */
+    void produce(std::size_t chunks)
+    {
+        assert(producer != nullptr);
+        for(std::size_t i = 0; i < chunks; i++)
+        {
+            uint64_t chunk = header->produced;
+            SlotSequence &sequence = sequences[chunk % header->slots];
+            while(sequence.value.load(std::memory_order_acquire) != chunk)
+            {
+                std::this_thread::yield();
+            }
+            producer->fillUint64(slotData(chunk), header->chunkWords);
+            sequence.value.store(chunk + 1, std::memory_order_release);
+            header->produced = chunk + 1;
+        }
+    }
+
+    /**
+     * @brief Claims the next chunk, waiting for the producer if it isn't ready yet
+     * @return the chunk, which must be destroyed before the producer can reuse its slot
+     */
+    Chunk acquire()
+    {
+        uint64_t chunk = header->cursor.fetch_add(1, std::memory_order_relaxed);
+        SlotSequence &sequence = sequences[chunk % header->slots];
+        while(sequence.value.load(std::memory_order_acquire) != chunk + 1)
+        {
+            std::this_thread::yield();
+        }
+        return Chunk(this, chunk, slotData(chunk));
+    }
+
+    /**
+     * @brief Returns the seed of the pool's stream
+     * @return the seed the producer was created with
+     */
+    const std::array<uint64_t, 16> &seed() const
+    {
+        return header->seed;
+    }
+
+    /**
+     * @brief Returns where in the stream chunk 0 starts
+     * @return the number of words of the seed's stream before chunk 0
+     */
+    uint64_t offset() const
+    {
+        return header->offset;
+    }
+
+    /**
+     * @brief Returns the number of words in each chunk
+     * @return the chunk size the producer was created with
+     */
+    std::size_t chunkWords() const
+    {
+        return static_cast<std::size_t>(header->chunkWords);
+    }
+
+    /**
+     * @brief Returns the position in the seed's stream of a chunk's first word
+     * @param index - the chunk's index, as returned by Chunk::index()
+     * @return where to start streamAt(seed(), ...) to reproduce the chunk
+     */
+    uint64_t chunkPosition(uint64_t index) const
+    {
+        return header->offset + index * header->chunkWords;
+    }
+
+private:
+    struct Header
+    {
+        char magic[8];
+        std::array<uint64_t, 16> seed;
+        uint64_t offset;
+        uint64_t chunkWords;
+        uint64_t slots;
+        // Written by the producer alone
+        uint64_t produced;
+        alignas(64) std::atomic<uint64_t> cursor;
+    };
+
+    // Slot n % slots holds n while it waits for chunk n, n + 1 once chunk n is ready to read
+    struct alignas(64) SlotSequence
+    {
+        std::atomic<uint64_t> value;
+    };
+
+    static const char *magic()
+    {
+        return "PRNGPOOL";
+    }
+
+    void *mapped;
+    std::size_t mappedBytes;
+    Header *header;
+    SlotSequence *sequences;
+    uint64_t *data;
+    // Only set in the producer
+    std::unique_ptr<PRNG> producer;
+
+    static std::size_t sequencesOffset()
+    {
+        return (sizeof(Header) + 63) / 64 * 64;
+    }
+
+    static std::size_t dataOffset(std::size_t slots)
+    {
+        // Start the words on a page so chunks never share one with the bookkeeping
+        return (sequencesOffset() + slots * sizeof(SlotSequence) + 4095) / 4096 * 4096;
+    }
+
+    static std::size_t layoutBytes(std::size_t chunkWords, std::size_t slots)
+    {
+        // Whole 2MB pages, so the file can live on hugetlbfs
+        const std::size_t hugePage = 2 << 20;
+        std::size_t bytes = dataOffset(slots) + chunkWords * slots * sizeof(uint64_t);
+        return (bytes + hugePage - 1) / hugePage * hugePage;
+    }
+
+    void map(int file, const std::string &path)
+    {
+        mapped = ::mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        int error = errno;
+        ::close(file);
+        if(mapped == MAP_FAILED)
+        {
+            mapped = nullptr;
+            throw std::system_error(error, std::generic_category(), "can't map " + path);
+        }
+#ifdef MADV_HUGEPAGE
+        ::madvise(mapped, mappedBytes, MADV_HUGEPAGE);
+#endif
+        header = static_cast<Header *>(mapped);
+        sequences = reinterpret_cast<SlotSequence *>(static_cast<char *>(mapped) + sequencesOffset());
+    }
+
+    uint64_t *slotsStart() const
+    {
+        return reinterpret_cast<uint64_t *>(static_cast<char *>(mapped) + dataOffset(static_cast<std::size_t>(header->slots)));
+    }
+
+    uint64_t *slotData(uint64_t chunk) const
+    {
+        return data + (chunk % header->slots) * header->chunkWords;
+    }
+
+    void release(uint64_t chunk)
+    {
+        sequences[chunk % header->slots].value.store(chunk + header->slots, std::memory_order_release);
+    }
+
+    SharedRandomPool(const SharedRandomPool &) = delete;
+    SharedRandomPool &operator=(const SharedRandomPool &) = delete;
+};
+#endif
+
+#endif // SHAREDPOOL_H
@@ -0,0 +1,270 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef STOCHASTICROUNDING_H
+#define STOCHASTICROUNDING_H
+
+#include "PRNG.h"
+#include "Dispatch.h"
+#include "FastMath.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief A bfloat16, the top half of a float: 8 exponent bits and 7 mantissa bits.
+ */
+struct BFloat16
+{
+    uint16_t bits;
+};
+
+/**
+ * @brief An IEEE 754 half precision float: 5 exponent bits and 10 mantissa bits.
+ */
+struct Half
+{
+    uint16_t bits;
+};
+
+/**
+ * @brief Converts a bfloat16 to a float, which is exact
+ * @param value - the bfloat16 to convert
+ * @return the same number as a float
+ */
+inline float toFloat(BFloat16 value)
+{
+    return fastmath::fromBits<float>(static_cast<uint32_t>(value.bits) << 16);
+}
+
+/**
+ * @brief Converts a half to a float, which is exact
+ * @param value - the half to convert
+ * @return the same number as a float
+ */
+inline float toFloat(Half value)
+{
+    uint32_t sign = static_cast<uint32_t>(value.bits & 0x8000) << 16;
+    uint32_t exponent = (value.bits >> 10) & 0x1f;
+    uint32_t mantissa = value.bits & 0x3ff;
+    if(exponent == 0)
+    {
+        // Subnormal, in units of 2^-24
+        float magnitude = static_cast<float>(mantissa) * 5.9604644775390625e-8f;
+        return fastmath::fromBits<float>(fastmath::toBits(magnitude) | sign);
+    }
+    uint32_t floatExponent = exponent == 0x1f ? 0xff : exponent + 127 - 15;
+    return fastmath::fromBits<float>(sign | floatExponent << 23 | mantissa << 13);
+}
+
+namespace prng_detail
+{
+
+// Words generated per pass of the rounding kernels, each rounding four elements
+const std::size_t roundingWords = 256;
+
+// Splits words into the 16 random bits of each element, four elements taking a word from its bottom up
+inline void unpackRoundingBits(const uint64_t *words, std::size_t count, uint16_t *random)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for(std::size_t i = 0; i < count; i++)
+    {
+        random[i] = static_cast<uint16_t>(words[i / 4] >> 16 * (i % 4));
+    }
+#else
+    std::memcpy(random, words, count * sizeof(uint16_t));
+#endif
+}
+
+/*
+ * Adding a uniform random number below the last bit kept and then truncating rounds up with
+ * probability equal to the fraction dropped. For bfloat16 that's an integer add on the float's
+ * bits, with any carry running on into the exponent as it should.
+ */
+template <class T>
+PRNG_ALWAYS_INLINE inline void roundBFloat16Kernel(const uint16_t *random, const float *input, T *output, std::size_t count)
+{
+    for(std::size_t i = 0; i < count; i++)
+    {
+        uint32_t bits = fastmath::toBits(input[i]);
+        uint32_t rounded = (bits + random[i]) >> 16;
+        // A NaN with its payload only in the dropped bits would turn into infinity, so quieten it
+        uint32_t nan = 0 - static_cast<uint32_t>((bits & 0x7fffffffU) > 0x7f800000U);
+        output[i].bits = static_cast<uint16_t>((rounded & ~nan) | (((bits >> 16) | 0x0040) & nan));
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(roundBFloat16, roundBFloat16Kernel)
+
+/*
+ * For normal halves the exponent is rebiased and 13 of the random bits added below the 10
+ * mantissa bits kept. Halves below 2^-14 are multiples of 2^-24, so there the mantissa is shifted
+ * to that unit with 16 fraction bits, all of which are rounded. Both are worked out for every
+ * element, in integers, so the loop has no branches or float compares for GCC to keep.
+ */
+template <class T>
+PRNG_ALWAYS_INLINE inline void roundHalfKernel(const uint16_t *random, const float *input, T *output, std::size_t count)
+{
+    const uint32_t smallestNormal = 0x38800000U;  // 2^-14
+    const uint32_t overflow = 0x47800000U;        // 2^16, past which everything rounds to infinity
+    for(std::size_t i = 0; i < count; i++)
+    {
+        uint32_t bits = fastmath::toBits(input[i]);
+        uint32_t magnitude = bits & 0x7fffffffU;
+        uint32_t bitsToAdd = random[i];
+
+        uint32_t normal = (magnitude - 0x38000000U + (bitsToAdd >> 3)) >> 13;
+        // magnitude * 2^40 is the mantissa shifted by 110 - exponent
+        uint32_t shift = 112 - (magnitude >> 23);
+        shift = shift < 31 ? shift : 31;
+        uint32_t fixed = ((magnitude & 0x7fffffU) | 0x800000U) << 2 >> shift;
+        uint32_t subnormal = (fixed + bitsToAdd) >> 16;
+
+        // Masks rather than ?:, which GCC narrows to 16 bits and then can't vectorize without AVX-512BW
+        uint32_t small = 0 - static_cast<uint32_t>(magnitude < smallestNormal);
+        uint32_t finite = 0 - static_cast<uint32_t>(magnitude < overflow);
+        uint32_t nan = 0 - static_cast<uint32_t>(magnitude > 0x7f800000U);
+        uint32_t rounded = (((subnormal & small) | (normal & ~small)) & finite) | (0x7c00 & ~finite) | (0x0200 & nan);
+        output[i].bits = static_cast<uint16_t>((bits >> 16 & 0x8000) | rounded);
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(roundHalf, roundHalfKernel)
+
+/*
+ * The scaled value is put in fixed point with 16 fraction bits straight from its mantissa and
+ * exponent, floored, clamped to the int8 range, then rounded with integer adds. Offsetting by 128
+ * keeps the shift on unsigned values. As with halves there are no float compares, which GCC
+ * won't turn into selects.
+ */
+template <class T>
+PRNG_ALWAYS_INLINE inline void roundInt8Kernel(const uint16_t *random, const float *input, T *output, std::size_t count,
+                                               float scale)
+{
+    const uint32_t outOfRange = 0x43000000U;  // 128
+    for(std::size_t i = 0; i < count; i++)
+    {
+        uint32_t bits = fastmath::toBits(input[i] * scale);
+        uint32_t magnitude = bits & 0x7fffffffU;
+        uint32_t negative = 0 - (bits >> 31);
+
+        // magnitude * 2^16 is the mantissa shifted by 134 - exponent
+        uint32_t shift = 134 - (magnitude >> 23);
+        shift = shift < 31 ? shift : 31;
+        // Zeros and subnormals have no implicit bit, without which -0.0 would floor to -2^-16
+        uint32_t implicit = 0x800000U & (0 - static_cast<uint32_t>(magnitude > 0x7fffffU));
+        // Rounding the magnitude up for negatives floors the value
+        uint32_t mantissa = ((magnitude & 0x7fffffU) | implicit) + (negative & ((1U << shift) - 1));
+        int32_t fixed = static_cast<int32_t>(mantissa >> shift);
+        fixed = magnitude < outOfRange ? fixed : 128 << 16;
+        fixed = magnitude > 0x7f800000U ? 0 : fixed;
+        fixed = (fixed ^ static_cast<int32_t>(negative)) - static_cast<int32_t>(negative);
+        fixed = fixed < (127 << 16) ? fixed : 127 << 16;
+
+        uint32_t offset = static_cast<uint32_t>(fixed + (128 << 16));
+        output[i] = static_cast<T>(static_cast<int32_t>((offset + random[i]) >> 16) - 128);
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(roundInt8, roundInt8Kernel)
+
+template <class T, class Round>
+inline void stochasticRound(PRNG &rng, const float *input, T *output, std::size_t count, Round round)
+{
+    uint64_t words[roundingWords];
+    uint16_t random[4 * roundingWords];
+    while(count > 0)
+    {
+        std::size_t elements = count < 4 * roundingWords ? count : 4 * roundingWords;
+        rng.fillUint64(words, (elements + 3) / 4);
+        unpackRoundingBits(words, elements, random);
+        round(static_cast<const uint16_t *>(random), input, output, elements);
+        input += elements;
+        output += elements;
+        count -= elements;
+    }
+}
+
+}
+
+/**
+ * @brief Rounds floats to bfloat16 stochastically, up with probability equal to the fraction of the last place dropped
+ *
+ * Unlike rounding to nearest, the result is the input on average, so small updates accumulated
+ * in low precision don't vanish. Each element takes 16 bits of a word, so a call draws
+ * (count + 3) / 4 words and the results for a seed are the same however the array is split
+ * into calls, as long as each call but the last rounds a multiple of 4 elements.
+ *
+ * Infinities and NaNs are kept, and values that round past the largest bfloat16 become infinity.
+ *
+ * @param rng - the generator to draw from
+ * @param input - the count floats to round
+ * @param output - where count bfloat16s are written
+ * @param count - how many elements to round
+ */
+inline void stochasticRound(PRNG &rng, const float *input, BFloat16 *output, std::size_t count)
+{
+    prng_detail::stochasticRound(rng, input, output, count, [](const uint16_t *random, const float *in, BFloat16 *out,
+                                                               std::size_t elements) {
+        prng_detail::roundBFloat16(random, in, out, elements);
+    });
+}
+
+/**
+ * @brief Rounds floats to half precision stochastically, up with probability equal to the fraction of the last place dropped
+ *
+ * This is exact to 1/8192 of a place for normal halves and to 1/65536 of a place for subnormals.
+ * Like the bfloat16 version it draws (count + 3) / 4 words, keeps infinities and NaNs and
+ * rounds past the largest half, 65504, to infinity.
+ *
+ * @param rng - the generator to draw from
+ * @param input - the count floats to round
+ * @param output - where count halves are written
+ * @param count - how many elements to round
+ */
+inline void stochasticRound(PRNG &rng, const float *input, Half *output, std::size_t count)
+{
+    prng_detail::stochasticRound(rng, input, output, count, [](const uint16_t *random, const float *in, Half *out,
+                                                               std::size_t elements) {
+        prng_detail::roundHalf(random, in, out, elements);
+    });
+}
+
+/**
+ * @brief Scales floats and rounds them to int8 stochastically, up with probability equal to the fraction dropped
+ *
+ * Values that scale outside [-128, 127] are clamped to it and NaNs become 0. Like the other
+ * versions it draws (count + 3) / 4 words.
+ *
+ * @param rng - the generator to draw from
+ * @param input - the count floats to round
+ * @param output - where count int8s are written
+ * @param count - how many elements to round
+ * @param scale - what each element is multiplied by first, e.g. 127 / the largest magnitude
+ */
+inline void stochasticRound(PRNG &rng, const float *input, int8_t *output, std::size_t count, float scale = 1)
+{
+    prng_detail::stochasticRound(rng, input, output, count, [scale](const uint16_t *random, const float *in, int8_t *out,
+                                                                    std::size_t elements) {
+        prng_detail::roundInt8(random, in, out, elements, scale);
+    });
+}
+
+#endif // STOCHASTICROUNDING_H
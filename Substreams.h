@@ -0,0 +1,371 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef SUBSTREAMS_H
+#define SUBSTREAMS_H
+
+#include "PRNG.h"
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <thread>
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace prng_detail
+{
+
+typedef std::array<uint64_t, 16> JumpPolynomial;
+
+// The characteristic polynomial of xorshift1024 without its x^1024 term, found by Berlekamp-Massey
+const JumpPolynomial xorshift1024Polynomial = {{
+    0x1000000000000001ULL, 0x2200aa001400f000ULL, 0x0111e1c02bc18180ULL, 0x030d535201556130ULL,
+    0x4a32d044029b08f7ULL, 0x34b3216457d7b028ULL, 0xe860f083d70158c6ULL, 0xdf6a7cadba32bca9ULL,
+    0xbabab341e2554b59ULL, 0xcd40a7e2537771eaULL, 0x0040f0e46e848800ULL, 0xa1422cb7814f5c68ULL,
+    0x53116c08605c805fULL, 0x0440024003007b28ULL, 0x787878786d381540ULL, 0x0000000000007879ULL}};
+
+// a * b modulo the characteristic polynomial, so the jumps they stand for add up
+inline JumpPolynomial multiplyJumps(const JumpPolynomial &a, JumpPolynomial b)
+{
+    JumpPolynomial product = {};
+    for(uint64_t word : a)
+    {
+        for(int bit = 0; bit < 64; bit++)
+        {
+            if(word & (uint64_t(1) << bit))
+            {
+                for(std::size_t i = 0; i < 16; i++)
+                {
+                    product[i] ^= b[i];
+                }
+            }
+            // b *= x, reducing the x^1024 that falls off the top
+            uint64_t overflow = 0 - (b[15] >> 63);
+            for(std::size_t i = 15; i > 0; i--)
+            {
+                b[i] = b[i] << 1 | b[i - 1] >> 63;
+            }
+            b[0] <<= 1;
+            for(std::size_t i = 0; i < 16; i++)
+            {
+                b[i] ^= xorshift1024Polynomial[i] & overflow;
+            }
+        }
+    }
+    return product;
+}
+
+// Bits of each id in a StreamId, and the log2 of the steps each worker's stream is given
+const int streamIdBits = 32;
+const int streamLengthBits = 512;
+
+// x^(2^k) for k from streamLengthBits, one for each bit of the three ids, built once by squaring
+inline const std::array<JumpPolynomial, 3 * streamIdBits> &streamJumps()
+{
+    static const std::array<JumpPolynomial, 3 * streamIdBits> jumps = []() {
+        std::array<JumpPolynomial, 3 * streamIdBits> powers;
+        powers[0] = PRNG::jumpPolynomial();
+        for(std::size_t i = 1; i < powers.size(); i++)
+        {
+            powers[i] = multiplyJumps(powers[i - 1], powers[i - 1]);
+        }
+        return powers;
+    }();
+    return jumps;
+}
+
+}
+
+/**
+ * @brief Identifies one process's stream among the runs of a seeded job.
+ *
+ * Each level is a 32 bit id. The stream for (job, node, worker) starts
+ * ((job * 2^32 + node) * 2^32 + worker) * 2^512 steps after the seed, so every stream has 2^512
+ * steps to itself and no two can overlap. Stream (0, 0, 0) is the seed itself.
+ */
+struct StreamId
+{
+    uint32_t job;
+    uint32_t node;
+    uint32_t worker;
+};
+
+/**
+ * @brief Returns the generator for one stream of a seed
+ *
+ * Rather than stepping through the streams before it, this multiplies together a precomputed jump
+ * polynomial for each set bit of the ids and applies the product with a single jump. That's a
+ * fraction of a millisecond for small ids and a few milliseconds with every bit set, plus a few
+ * more the first time to build the polynomials.
+ *
+ * The same seed and id always give the same stream, on any machine, so the processes of a job can
+ * derive their generators without talking to each other.
+ *
+ * Calling jump() on a stream's generator moves it to the next worker's stream.
+ *
+ * @param seed - the seed shared by the whole job
+ * @param id - which stream to derive
+ * @return a PRNG positioned at the start of the stream
+ */
+inline PRNG substream(const std::array<uint64_t, 16> &seed, const StreamId &id)
+{
+    const std::array<prng_detail::JumpPolynomial, 3 * prng_detail::streamIdBits> &jumps = prng_detail::streamJumps();
+    const uint32_t levels[3] = {id.worker, id.node, id.job};
+    prng_detail::JumpPolynomial polynomial = {{1}};
+    for(int level = 0; level < 3; level++)
+    {
+        for(int bit = 0; bit < prng_detail::streamIdBits; bit++)
+        {
+            if(levels[level] & (uint32_t(1) << bit))
+            {
+                polynomial = prng_detail::multiplyJumps(polynomial, jumps[level * prng_detail::streamIdBits + bit]);
+            }
+        }
+    }
+    PRNG rng(seed);
+    rng.jump(polynomial);
+    return rng;
+}
+
+/**
+ * @brief Returns a generator positioned at any word of a seed's stream, in time logarithmic in the position
+ * @param seed - the seed the stream starts from
+ * @param position - how many words of the stream to skip
+ * @return a PRNG that gives the same numbers as PRNG(seed) after position draws
+ */
+inline PRNG streamAt(const std::array<uint64_t, 16> &seed, uint64_t position)
+{
+    // x^position by square and multiply, starting from x
+    prng_detail::JumpPolynomial power = {{2}};
+    prng_detail::JumpPolynomial polynomial = {{1}};
+    for(; position != 0; position >>= 1)
+    {
+        if(position & 1)
+        {
+            polynomial = prng_detail::multiplyJumps(polynomial, power);
+        }
+        power = prng_detail::multiplyJumps(power, power);
+    }
+    PRNG rng(seed);
+    rng.jump(polynomial);
+    return rng;
+}
+
+#ifdef __unix__
+/**
+ * @brief Hands out worker ids, and a shared seed, to the processes of a job on one machine.
+ *
+ * The first process to construct a coordinator with a given name creates a small POSIX shared
+ * memory segment holding the seed and a counter; later ones attach to it. claim() then gives
+ * each caller the next worker id, so processes can start in any order and in any number without
+ * a seeding round trip, and still get streams that can't overlap.
+ *
+ * This stands in for a cluster wide service. On several machines run one coordinator per machine
+ * and give each its own node id.
+ */
+class StreamCoordinator
+{
+public:
+    /**
+     * @brief Creates or attaches to the coordinator called name, with a seed from std::random_device if it's new
+     * @param name - the shared memory name, e.g. "/my-job"
+     * @param job - the job id of the streams claimed
+     * @param node - the node id of the streams claimed
+     * @throw std::system_error if the shared memory can't be created or opened
+     */
+    StreamCoordinator(const std::string &name, uint32_t job, uint32_t node = 0)
+        : StreamCoordinator(name, PRNG().getState(), false, job, node) {}
+
+    /**
+     * @brief Creates or attaches to the coordinator called name, with a set seed
+     * @param name - the shared memory name, e.g. "/my-job"
+     * @param seed - the seed of the job, which must match the coordinator's if it already exists
+     * @param job - the job id of the streams claimed
+     * @param node - the node id of the streams claimed
+     * @throw std::system_error if the shared memory can't be created or opened, or has a different seed
+     */
+    StreamCoordinator(const std::string &name, const std::array<uint64_t, 16> &seed, uint32_t job, uint32_t node = 0)
+        : StreamCoordinator(name, seed, true, job, node) {}
+
+    ~StreamCoordinator()
+    {
+        ::munmap(block, sizeof(Block));
+    }
+
+    /**
+     * @brief Claims the next unused worker id
+     * @throw cassert ensuring fewer than 2^32 ids have been claimed
+     * @return this process's StreamId
+     */
+    StreamId claim()
+    {
+        uint64_t worker = block->nextWorker.fetch_add(1, std::memory_order_relaxed);
+        assert(worker <= UINT32_MAX);
+        return StreamId{job, node, static_cast<uint32_t>(worker)};
+    }
+
+    /**
+     * @brief Claims the next unused worker id and returns its stream
+     * @return a PRNG positioned at the start of a stream no other claim will get
+     */
+    PRNG claimStream()
+    {
+        return substream(seed(), claim());
+    }
+
+    /**
+     * @brief Returns the seed of the job, to log so the run can be reproduced
+     * @return the seed the first process created the coordinator with
+     */
+    const std::array<uint64_t, 16> &seed() const
+    {
+        return block->seed;
+    }
+
+    /**
+     * @brief Removes the coordinator's shared memory, so the next one created starts again from worker 0
+     *
+     * Processes already attached keep working.
+     *
+     * @param name - the shared memory name
+     */
+    static void remove(const std::string &name)
+    {
+        ::shm_unlink(name.c_str());
+    }
+
+private:
+    struct Block
+    {
+        std::atomic<uint64_t> ready;
+        std::atomic<uint64_t> nextWorker;
+        std::array<uint64_t, 16> seed;
+    };
+
+    static const uint64_t readyValue = 0x50524e4753545231ULL;
+
+    Block *block;
+    uint32_t job;
+    uint32_t node;
+
+    StreamCoordinator(const std::string &name, const std::array<uint64_t, 16> &seed, bool checkSeed, uint32_t job,
+                      uint32_t node)
+        : block(nullptr), job(job), node(node)
+    {
+        int file = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        bool created = file >= 0;
+        if(!created)
+        {
+            if(errno != EEXIST)
+            {
+                throw std::system_error(errno, std::generic_category(), "can't create " + name);
+            }
+            file = ::shm_open(name.c_str(), O_RDWR, 0600);
+            if(file < 0)
+            {
+                throw std::system_error(errno, std::generic_category(), "can't open " + name);
+            }
+            waitUntilSized(file, name);
+        }
+        else if(::ftruncate(file, sizeof(Block)) != 0)
+        {
+            int error = errno;
+            ::close(file);
+            // Left behind, it would look to every later process like a creator that never finished
+            ::shm_unlink(name.c_str());
+            throw std::system_error(error, std::generic_category(), "can't size " + name);
+        }
+
+        void *mapped = ::mmap(nullptr, sizeof(Block), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        int error = errno;
+        ::close(file);
+        if(mapped == MAP_FAILED)
+        {
+            if(created)
+            {
+                ::shm_unlink(name.c_str());
+            }
+            throw std::system_error(error, std::generic_category(), "can't map " + name);
+        }
+        block = static_cast<Block *>(mapped);
+
+        if(created)
+        {
+            // The segment starts zeroed, so the counter is already 0
+            block->seed = seed;
+            block->ready.store(readyValue, std::memory_order_release);
+        }
+        else
+        {
+            waitUntilReady(name);
+            if(checkSeed && block->seed != seed)
+            {
+                ::munmap(block, sizeof(Block));
+                throw std::system_error(EINVAL, std::generic_category(), name + " has a different seed");
+            }
+        }
+    }
+
+    // The creator may not have sized or filled in the segment yet
+    static void waitUntilSized(int file, const std::string &name)
+    {
+        for(int attempt = 0; attempt < 1000; attempt++)
+        {
+            struct stat status;
+            if(::fstat(file, &status) == 0 && static_cast<std::size_t>(status.st_size) >= sizeof(Block))
+            {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        ::close(file);
+        throw std::system_error(ETIMEDOUT, std::generic_category(), name + " was never initialised");
+    }
+
+    void waitUntilReady(const std::string &name)
+    {
+        for(int attempt = 0; attempt < 1000; attempt++)
+        {
+            if(block->ready.load(std::memory_order_acquire) == readyValue)
+            {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        ::munmap(block, sizeof(Block));
+        throw std::system_error(ETIMEDOUT, std::generic_category(), name + " was never initialised");
+    }
+
+    StreamCoordinator(const StreamCoordinator &) = delete;
+    StreamCoordinator &operator=(const StreamCoordinator &) = delete;
+};
+#endif
+
+#endif // SUBSTREAMS_H
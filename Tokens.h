@@ -0,0 +1,310 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#ifndef TOKENS_H
+#define TOKENS_H
+
+#include "PRNG.h"
+#include "Dispatch.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * @brief The number of characters uuid4Bulk writes for each UUID
+ */
+const std::size_t uuid4Length = 36;
+
+namespace prng_detail
+{
+
+// Words generated per pass of the token generators
+const std::size_t tokenWords = 64;
+
+// Alphabets made of at most this many runs of consecutive characters are mapped arithmetically
+const std::size_t maxAlphabetRuns = 16;
+
+/*
+ * How randomStrings turns words into symbols. Each 32 bit half of a word is an index into the
+ * size^digits possible strings of that many symbols, and its symbols are read off most significant
+ * first by multiplying by size. Halves whose product with size^digits, modulo 2^32, is below
+ * threshold are rejected, which makes every string exactly equally likely, as in boundedUint64.
+ *
+ * The symbols are then mapped to characters without a table: a run of consecutive characters,
+ * like A-Z, is a constant added to a range of symbols, so an alphabet of a few runs is a few
+ * compares and adds per byte, which vectorise where table lookups don't.
+ */
+struct Alphabet
+{
+    uint32_t size;
+    std::size_t digits;
+    // size^digits modulo 2^32
+    uint32_t strings;
+    uint32_t threshold;
+    std::size_t runCount;
+    // Symbols from runStarts[k] onwards have runOffsets[k] added, on top of those before them
+    unsigned char runStarts[maxAlphabetRuns];
+    unsigned char runOffsets[maxAlphabetRuns];
+    const char *characters;
+
+    explicit Alphabet(const std::string &alphabet)
+        : size(static_cast<uint32_t>(alphabet.size())), digits(0), runCount(0), characters(alphabet.data())
+    {
+        uint64_t power = 1;
+        while(power * size <= uint64_t(1) << 32)
+        {
+            power *= size;
+            digits++;
+        }
+        strings = static_cast<uint32_t>(power);
+        threshold = static_cast<uint32_t>((uint64_t(1) << 32) % power);
+
+        unsigned char added = 0;
+        for(std::size_t symbol = 0; symbol < size; symbol++)
+        {
+            unsigned char character = static_cast<unsigned char>(alphabet[symbol]);
+            if(symbol != 0 && character == static_cast<unsigned char>(alphabet[symbol - 1] + 1))
+            {
+                continue;
+            }
+            if(runCount == maxAlphabetRuns)
+            {
+                runCount++;
+                break;
+            }
+            unsigned char offset = static_cast<unsigned char>(character - symbol);
+            runStarts[runCount] = static_cast<unsigned char>(symbol);
+            runOffsets[runCount] = static_cast<unsigned char>(offset - added);
+            added = offset;
+            runCount++;
+        }
+    }
+
+    bool arithmetic() const
+    {
+        return runCount <= maxAlphabetRuns;
+    }
+};
+
+// Splits words into halves, keeping those randomStrings doesn't reject, and returns how many were kept
+inline std::size_t acceptHalves(const uint64_t *words, std::size_t count, const Alphabet &alphabet, uint32_t *halves)
+{
+    std::size_t accepted = 0;
+    for(std::size_t i = 0; i < 2 * count; i++)
+    {
+        uint32_t half = static_cast<uint32_t>(words[i / 2] >> 32 * (i % 2));
+        halves[accepted] = half;
+        accepted += static_cast<uint32_t>(half * alphabet.strings) >= alphabet.threshold;
+    }
+    return accepted;
+}
+
+/*
+ * Reads off the symbols of the halves, digit major so that each pass is a vector multiply. The
+ * characters are independent, so the order they're written in doesn't change the strings'
+ * distribution.
+ */
+template <class T>
+PRNG_ALWAYS_INLINE inline void symbolsKernel(uint32_t *halves, std::size_t count, uint32_t size, std::size_t digits, T *symbols)
+{
+    for(std::size_t digit = 0; digit < digits; digit++)
+    {
+        T *row = symbols + digit * count;
+        for(std::size_t i = 0; i < count; i++)
+        {
+            uint64_t product = static_cast<uint64_t>(halves[i]) * size;
+            row[i] = static_cast<T>(product >> 32);
+            halves[i] = static_cast<uint32_t>(product);
+        }
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(symbols, symbolsKernel)
+
+template <class T>
+PRNG_ALWAYS_INLINE inline void mapRunsKernel(const T *symbols, char *output, std::size_t count, const Alphabet *alphabet)
+{
+    // Copied so the compiler can see the char stores don't change them
+    const std::size_t runCount = alphabet->runCount;
+    T starts[maxAlphabetRuns];
+    T offsets[maxAlphabetRuns];
+    for(std::size_t run = 0; run < runCount; run++)
+    {
+        starts[run] = alphabet->runStarts[run];
+        offsets[run] = alphabet->runOffsets[run];
+    }
+    // One pass per run, each a vector compare and add
+    for(std::size_t i = 0; i < count; i++)
+    {
+        output[i] = static_cast<char>(symbols[i] + offsets[0]);
+    }
+    for(std::size_t run = 1; run < runCount; run++)
+    {
+        const T start = starts[run];
+        const T offset = offsets[run];
+        for(std::size_t i = 0; i < count; i++)
+        {
+            output[i] = static_cast<char>(output[i] + (symbols[i] >= start ? offset : 0));
+        }
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(mapRuns, mapRunsKernel)
+
+// The 8 hex digits of value as characters, one per byte with the first digit in the bottom byte
+PRNG_ALWAYS_INLINE inline uint64_t hexDigits(uint32_t value)
+{
+    // Reverse the nibbles, then spread them out to a byte each
+    value = (value >> 4 & 0x0f0f0f0fU) | (value & 0x0f0f0f0fU) << 4;
+    value = (value >> 8 & 0x00ff00ffU) | (value & 0x00ff00ffU) << 8;
+    uint64_t spread = static_cast<uint32_t>(value >> 16 | value << 16);
+    spread = (spread | spread << 16) & 0x0000ffff0000ffffULL;
+    spread = (spread | spread << 8) & 0x00ff00ff00ff00ffULL;
+    spread = (spread | spread << 4) & 0x0f0f0f0f0f0f0f0fULL;
+    // Adding 6 carries into bit 4 of the bytes from 10 up, which are letters
+    uint64_t letters = ((spread + 0x0606060606060606ULL) >> 4) & 0x0101010101010101ULL;
+    return spread + 0x3030303030303030ULL + letters * ('a' - '0' - 10);
+}
+
+// Writes the first count characters of a hexDigits result
+template <class T>
+PRNG_ALWAYS_INLINE inline void storeDigits(T *output, uint64_t digits, std::size_t count)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for(std::size_t i = 0; i < count; i++)
+    {
+        output[i] = static_cast<T>(digits >> 8 * i);
+    }
+#else
+    // Byte stores that would be merged into these anyway are far slower when they aren't
+    std::memcpy(output, &digits, count);
+#endif
+}
+
+// Each UUID is two words, written as 36 characters of lower case hex and dashes
+template <class T>
+PRNG_ALWAYS_INLINE inline void uuidKernel(const uint64_t *words, T *output, std::size_t count)
+{
+    for(std::size_t i = 0; i < count; i++)
+    {
+        // Version 4 in the 13th digit and the variant 10 in the top bits of the 17th
+        uint64_t high = (words[2 * i] & ~(uint64_t(0xf) << 12)) | uint64_t(4) << 12;
+        // Shifted rather than masked, to keep the better top bits
+        uint64_t low = (words[2 * i + 1] >> 2) | uint64_t(2) << 62;
+        const uint64_t digits[4] = {hexDigits(static_cast<uint32_t>(high >> 32)), hexDigits(static_cast<uint32_t>(high)),
+                                    hexDigits(static_cast<uint32_t>(low >> 32)), hexDigits(static_cast<uint32_t>(low))};
+        T *uuid = output + uuid4Length * i;
+        storeDigits(uuid, digits[0], 8);
+        storeDigits(uuid + 9, digits[1], 4);
+        storeDigits(uuid + 14, digits[1] >> 32, 4);
+        storeDigits(uuid + 19, digits[2], 4);
+        storeDigits(uuid + 24, digits[2] >> 32, 4);
+        storeDigits(uuid + 28, digits[3], 8);
+        uuid[8] = uuid[13] = uuid[18] = uuid[23] = '-';
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(uuid, uuidKernel)
+
+}
+
+/**
+ * @brief Writes random version 4 UUIDs in their usual text form, e.g. 3b241101-e2bb-4255-8caf-4136c566a962
+ *
+ * Each UUID takes two words, of which the 122 bits not fixed by the version and variant are used.
+ * The UUIDs are written back to back with no separator or terminator, so UUID i starts at
+ * output + i * uuid4Length.
+ *
+ * @param rng - the generator to draw from, which should be a ChaChaPRNG if the UUIDs must be unguessable
+ * @param output - where count * uuid4Length characters are written
+ * @param count - how many UUIDs to write
+ */
+template <class Engine>
+void uuid4Bulk(Engine &rng, char *output, std::size_t count)
+{
+    uint64_t words[prng_detail::tokenWords];
+    const std::size_t perPass = prng_detail::tokenWords / 2;
+    while(count > 0)
+    {
+        std::size_t uuids = count < perPass ? count : perPass;
+        rng.fillUint64(words, 2 * uuids);
+        prng_detail::uuid(static_cast<const uint64_t *>(words), output, uuids);
+        output += uuids * uuid4Length;
+        count -= uuids;
+    }
+}
+
+/**
+ * @brief Writes random strings of characters drawn uniformly from an alphabet, such as tokens or request ids
+ *
+ * Each 32 bits of a word make as many characters as they can, e.g. 5 for a 62 character
+ * alphabet or 6 for base32, and a few of those 32 bit values are rejected so that every
+ * character is exactly equally likely. Alphabets made of a few runs of consecutive characters,
+ * like "0123456789abcdef", base32 or base64, are mapped to characters with vector instructions;
+ * others through a table.
+ *
+ * The strings are written back to back with no separator or terminator, so string i starts at
+ * output + i * length.
+ *
+ * @param rng - the generator to draw from, which should be a ChaChaPRNG if the strings must be unguessable
+ * @param alphabet - the characters to choose from
+ * @param length - how many characters are in each string
+ * @param count - how many strings to write
+ * @param output - where count * length characters are written
+ * @throw cassert ensuring the alphabet has 2 to 256 characters
+ */
+template <class Engine>
+void randomStrings(Engine &rng, const std::string &alphabet, std::size_t length, std::size_t count, char *output)
+{
+    assert(alphabet.size() >= 2 && alphabet.size() <= 256);
+    const prng_detail::Alphabet plan(alphabet);
+    uint64_t words[prng_detail::tokenWords];
+    uint32_t halves[2 * prng_detail::tokenWords];
+    unsigned char symbols[2 * prng_detail::tokenWords * 32];
+
+    std::size_t remaining = length * count;
+    while(remaining > 0)
+    {
+        std::size_t wanted = (remaining + 2 * plan.digits - 1) / (2 * plan.digits);
+        std::size_t wordCount = wanted < prng_detail::tokenWords ? wanted : prng_detail::tokenWords;
+        rng.fillUint64(words, wordCount);
+        std::size_t accepted = prng_detail::acceptHalves(words, wordCount, plan, halves);
+        prng_detail::symbols(halves, accepted, plan.size, plan.digits, static_cast<unsigned char *>(symbols));
+
+        std::size_t characters = accepted * plan.digits < remaining ? accepted * plan.digits : remaining;
+        if(plan.arithmetic())
+        {
+            prng_detail::mapRuns(static_cast<const unsigned char *>(symbols), output, characters, &plan);
+        }
+        else
+        {
+            for(std::size_t i = 0; i < characters; i++)
+            {
+                output[i] = plan.characters[symbols[i]];
+            }
+        }
+        output += characters;
+        remaining -= characters;
+    }
+}
+
+#endif // TOKENS_H
@@ -0,0 +1,317 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+#include<PRNG.h>
+#include<Distributions.h>
+#include<PrefetchingPRNG.h>
+#include<PRNGEnsemble.h>
+#include<ChaChaPRNG.h>
+#include<Tokens.h>
+#include<StochasticRounding.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const size_t elements = 1 << 20;
+const int repeats = 20;
+
+// Stops the optimiser throwing away results we never look at
+volatile uint64_t sink;
+
+/*
+ * Runs benchmark repeats times and prints the best time per item.
+ */
+template <class Benchmark>
+void run(const char *name, size_t items, Benchmark benchmark)
+{
+    double best = 1e300;
+    for(int i = 0; i < repeats; i++)
+    {
+        auto start = chrono::steady_clock::now();
+        benchmark();
+        chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    printf("%-40s %8.3f ns/item %10.1f M items/s\n", name, best / items, items * 1e3 / best);
+}
+
+template <class Engine>
+void standardAlgorithms(const char *engineName, Engine &engine)
+{
+    char name[64];
+    vector<uint32_t> data(elements);
+    iota(data.begin(), data.end(), 0);
+
+    snprintf(name, sizeof(name), "std::shuffle (%s)", engineName);
+    run(name, elements, [&]() {
+        shuffle(data.begin(), data.end(), engine);
+        sink = data[0];
+    });
+
+    vector<uint32_t> sampled(elements / 16);
+    snprintf(name, sizeof(name), "std::sample (%s)", engineName);
+    run(name, elements, [&]() {
+        sample(data.begin(), data.end(), sampled.begin(), sampled.size(), engine);
+        sink = sampled[0];
+    });
+
+    snprintf(name, sizeof(name), "uniform_int_distribution (%s)", engineName);
+    run(name, elements, [&]() {
+        uniform_int_distribution<int> dice(1, 6);
+        uint64_t total = 0;
+        for(size_t i = 0; i < elements; i++)
+        {
+            total += dice(engine);
+        }
+        sink = total;
+    });
+
+    snprintf(name, sizeof(name), "uniform_real_distribution (%s)", engineName);
+    run(name, elements, [&]() {
+        uniform_real_distribution<double> unit(0.0, 1.0);
+        double total = 0;
+        for(size_t i = 0; i < elements; i++)
+        {
+            total += unit(engine);
+        }
+        sink = static_cast<uint64_t>(total);
+    });
+}
+
+
+/*
+ * Bulk normal fills against calling std::normal_distribution once per value.
+ */
+template <class T>
+void normals(const char *typeName)
+{
+    char name[64];
+    PRNG rng;
+    vector<T> output(elements);
+
+    snprintf(name, sizeof(name), "fillNormal (%s)", typeName);
+    run(name, elements, [&]() {
+        fillNormal(rng, output.data(), output.size());
+        sink = static_cast<uint64_t>(output[0]);
+    });
+
+    snprintf(name, sizeof(name), "fillLogNormal (%s)", typeName);
+    run(name, elements, [&]() {
+        fillLogNormal(rng, output.data(), output.size());
+        sink = static_cast<uint64_t>(output[0]);
+    });
+
+    snprintf(name, sizeof(name), "std::normal_distribution (%s)", typeName);
+    run(name, elements, [&]() {
+        normal_distribution<T> normal;
+        for(T &value : output)
+        {
+            value = normal(rng);
+        }
+        sink = static_cast<uint64_t>(output[0]);
+    });
+}
+
+
+/*
+ * Bulk bytes, UUIDs and tokens against building them a byte or a character per draw.
+ */
+void tokens()
+{
+    PRNG rng;
+    const size_t items = elements / 16;
+    const string alphanumeric = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+    vector<char> output(items * uuid4Length);
+
+    run("fillBytes (16 bytes)", items, [&]() {
+        rng.fillBytes(output.data(), items * 16);
+        sink = static_cast<uint64_t>(output[0]);
+    });
+    run("getRandomUnsignedChar() (16 bytes)", items, [&]() {
+        for(size_t i = 0; i < items * 16; i++)
+        {
+            output[i] = static_cast<char>(rng.getRandomUnsignedChar());
+        }
+        sink = static_cast<uint64_t>(output[0]);
+    });
+    run("uuid4Bulk", items, [&]() {
+        uuid4Bulk(rng, output.data(), items);
+        sink = static_cast<uint64_t>(output[0]);
+    });
+    run("randomStrings (22 alphanumerics)", items, [&]() {
+        randomStrings(rng, alphanumeric, 22, items, output.data());
+        sink = static_cast<uint64_t>(output[0]);
+    });
+    run("getRandomUnsignedChar(61) (22 alphanumerics)", items, [&]() {
+        for(size_t i = 0; i < items * 22; i++)
+        {
+            output[i] = alphanumeric[rng.getRandomUnsignedChar(61)];
+        }
+        sink = static_cast<uint64_t>(output[0]);
+    });
+}
+
+/*
+ * Stochastic rounding of a float array, against a getRandomFloat() draw per element.
+ */
+void rounding()
+{
+    PRNG rng;
+    vector<float> input(elements);
+    for(float &value : input)
+    {
+        value = rng.getRandomFloat(-100, 100);
+    }
+    vector<BFloat16> bfloats(elements);
+    vector<Half> halves(elements);
+    vector<int8_t> integers(elements);
+
+    run("stochasticRound (bfloat16)", elements, [&]() {
+        stochasticRound(rng, input.data(), bfloats.data(), elements);
+        sink = bfloats[0].bits;
+    });
+    run("stochasticRound (half)", elements, [&]() {
+        stochasticRound(rng, input.data(), halves.data(), elements);
+        sink = halves[0].bits;
+    });
+    run("stochasticRound (int8)", elements, [&]() {
+        stochasticRound(rng, input.data(), integers.data(), elements, 1.27f);
+        sink = static_cast<uint64_t>(integers[0]);
+    });
+    run("floor(x + getRandomFloat()) (int8)", elements, [&]() {
+        for(size_t i = 0; i < elements; i++)
+        {
+            integers[i] = static_cast<int8_t>(floor(input[i] * 1.27f + rng.getRandomFloat()));
+        }
+        sink = static_cast<uint64_t>(integers[0]);
+    });
+}
+
+}
+
+int main()
+{
+    printf("Kernels dispatched to %s\n", prng_dispatch::levelName(prng_dispatch::activeLevel()));
+    PRNG rng;
+    mt19937_64 mersenneTwister(random_device{}());
+
+    standardAlgorithms("PRNG", rng);
+    standardAlgorithms("mt19937_64", mersenneTwister);
+    run("PRNG::shared().getRandomUint64()", elements, []() {
+        uint64_t total = 0;
+        for(size_t i = 0; i < elements; i++)
+        {
+            total += PRNG::shared().getRandomUint64();
+        }
+        sink = total;
+    });
+    PrefetchingPRNG prefetching;
+    run("PrefetchingPRNG::getRandomUint64(9)", elements, [&]() {
+        uint64_t total = 0;
+        for(size_t i = 0; i < elements; i++)
+        {
+            total += prefetching.getRandomUint64(9);
+        }
+        sink = total;
+    });
+    run("PRNG::getRandomUint64(9)", elements, [&]() {
+        uint64_t total = 0;
+        for(size_t i = 0; i < elements; i++)
+        {
+            total += rng.getRandomUint64(9);
+        }
+        sink = total;
+    });
+    PRNGEnsemble ensemble(elements, 1);
+    vector<uint64_t> words(elements);
+    run("PRNGEnsemble::stepAll", elements, [&]() {
+        ensemble.stepAll(words.data());
+        sink = words[0];
+    });
+    ChaCha8PRNG chacha8;
+    run("ChaCha8PRNG::fillUint64", elements, [&]() {
+        chacha8.fillUint64(words.data(), words.size());
+        sink = words[0];
+    });
+    ChaCha20PRNG chacha20;
+    run("ChaCha20PRNG::fillUint64", elements, [&]() {
+        chacha20.fillUint64(words.data(), words.size());
+        sink = words[0];
+    });
+    run("ChaCha20PRNG::getRandomUint64(9)", elements, [&]() {
+        uint64_t total = 0;
+        for(size_t i = 0; i < elements; i++)
+        {
+            total += chacha20.getRandomUint64(9);
+        }
+        sink = total;
+    });
+#ifdef __SIZEOF_INT128__
+    const PRNG::uint128 wide = static_cast<PRNG::uint128>(3) << 100;
+    run("PRNG::getRandomUint128(3 * 2^100)", elements, [&]() {
+        PRNG::uint128 total = 0;
+        for(size_t i = 0; i < elements; i++)
+        {
+            total += rng.getRandomUint128(wide);
+        }
+        sink = static_cast<uint64_t>(total);
+    });
+    vector<PRNG::uint128> wideWords(elements);
+    run("PRNG::fillUint128", elements, [&]() {
+        rng.fillUint128(wideWords.data(), elements);
+        sink = static_cast<uint64_t>(wideWords[0]);
+    });
+#endif
+    vector<double> doubles(elements);
+    run("PRNG::getRandomDouble(-1, 1)", elements, [&]() {
+        for(size_t i = 0; i < elements; i++)
+        {
+            doubles[i] = rng.getRandomDouble(-1, 1);
+        }
+        sink = static_cast<uint64_t>(doubles[0]);
+    });
+    FloatRange<double> range(-1, 1);
+    run("FloatRange<double>(-1, 1)", elements, [&]() {
+        for(size_t i = 0; i < elements; i++)
+        {
+            doubles[i] = range(rng);
+        }
+        sink = static_cast<uint64_t>(doubles[0]);
+    });
+    run("FloatRange<double>::fill", elements, [&]() {
+        range.fill(rng, doubles.data(), elements);
+        sink = static_cast<uint64_t>(doubles[0]);
+    });
+    normals<float>("float");
+    normals<double>("double");
+    tokens();
+    rounding();
+    return 0;
+}
@@ -0,0 +1,703 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+/*
+ * prng-smoke is a quick statistical battery for catching engine regressions, like a wrong shift
+ * constant, that the unit tests can't see. It's no substitute for PractRand or TestU01 (see
+ * prng-stream), but it runs in the build and needs nothing else:
+ *
+ *     prng-smoke --words 10G --threads 16
+ *
+ * The stream is split into one region per thread, each started with streamAt(), and every test's
+ * counts are summed over the regions. Bytes, popcounts and gaps are counted over every word; the
+ * runs, birthday spacings, matrix rank and linear complexity tests are slower so they only look
+ * at the first --sampled words. Each test gives a chi-square p-value and fails outside
+ * [1e-6, 1 - 1e-6]. The default seed is fixed so that runs are repeatable.
+ *
+ * A wrong shift constant still makes a decent generator, just not this one, so for xorshift1024*
+ * the battery also checks that bit 0 follows exactly the engine's characteristic polynomial.
+ */
+
+#include<PRNG.h>
+#include<ChaChaPRNG.h>
+#include<Dispatch.h>
+#include<Substreams.h>
+#include<prng-tools.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using prng_tools::expandSeed;
+using prng_tools::parseNumber;
+
+namespace {
+
+// Words generated and tested at a time, also the size of one birthday spacings sample
+const size_t blockWords = 4096;
+
+const size_t gapBins = 100;
+const size_t runBins = 40;
+const size_t birthdayBins = 16;
+// Lengths of the bit sequences the linear complexity test finds the complexity of
+const int complexityBits = 1000;
+const size_t complexityWords = (complexityBits + 63) / 64;
+
+struct Options
+{
+    string engine = "xorshift1024";
+    uint64_t seed = 0x5eed;
+    uint64_t words = uint64_t(1) << 30;
+    uint64_t sampled = uint64_t(1) << 26;
+    unsigned int threads = max(1u, thread::hardware_concurrency());
+};
+
+struct Counts
+{
+    array<uint64_t, 256> bytes;
+    array<uint64_t, 65> popcounts;
+    array<uint64_t, gapBins + 1> gaps;
+    array<uint64_t, runBins + 1> runs;
+    array<uint64_t, birthdayBins + 1> birthdays;
+    // Ranks of 32x32 matrices made of the high halves of 32 words, then of bit 0 of 1024 words
+    array<uint64_t, 4> highRanks;
+    array<uint64_t, 4> lowRanks;
+    array<uint64_t, 7> complexities;
+
+    void add(const Counts &other)
+    {
+        addArray(bytes, other.bytes);
+        addArray(popcounts, other.popcounts);
+        addArray(gaps, other.gaps);
+        addArray(runs, other.runs);
+        addArray(birthdays, other.birthdays);
+        addArray(highRanks, other.highRanks);
+        addArray(lowRanks, other.lowRanks);
+        addArray(complexities, other.complexities);
+    }
+
+    template <size_t N>
+    static void addArray(array<uint64_t, N> &to, const array<uint64_t, N> &from)
+    {
+        for(size_t i = 0; i < N; i++)
+        {
+            to[i] += from[i];
+        }
+    }
+};
+
+/*
+ * Byte and popcount histograms of a block. This stays scalar: scattered increments don't
+ * vectorise without AVX-512's conflict detection, which the dispatch levels don't assume, and
+ * even then collisions within a vector cost more than they save. Instead the bytes go to four
+ * tables in turn so consecutive increments rarely hit the same counter, and the dispatch only
+ * buys single instruction popcounts at AVX2 and above.
+ */
+template <class T>
+PRNG_ALWAYS_INLINE inline void countBlockKernel(const uint64_t *words, size_t count, uint32_t (*bytes)[256],
+                                                T *popcounts)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        uint64_t word = words[i];
+        for(int byte = 0; byte < 8; byte += 4)
+        {
+            bytes[0][(word >> (8 * byte)) & 0xff]++;
+            bytes[1][(word >> (8 * byte + 8)) & 0xff]++;
+            bytes[2][(word >> (8 * byte + 16)) & 0xff]++;
+            bytes[3][(word >> (8 * byte + 24)) & 0xff]++;
+        }
+        popcounts[__builtin_popcountll(word)]++;
+    }
+}
+
+PRNG_DISPATCHED_KERNEL(countBlock, countBlockKernel)
+
+// Gaussian elimination without data dependent branches, which random rows would mispredict half the time
+int rank32(array<uint32_t, 32> rows)
+{
+    int rank = 0;
+    for(int column = 31; column >= 0; column--)
+    {
+        uint32_t candidates = 0;
+        for(int row = 0; row < 32; row++)
+        {
+            candidates |= ((rows[row] >> column) & 1) << row;
+        }
+        candidates &= rank == 32 ? 0 : ~0u << rank;
+        if(candidates == 0)
+        {
+            continue;
+        }
+        int pivot = __builtin_ctz(candidates);
+        swap(rows[rank], rows[pivot]);
+        uint32_t pivotRow = rows[rank];
+        for(int row = 0; row < 32; row++)
+        {
+            rows[row] ^= pivotRow & (0 - ((rows[row] >> column) & 1));
+        }
+        rows[rank] = pivotRow;
+        rank++;
+    }
+    return rank;
+}
+
+void countRank(array<uint64_t, 4> &ranks, const array<uint32_t, 32> &rows)
+{
+    ranks[static_cast<size_t>(max(rank32(rows), 29) - 29)]++;
+}
+
+/*
+ * Berlekamp-Massey over bit packed polynomials, for sequences of Bits bits. The sequence is stored
+ * reversed so that each discrepancy is the parity of the connection polynomial ANDed with a
+ * shifted window of it. Returns the linear complexity, and the connection polynomial if asked.
+ */
+template <int Bits>
+int linearComplexity(const uint64_t *bits, uint64_t *connectionOutput = nullptr)
+{
+    const int words = (Bits + 63) / 64 + 1;
+    uint64_t reversed[words + 1] = {};
+    for(int i = 0; i < Bits; i++)
+    {
+        int j = Bits - 1 - i;
+        reversed[j / 64] |= ((bits[i / 64] >> (i % 64)) & 1) << (j % 64);
+    }
+    uint64_t connection[words] = {1};
+    uint64_t previous[words] = {1};
+    int complexity = 0;
+    int shift = 1;
+    for(int n = 0; n < Bits; n++)
+    {
+        // sum over i of c_i s_(n - i), where s_(n - i) is bit Bits - 1 - n + i of reversed
+        int offset = Bits - 1 - n;
+        int wordOffset = offset / 64;
+        int bitOffset = offset % 64;
+        uint64_t discrepancy = 0;
+        for(int w = 0; w <= complexity / 64 && wordOffset + w < words; w++)
+        {
+            uint64_t window = reversed[wordOffset + w] >> bitOffset;
+            if(bitOffset != 0)
+            {
+                window |= reversed[wordOffset + w + 1] << (64 - bitOffset);
+            }
+            discrepancy ^= connection[w] & window;
+        }
+        if(__builtin_parityll(discrepancy) == 0)
+        {
+            shift++;
+            continue;
+        }
+        uint64_t saved[words];
+        memcpy(saved, connection, sizeof(saved));
+        // connection ^= previous << shift
+        int wordShift = shift / 64;
+        int bitShift = shift % 64;
+        for(int w = words - 1; w >= wordShift; w--)
+        {
+            uint64_t shifted = previous[w - wordShift] << bitShift;
+            if(bitShift != 0 && w - wordShift > 0)
+            {
+                shifted |= previous[w - wordShift - 1] >> (64 - bitShift);
+            }
+            connection[w] ^= shifted;
+        }
+        if(2 * complexity <= n)
+        {
+            complexity = n + 1 - complexity;
+            memcpy(previous, saved, sizeof(previous));
+            shift = 1;
+        }
+        else
+        {
+            shift++;
+        }
+    }
+    if(connectionOutput != nullptr)
+    {
+        memcpy(connectionOutput, connection, sizeof(connection));
+    }
+    return complexity;
+}
+
+// NIST SP 800-22's linear complexity statistic, binned into its seven classes
+void countComplexity(array<uint64_t, 7> &complexities, int complexity)
+{
+    const double mean = complexityBits / 2.0 + (9.0 + (complexityBits % 2 == 0 ? -1.0 : 1.0)) / 36.0;
+    double t = (complexityBits % 2 == 0 ? 1.0 : -1.0) * (complexity - mean) + 2.0 / 9.0;
+    size_t bin = t <= -2.5 ? 0 : t <= -1.5 ? 1 : t <= -0.5 ? 2 : t <= 0.5 ? 3 : t <= 1.5 ? 4 : t <= 2.5 ? 5 : 6;
+    complexities[bin]++;
+}
+
+// State carried from block to block by the tests that look across word boundaries
+struct Carry
+{
+    uint64_t position = 0;
+    bool haveEvent = false;
+    uint64_t lastEvent = 0;
+    bool haveRun = false;
+    uint64_t runStart = 0;
+    uint64_t previousWord = 0;
+};
+
+void countGaps(Counts &counts, Carry &carry, const uint64_t *words)
+{
+    for(size_t i = 0; i < blockWords; i++)
+    {
+        // An event is the top four bits being zero, 1 in 16 words
+        if((words[i] >> 60) == 0)
+        {
+            uint64_t index = carry.position + i;
+            if(carry.haveEvent)
+            {
+                counts.gaps[min<uint64_t>(index - carry.lastEvent - 1, gapBins)]++;
+            }
+            carry.haveEvent = true;
+            carry.lastEvent = index;
+        }
+    }
+}
+
+void countRuns(Counts &counts, Carry &carry, const uint64_t *words, bool firstBlock)
+{
+    for(size_t i = 0; i < blockWords; i++)
+    {
+        uint64_t word = words[i];
+        // Bit k of changes is set where bit k differs from the bit before it, read low bit first
+        uint64_t changes = word ^ (word << 1 | carry.previousWord >> 63);
+        if(firstBlock && i == 0)
+        {
+            changes &= ~uint64_t(1);
+        }
+        uint64_t base = (carry.position + i) * 64;
+        while(changes != 0)
+        {
+            uint64_t position = base + static_cast<uint64_t>(__builtin_ctzll(changes));
+            if(carry.haveRun)
+            {
+                counts.runs[min<uint64_t>(position - carry.runStart, runBins) - 1]++;
+            }
+            carry.haveRun = true;
+            carry.runStart = position;
+            changes &= changes - 1;
+        }
+        carry.previousWord = word;
+    }
+}
+
+void countBirthdays(Counts &counts, const uint64_t *words)
+{
+    // 4096 birthdays in a year of 2^32 days, so duplicate spacings are Poisson with mean 4
+    vector<uint32_t> days(blockWords);
+    for(size_t i = 0; i < blockWords; i++)
+    {
+        days[i] = static_cast<uint32_t>(words[i] >> 32);
+    }
+    sort(days.begin(), days.end());
+    vector<uint32_t> spacings(blockWords);
+    spacings[0] = days[0];
+    for(size_t i = 1; i < blockWords; i++)
+    {
+        spacings[i] = days[i] - days[i - 1];
+    }
+    sort(spacings.begin(), spacings.end());
+    size_t duplicates = 0;
+    for(size_t i = 1; i < blockWords; i++)
+    {
+        duplicates += spacings[i] == spacings[i - 1];
+    }
+    counts.birthdays[min(duplicates, birthdayBins)]++;
+}
+
+void countMatrices(Counts &counts, const uint64_t *words)
+{
+    array<uint32_t, 32> rows;
+    for(size_t matrix = 0; matrix < blockWords / 32; matrix++)
+    {
+        for(size_t row = 0; row < 32; row++)
+        {
+            rows[row] = static_cast<uint32_t>(words[matrix * 32 + row] >> 32);
+        }
+        countRank(counts.highRanks, rows);
+    }
+    for(size_t matrix = 0; matrix < blockWords / 1024; matrix++)
+    {
+        for(size_t row = 0; row < 32; row++)
+        {
+            rows[row] = 0;
+            for(size_t column = 0; column < 32; column++)
+            {
+                rows[row] |= static_cast<uint32_t>(words[matrix * 1024 + row * 32 + column] & 1) << column;
+            }
+        }
+        countRank(counts.lowRanks, rows);
+    }
+}
+
+void countComplexities(Counts &counts, const uint64_t *words)
+{
+    // The low two bits are the weakest of xorshift1024*, so test both
+    for(int bit = 0; bit < 2; bit++)
+    {
+        for(size_t start = 0; start + complexityBits <= blockWords; start += complexityBits)
+        {
+            uint64_t bits[complexityWords] = {};
+            for(int i = 0; i < complexityBits; i++)
+            {
+                bits[i / 64] |= ((words[start + static_cast<size_t>(i)] >> bit) & 1) << (i % 64);
+            }
+            countComplexity(counts.complexities, linearComplexity<complexityBits>(bits));
+        }
+    }
+}
+
+// Counts blocks from start to end of the stream, with the slow tests on blocks before sampledEnd
+template <class Engine>
+void countRegion(Engine &rng, uint64_t start, uint64_t end, uint64_t sampledEnd, Counts &counts)
+{
+    vector<uint64_t> words(blockWords);
+    uint32_t bytes[4][256] = {};
+    array<uint64_t, 65> popcounts = {};
+    Carry carry;
+    carry.position = start;
+    for(; carry.position < end; carry.position += blockWords)
+    {
+        rng.fillUint64(words.data(), blockWords);
+        countBlock(words.data(), blockWords, bytes, popcounts.data());
+        for(size_t value = 0; value < 256; value++)
+        {
+            counts.bytes[value] += uint64_t(bytes[0][value]) + bytes[1][value] + bytes[2][value] + bytes[3][value];
+        }
+        memset(bytes, 0, sizeof(bytes));
+        countGaps(counts, carry, words.data());
+        if(carry.position < sampledEnd)
+        {
+            countRuns(counts, carry, words.data(), carry.position == start);
+            countBirthdays(counts, words.data());
+            countMatrices(counts, words.data());
+            countComplexities(counts, words.data());
+        }
+    }
+    Counts::addArray(counts.popcounts, popcounts);
+}
+
+// The regularised upper incomplete gamma function Q(a, x), for chi-square p-values
+double upperGamma(double a, double x)
+{
+    if(x <= 0)
+    {
+        return 1.0;
+    }
+    double logPrefix = a * log(x) - x - lgamma(a);
+    if(x < a + 1)
+    {
+        double term = 1.0 / a;
+        double sum = term;
+        for(int n = 1; n < 10000 && fabs(term) > fabs(sum) * 1e-15; n++)
+        {
+            term *= x / (a + n);
+            sum += term;
+        }
+        return 1.0 - sum * exp(logPrefix);
+    }
+    // Lentz's continued fraction
+    double b = x + 1 - a;
+    double c = 1e300;
+    double d = 1 / b;
+    double h = d;
+    for(int n = 1; n < 10000; n++)
+    {
+        double an = -n * (n - a);
+        b += 2;
+        d = an * d + b;
+        d = fabs(d) < 1e-300 ? 1e-300 : d;
+        c = b + an / c;
+        c = fabs(c) < 1e-300 ? 1e-300 : c;
+        d = 1 / d;
+        double delta = d * c;
+        h *= delta;
+        if(fabs(delta - 1) < 1e-15)
+        {
+            break;
+        }
+    }
+    return exp(logPrefix) * h;
+}
+
+/*
+ * The chi-square p-value of observed counts against bin probabilities. Bins expected to hold
+ * fewer than 20 are pooled with their neighbours so the chi-square approximation holds.
+ */
+double chiSquare(const uint64_t *observed, const double *probabilities, size_t bins, double &statistic)
+{
+    double total = 0;
+    for(size_t i = 0; i < bins; i++)
+    {
+        total += static_cast<double>(observed[i]);
+    }
+    statistic = 0;
+    int pooledBins = 0;
+    double pooledObserved = 0;
+    double pooledExpected = 0;
+    for(size_t i = 0; i < bins; i++)
+    {
+        pooledObserved += static_cast<double>(observed[i]);
+        pooledExpected += probabilities[i] * total;
+        if(pooledExpected >= 20 || i + 1 == bins)
+        {
+            if(pooledExpected > 0)
+            {
+                statistic += (pooledObserved - pooledExpected) * (pooledObserved - pooledExpected) / pooledExpected;
+                pooledBins++;
+            }
+            pooledObserved = 0;
+            pooledExpected = 0;
+        }
+    }
+    if(pooledBins < 2)
+    {
+        return 0.5;
+    }
+    return upperGamma((pooledBins - 1) / 2.0, statistic / 2);
+}
+
+bool report(const char *name, const uint64_t *observed, const vector<double> &probabilities)
+{
+    double statistic;
+    double p = chiSquare(observed, probabilities.data(), probabilities.size(), statistic);
+    bool pass = p >= 1e-6 && p <= 1 - 1e-6;
+    printf("%-28s chi2 %14.2f   p %.6f   %s\n", name, statistic, p, pass ? "pass" : "FAIL");
+    return pass;
+}
+
+vector<double> rankProbabilities()
+{
+    // P(rank r) of a random 32x32 matrix over GF(2), with ranks below 30 pooled
+    vector<double> probabilities(4);
+    for(int rank = 0; rank <= 32; rank++)
+    {
+        double p = pow(2.0, rank * (64.0 - rank) - 1024.0);
+        for(int i = 0; i < rank; i++)
+        {
+            p *= (1 - pow(2.0, i - 32.0)) * (1 - pow(2.0, i - 32.0)) / (1 - pow(2.0, i - rank));
+        }
+        probabilities[static_cast<size_t>(max(rank, 29) - 29)] += p;
+    }
+    return probabilities;
+}
+
+/*
+ * Bit 0 of xorshift1024* is a linear recurrence, the same as its state's, so Berlekamp-Massey on
+ * it must find exactly the generator's characteristic polynomial. No statistical test can tell
+ * a wrong shift constant from the right one, but this always does.
+ */
+bool checkRecurrence(const array<uint64_t, 16> &seed)
+{
+    const int bits = 2304;
+    PRNG rng(seed);
+    uint64_t sequence[bits / 64] = {};
+    for(int i = 0; i < bits; i++)
+    {
+        sequence[i / 64] |= (rng.getRandomUint64() & 1) << (i % 64);
+    }
+    uint64_t connection[bits / 64 + 1];
+    int complexity = linearComplexity<bits>(sequence, connection);
+
+    // The connection polynomial is the characteristic polynomial with its coefficients reversed
+    bool matches = complexity == 1024;
+    for(int i = 0; i <= 1024 && matches; i++)
+    {
+        int k = 1024 - i;
+        uint64_t expected = k == 1024 ? 1 : (prng_detail::xorshift1024Polynomial[k / 64] >> (k % 64)) & 1;
+        matches = ((connection[i / 64] >> (i % 64)) & 1) == expected;
+    }
+    printf("%-28s linear complexity %d%s   %s\n", "recurrence of bit 0", complexity,
+           matches ? ", characteristic polynomial matches" : ", characteristic polynomial differs",
+           matches ? "pass" : "FAIL");
+    return matches;
+}
+
+bool runTests(const Counts &counts)
+{
+    bool pass = true;
+    pass &= report("bytes", counts.bytes.data(), vector<double>(256, 1.0 / 256));
+
+    vector<double> popcounts(65);
+    for(size_t k = 0; k <= 64; k++)
+    {
+        popcounts[k] = exp(lgamma(65.0) - lgamma(k + 1.0) - lgamma(65.0 - k) - 64 * log(2.0));
+    }
+    pass &= report("popcount", counts.popcounts.data(), popcounts);
+
+    vector<double> gaps(gapBins + 1);
+    for(size_t gap = 0; gap < gapBins; gap++)
+    {
+        gaps[gap] = pow(15.0 / 16, static_cast<double>(gap)) / 16;
+    }
+    gaps[gapBins] = pow(15.0 / 16, static_cast<double>(gapBins));
+    pass &= report("gap", counts.gaps.data(), gaps);
+
+    vector<double> runs(runBins);
+    for(size_t length = 1; length < runBins; length++)
+    {
+        runs[length - 1] = pow(0.5, static_cast<double>(length));
+    }
+    runs[runBins - 1] = pow(0.5, static_cast<double>(runBins - 1));
+    pass &= report("runs", counts.runs.data(), runs);
+
+    vector<double> birthdays(birthdayBins + 1);
+    double tail = 1;
+    for(size_t k = 0; k < birthdayBins; k++)
+    {
+        birthdays[k] = exp(-4.0 + k * log(4.0) - lgamma(k + 1.0));
+        tail -= birthdays[k];
+    }
+    birthdays[birthdayBins] = tail;
+    pass &= report("birthday spacings", counts.birthdays.data(), birthdays);
+
+    pass &= report("matrix rank, high bits", counts.highRanks.data(), rankProbabilities());
+    pass &= report("matrix rank, bit 0", counts.lowRanks.data(), rankProbabilities());
+    const vector<double> complexities = {1.0 / 96, 1.0 / 32, 1.0 / 8, 1.0 / 2, 1.0 / 4, 1.0 / 16, 1.0 / 48};
+    pass &= report("linear complexity, bits 0-1", counts.complexities.data(), complexities);
+    return pass;
+}
+
+// Runs each thread's region of the stream. makeAt(position) returns an Engine starting there.
+template <class Engine>
+Counts countStream(const Options &options, const function<Engine(uint64_t)> &makeAt)
+{
+    uint64_t blocks = (options.words + blockWords - 1) / blockWords;
+    uint64_t sampledBlocks = (min(options.sampled, options.words) + blockWords - 1) / blockWords;
+    vector<Counts> counts(options.threads, Counts());
+    vector<thread> threads;
+    for(unsigned int t = 0; t < options.threads; t++)
+    {
+        threads.emplace_back([&, t]() {
+            uint64_t first = blocks * t / options.threads;
+            uint64_t last = blocks * (t + 1) / options.threads;
+            uint64_t sampledFirst = sampledBlocks * t / options.threads;
+            uint64_t sampledLast = sampledBlocks * (t + 1) / options.threads;
+            Engine rng = makeAt(first * blockWords);
+            // The slow tests take the first blocks of every region, so they're spread over the threads
+            countRegion(rng, first * blockWords, last * blockWords,
+                        (first + sampledLast - sampledFirst) * blockWords, counts[t]);
+        });
+    }
+    Counts total = Counts();
+    for(unsigned int t = 0; t < options.threads; t++)
+    {
+        threads[t].join();
+        total.add(counts[t]);
+    }
+    return total;
+}
+
+bool parseOptions(int argc, char **argv, Options &options)
+{
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        string option = argv[i];
+        uint64_t number = 0;
+        if(option == "--engine")
+        {
+            options.engine = argv[i + 1];
+        }
+        else if(!parseNumber(argv[i + 1], number))
+        {
+            return false;
+        }
+        else if(option == "--seed")
+        {
+            options.seed = number;
+        }
+        else if(option == "--words" && number > 0)
+        {
+            options.words = number;
+        }
+        else if(option == "--sampled")
+        {
+            options.sampled = number;
+        }
+        else if(option == "--threads" && number > 0 && number <= 1024)
+        {
+            options.threads = static_cast<unsigned int>(number);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return argc % 2 == 1;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if(!parseOptions(argc, argv, options))
+    {
+        fprintf(stderr,
+                "usage: prng-smoke [--engine xorshift1024|chacha8] [--seed N] [--words N] [--sampled N] [--threads N]\n"
+                "  N takes an optional K, M, G or T suffix\n");
+        return 2;
+    }
+    printf("%s, seed 0x%llx, %llu words, %llu sampled, %u threads, kernels at %s\n", options.engine.c_str(),
+           static_cast<unsigned long long>(options.seed), static_cast<unsigned long long>(options.words),
+           static_cast<unsigned long long>(min(options.sampled, options.words)), options.threads,
+           prng_dispatch::levelName(prng_dispatch::activeLevel()));
+
+    const array<uint64_t, 16> seed = expandSeed(options.seed);
+    auto started = chrono::steady_clock::now();
+    Counts counts;
+    if(options.engine == "xorshift1024")
+    {
+        counts = countStream<PRNG>(options, [&](uint64_t position) { return streamAt(seed, position); });
+    }
+    else if(options.engine == "chacha8")
+    {
+        counts = countStream<ChaCha8PRNG>(options, [&](uint64_t position) {
+            ChaCha8PRNG rng(seed);
+            rng.seek(position / prng_detail::chachaBlockWords);
+            return rng;
+        });
+    }
+    else
+    {
+        fprintf(stderr, "prng-smoke: unknown engine %s\n", options.engine.c_str());
+        return 2;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    printf("generated and counted in %.1f s\n", seconds);
+    bool pass = runTests(counts);
+    if(options.engine == "xorshift1024")
+    {
+        pass &= checkRecurrence(seed);
+    }
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,380 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+/*
+ * prng-stream writes raw generator output, for piping into statistical batteries like PractRand
+ * and TestU01 or for making fixture files:
+ *
+ *     prng-stream --seed 42 | RNG_test stdin64
+ *     prng-stream --engine chacha8 --bits 32 --bytes 4G --output fixture.bin --direct
+ *
+ * Words are generated with the engines' fillUint64() into two page aligned buffers. When stdout is
+ * a pipe they're handed to it with vmsplice, so the bytes are never copied, and when writing a file
+ * --direct opens it with O_DIRECT to bypass the page cache.
+ */
+
+#include<PRNG.h>
+#include<ChaChaPRNG.h>
+#include<Substreams.h>
+#include<prng-tools.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std;
+using prng_tools::expandSeed;
+using prng_tools::parseNumber;
+
+namespace {
+
+const size_t defaultBufferBytes = 1 << 20;
+
+struct Options
+{
+    string engine = "xorshift1024";
+    uint64_t seed = 0;
+    bool seeded = false;
+    uint32_t jump = 0;
+    uint64_t bytes = 0;
+    int bits = 64;
+    string output;
+    bool direct = false;
+};
+
+void usage()
+{
+    fprintf(stderr,
+            "usage: prng-stream [options]\n"
+            "  --engine NAME   xorshift1024 (default), chacha8, chacha12 or chacha20\n"
+            "  --seed N        64 bit seed, expanded to the engine's state; random if not given\n"
+            "  --jump N        use stream N of the seed: N jump()s for xorshift1024, the nonce for chacha\n"
+            "  --bytes N       stop after N bytes, with an optional K, M, G or T suffix; endless if not given\n"
+            "  --bits 32|64    write whole words or only their high 32 bits\n"
+            "  --output PATH   write to a file rather than stdout\n"
+            "  --direct        open the output file with O_DIRECT\n");
+}
+
+bool parseOptions(int argc, char **argv, Options &options)
+{
+    for(int i = 1; i < argc; i++)
+    {
+        string option = argv[i];
+        if(option == "--direct")
+        {
+            options.direct = true;
+            continue;
+        }
+        if(i + 1 == argc)
+        {
+            return false;
+        }
+        const char *value = argv[++i];
+        uint64_t number = 0;
+        if(option == "--engine")
+        {
+            options.engine = value;
+        }
+        else if(option == "--output")
+        {
+            options.output = value;
+        }
+        else if(!parseNumber(value, number))
+        {
+            return false;
+        }
+        else if(option == "--seed")
+        {
+            options.seed = number;
+            options.seeded = true;
+        }
+        else if(option == "--jump" && number <= UINT32_MAX)
+        {
+            options.jump = static_cast<uint32_t>(number);
+        }
+        else if(option == "--bytes")
+        {
+            options.bytes = number;
+        }
+        else if(option == "--bits" && (number == 32 || number == 64))
+        {
+            options.bits = static_cast<int>(number);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+enum WriteResult
+{
+    writeDone,
+    // The reader closed the pipe, which is how batteries say they've read enough
+    writeReaderGone,
+    writeFailed
+};
+
+/*
+ * Writes buffers to a file descriptor. A buffer passed to write() may be handed to the pipe by
+ * reference, so the caller must alternate between two buffers of at most bufferBytes() and not
+ * touch one until the other has been written.
+ */
+class Output
+{
+public:
+    Output() : descriptor(1), pipe(false), direct(false), bytesPerBuffer(defaultBufferBytes) {}
+
+    ~Output()
+    {
+        if(descriptor != 1)
+        {
+            close(descriptor);
+        }
+    }
+
+    bool open(const Options &options)
+    {
+        if(!options.output.empty())
+        {
+            int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+            if(options.direct)
+            {
+                flags |= O_DIRECT;
+                direct = true;
+            }
+#endif
+            descriptor = ::open(options.output.c_str(), flags, 0644);
+            if(descriptor < 0)
+            {
+                perror(options.output.c_str());
+                return false;
+            }
+        }
+#ifdef __linux__
+        struct stat status;
+        if(fstat(descriptor, &status) == 0 && S_ISFIFO(status.st_mode))
+        {
+            // vmsplice'd pages stay referenced until the reader consumes them. Once a whole pipe's
+            // worth from one buffer has gone in, the other buffer has been fully read, so the
+            // buffers must be the size of the pipe.
+            pipe = true;
+            int size = fcntl(descriptor, F_SETPIPE_SZ, static_cast<int>(defaultBufferBytes));
+            if(size <= 0)
+            {
+                size = fcntl(descriptor, F_GETPIPE_SZ);
+            }
+            if(size > 0)
+            {
+                bytesPerBuffer = static_cast<size_t>(size);
+            }
+            else
+            {
+                pipe = false;
+            }
+        }
+#endif
+        return true;
+    }
+
+    size_t bufferBytes() const
+    {
+        return bytesPerBuffer;
+    }
+
+    WriteResult write(const char *data, size_t size)
+    {
+#ifdef __linux__
+        while(pipe && size > 0)
+        {
+            iovec vector = {const_cast<char *>(data), size};
+            ssize_t written = vmsplice(descriptor, &vector, 1, 0);
+            if(written < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                // Not every kind of pipe supports it, e.g. some FUSE files; fall back to write()
+                pipe = false;
+                break;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+#endif
+        if(direct && size % 4096 != 0)
+        {
+            // O_DIRECT needs whole blocks, so finish the tail through the page cache
+#ifdef O_DIRECT
+            fcntl(descriptor, F_SETFL, fcntl(descriptor, F_GETFL) & ~O_DIRECT);
+#endif
+            direct = false;
+        }
+        while(size > 0)
+        {
+            ssize_t written = ::write(descriptor, data, size);
+            if(written < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                if(errno == EPIPE)
+                {
+                    return writeReaderGone;
+                }
+                perror("prng-stream");
+                return writeFailed;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return writeDone;
+    }
+
+private:
+    int descriptor;
+    bool pipe;
+    bool direct;
+    size_t bytesPerBuffer;
+};
+
+void *allocatePages(size_t bytes)
+{
+    void *memory = nullptr;
+    if(posix_memalign(&memory, 4096, bytes) != 0)
+    {
+        return nullptr;
+    }
+    return memory;
+}
+
+template <class Engine>
+int stream(Engine &rng, const Options &options, Output &output)
+{
+    const size_t bufferBytes = output.bufferBytes();
+    char *buffers[2] = {static_cast<char *>(allocatePages(bufferBytes)),
+                        static_cast<char *>(allocatePages(bufferBytes))};
+    vector<uint64_t> words(options.bits == 32 ? bufferBytes / sizeof(uint32_t) : 0);
+    if(buffers[0] == nullptr || buffers[1] == nullptr)
+    {
+        fprintf(stderr, "prng-stream: out of memory\n");
+        return 1;
+    }
+
+    int status = 0;
+    uint64_t remaining = options.bytes;
+    for(int current = 0; options.bytes == 0 || remaining > 0; current ^= 1)
+    {
+        char *buffer = buffers[current];
+        if(options.bits == 64)
+        {
+            rng.fillUint64(reinterpret_cast<uint64_t *>(buffer), bufferBytes / sizeof(uint64_t));
+        }
+        else
+        {
+            // The high halves, which are the better bits of xorshift1024*
+            rng.fillUint64(words.data(), words.size());
+            uint32_t *halves = reinterpret_cast<uint32_t *>(buffer);
+            for(size_t i = 0; i < words.size(); i++)
+            {
+                halves[i] = static_cast<uint32_t>(words[i] >> 32);
+            }
+        }
+        size_t size = bufferBytes;
+        if(options.bytes != 0 && remaining < size)
+        {
+            size = static_cast<size_t>(remaining);
+        }
+        remaining -= size;
+        WriteResult result = output.write(buffer, size);
+        if(result != writeDone)
+        {
+            // A truncated fixture mustn't look like a finished one
+            status = result == writeFailed ? 1 : 0;
+            break;
+        }
+    }
+    free(buffers[0]);
+    free(buffers[1]);
+    return status;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if(!parseOptions(argc, argv, options))
+    {
+        usage();
+        return 2;
+    }
+    if(!options.seeded)
+    {
+        random_device device;
+        options.seed = static_cast<uint64_t>(device()) << 32 | device();
+        fprintf(stderr, "prng-stream: --seed 0x%016llx\n", static_cast<unsigned long long>(options.seed));
+    }
+    signal(SIGPIPE, SIG_IGN);
+    Output output;
+    if(!output.open(options))
+    {
+        return 1;
+    }
+
+    array<uint64_t, 16> seed = expandSeed(options.seed);
+    if(options.engine == "xorshift1024")
+    {
+        PRNG rng = substream(seed, StreamId{0, 0, options.jump});
+        return stream(rng, options, output);
+    }
+    array<uint64_t, 4> key = {{seed[0], seed[1], seed[2], seed[3]}};
+    if(options.engine == "chacha8")
+    {
+        ChaCha8PRNG rng(key, options.jump);
+        return stream(rng, options, output);
+    }
+    if(options.engine == "chacha12")
+    {
+        ChaCha12PRNG rng(key, options.jump);
+        return stream(rng, options, output);
+    }
+    if(options.engine == "chacha20")
+    {
+        ChaCha20PRNG rng(key, options.jump);
+        return stream(rng, options, output);
+    }
+    usage();
+    return 2;
+}
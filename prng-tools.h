@@ -0,0 +1,91 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+/*
+ * What the command line tools, prng-stream and prng-smoke, share: reading sizes and expanding
+ * --seed. Both go through here so the same --seed always means the same stream in either tool.
+ */
+
+#ifndef PRNG_TOOLS_H
+#define PRNG_TOOLS_H
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace prng_tools
+{
+
+/**
+ * @brief Reads a number with an optional K, M, G or T suffix, for powers of 1024
+ * @param text - the argument to read
+ * @param value - set to the number read
+ * @return whether text was a whole number that fits in 64 bits
+ */
+inline bool parseNumber(const char *text, uint64_t &value)
+{
+    char *end;
+    errno = 0;
+    value = std::strtoull(text, &end, 0);
+    if(errno != 0 || end == text)
+    {
+        return false;
+    }
+    const std::string suffixes = "KMGT";
+    if(*end != '\0')
+    {
+        std::size_t power = suffixes.find(*end);
+        if(power == std::string::npos || end[1] != '\0')
+        {
+            return false;
+        }
+        unsigned shift = 10 * static_cast<unsigned>(power + 1);
+        if(value > UINT64_MAX >> shift)
+        {
+            return false;
+        }
+        value <<= shift;
+    }
+    return true;
+}
+
+/**
+ * @brief Expands a 64 bit seed into a generator's 16 words with splitmix64, the same way on every run
+ * @param seed - the seed given on the command line
+ * @return the state to seed a PRNG with, or to take a ChaCha key from
+ */
+inline std::array<uint64_t, 16> expandSeed(uint64_t seed)
+{
+    std::array<uint64_t, 16> state;
+    for(uint64_t &word : state)
+    {
+        seed += 0x9e3779b97f4a7c15ULL;
+        uint64_t value = seed;
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        word = value ^ (value >> 31);
+    }
+    return state;
+}
+
+}
+
+#endif // PRNG_TOOLS_H
@@ -0,0 +1,296 @@
+/*
+    Copyright 2015 Matthew Leadbetter
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+    If you have any queries I can be contacted by e-mail: matthew@mleadbetter.com
+*/
+
+/*
+ * The tests of the opt in builds, PRNG_INSTRUMENTATION and PRNG_RECORDING. They change PRNG's
+ * layout, so they're a binary of their own rather than part of tests.cpp, which keeps to the
+ * default configuration.
+ */
+
+#include "gtest/gtest.h"
+
+#define PRNG_INSTRUMENTATION
+#define PRNG_RECORDING
+#include<PRNG.h>
+#include<ChaChaPRNG.h>
+#include<RecordingPRNG.h>
+
+#include <array>
+#include <cstdio>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr array<uint64_t, 16> constexprSeed
+        = {{0x374be26ee31f1e78, 0xd4eef394f72f149b, 0x91cb5a7001068c8b, 0x718ef6c2be5efbe7,
+            0xbb0dd94396008d70, 0x4f0996d1cd72d2d8, 0x2419b74e0b39e9b3, 0x0da693cf50e1396e,
+            0xcaec0e7f4cae7ffa, 0x350b63e4717957c6, 0xbe8460185de680dc, 0xff18c7a0efbcec26,
+            0xff1a72bb0ca9ac7f, 0x3b4818e046188158, 0xcac3e320230a44ba, 0xcaf9544740fbd288}};
+
+// Draws from a few call sites, as a simulation step would
+template <class Engine>
+double simulationStep(Engine &rng)
+{
+    double total = PRNG_DRAW(rng, 1, getRandomDouble());
+    total += PRNG_DRAW(rng, 2, getRandomInt(0, 6));
+    total += static_cast<double>(rng.getRandomUint64() >> 60);
+    total += PRNG_DRAW(rng, 3, getRandomUint64(999));
+    return total;
+}
+
+TEST(RecordingPRNG, test_records_words_and_sites)
+{
+    RecordingPRNG recording(constexprSeed);
+    PRNG plain(constexprSeed);
+    DrawLog log(64);
+    recording.attach(&log);
+    EXPECT_EQ(simulationStep(plain), simulationStep(recording));
+
+    ASSERT_GE(log.size(), 4u);
+    PRNG words(constexprSeed);
+    for(size_t i = 0; i < log.size(); i++)
+    {
+        EXPECT_EQ(words.getRandomUint64(), log[i].word);
+    }
+    // Bounded draws may reject words, so each site can have several records, numbered by draw
+    const uint32_t sites[4] = {1, 2, 0, 3};
+    const uint16_t methods[4] = {prng_detail::methodId("getRandomDouble"), prng_detail::methodId("getRandomInt"), 0,
+                                 prng_detail::methodId("getRandomUint64")};
+    size_t record = 0;
+    for(int call = 0; call < 4; call++)
+    {
+        for(uint16_t draw = 0; record < log.size() && log[record].site == sites[call]; draw++, record++)
+        {
+            EXPECT_EQ(methods[call], log[record].method);
+            EXPECT_EQ(draw, log[record].draw);
+        }
+    }
+    EXPECT_EQ(log.size(), record);
+}
+
+TEST(RecordingPRNG, test_log_keeps_newest)
+{
+    RecordingPRNG recording(constexprSeed);
+    DrawLog log(10);
+    recording.attach(&log);
+    vector<uint64_t> words(100);
+    recording.fillUint64(words.data(), words.size());
+    EXPECT_EQ(16u, log.capacity());
+    EXPECT_EQ(100u, log.written());
+    ASSERT_EQ(16u, log.size());
+    for(size_t i = 0; i < 16; i++)
+    {
+        EXPECT_EQ(words[84 + i], log[i].word);
+    }
+}
+
+TEST(RecordingPRNG, test_replay_reproduces_run)
+{
+    RecordingPRNG recording(constexprSeed);
+    DrawLog log(1024);
+    recording.attach(&log);
+    vector<double> recorded;
+    for(int i = 0; i < 20; i++)
+    {
+        recorded.push_back(simulationStep(recording));
+    }
+
+    ReplayPRNG replay(log);
+    for(int i = 0; i < 20; i++)
+    {
+        EXPECT_EQ(recorded[i], simulationStep(replay));
+    }
+    EXPECT_FALSE(replay.hasDiverged());
+    EXPECT_EQ(0u, replay.remaining());
+
+    // A draw from a different call site is caught at the record it consumed
+    ReplayPRNG diverging(log);
+    simulationStep(diverging);
+    PRNG_DRAW(diverging, 7, getRandomDouble());
+    size_t secondStep = 1;
+    while(log[secondStep].site != 1)
+    {
+        secondStep++;
+    }
+    EXPECT_TRUE(diverging.hasDiverged());
+    EXPECT_EQ(secondStep, diverging.firstDivergence());
+}
+
+TEST(RecordingPRNG, test_file_log_replays)
+{
+    string path = testing::TempDir() + "prng_draw_log";
+    vector<uint64_t> recorded(50);
+    {
+        DrawLog log(path, 100);
+        RecordingPRNG recording(constexprSeed);
+        recording.attach(&log);
+        for(uint64_t &word : recorded)
+        {
+            word = PRNG_DRAW(recording, 5, getRandomUint64());
+        }
+    }
+    DrawLog log(path);
+    EXPECT_EQ(128u, log.capacity());
+    EXPECT_EQ(50u, log.size());
+    ReplayPRNG replay(log);
+    for(uint64_t word : recorded)
+    {
+        EXPECT_EQ(word, PRNG_DRAW(replay, 5, getRandomUint64()));
+    }
+    EXPECT_FALSE(replay.hasDiverged());
+    remove(path.c_str());
+    EXPECT_THROW(DrawLog(testing::TempDir() + "no/such/dir/log"), std::system_error);
+}
+
+TEST(Instrumentation, test_counts_calls_and_steps)
+{
+    PRNG rng(constexprSeed);
+    prng_instrumentation::reset();
+    rng.getRandomInt();
+    rng.getRandomDouble(1.0, 2.0);
+    rng.uniform<int, 1, 8>();
+    uint64_t words[100];
+    rng.fillUint64(words, 100);
+
+    prng_instrumentation::Snapshot totals = prng_instrumentation::snapshot();
+    EXPECT_EQ(103u, totals.steps);
+    EXPECT_EQ(1u, totals.calls[prng_instrumentation::callGetRandomInt]);
+    EXPECT_EQ(1u, totals.calls[prng_instrumentation::callGetRandomDoubleRange]);
+    EXPECT_EQ(1u, totals.calls[prng_instrumentation::callUniform]);
+    EXPECT_EQ(1u, totals.calls[prng_instrumentation::callFillUint64]);
+    EXPECT_EQ(0u, totals.calls[prng_instrumentation::callGetRandomDouble]);
+
+    prng_instrumentation::reset();
+    EXPECT_EQ(0u, prng_instrumentation::snapshot().steps);
+}
+
+TEST(Instrumentation, test_counts_rejections)
+{
+    PRNG rng(constexprSeed);
+    prng_instrumentation::reset();
+    // A range of 2^20 + 1 values fills just over half of the 21 bit draws
+    const int calls = 10000;
+    for(int i = 0; i < calls; i++)
+    {
+        rng.getRandomInt(0, 1 << 20);
+    }
+
+    prng_instrumentation::Snapshot totals = prng_instrumentation::snapshot();
+    EXPECT_EQ(static_cast<uint64_t>(calls), totals.calls[prng_instrumentation::callGetRandomIntRange]);
+    EXPECT_EQ(0u, totals.calls[prng_instrumentation::callGetRandomUint64Max]);
+    EXPECT_EQ(static_cast<uint64_t>(calls), totals.boundedCalls[21]);
+    EXPECT_EQ(totals.steps, totals.boundedDraws[21]);
+    EXPECT_NEAR(2.0, static_cast<double>(totals.boundedDraws[21]) / calls, 0.1);
+
+    // Ranges of a power of two values never reject
+    prng_instrumentation::reset();
+    for(int i = 0; i < calls; i++)
+    {
+        rng.getRandomUnsignedInt(1023u);
+    }
+    totals = prng_instrumentation::snapshot();
+    EXPECT_EQ(totals.boundedCalls[10], totals.boundedDraws[10]);
+}
+
+TEST(Instrumentation, test_keeps_counts_of_exited_threads)
+{
+    prng_instrumentation::reset();
+    vector<thread> threads;
+    for(int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([]() {
+            PRNG rng(constexprSeed);
+            for(int i = 0; i < 1000; i++)
+            {
+                rng.getRandomUint64();
+            }
+        });
+    }
+    for(thread &t : threads)
+    {
+        t.join();
+    }
+    PRNG rng(constexprSeed);
+    rng.getRandomUint64();
+
+    prng_instrumentation::Snapshot totals = prng_instrumentation::snapshot();
+    EXPECT_EQ(4001u, totals.steps);
+    EXPECT_EQ(4001u, totals.calls[prng_instrumentation::callGetRandomUint64]);
+}
+
+// fillBytes() makes its words with the engine's own fill, but that mustn't count as calls to fillUint64()
+template <class Engine>
+void expectFillBytesCountedOnce(Engine &rng)
+{
+    prng_instrumentation::reset();
+    // Unaligned with a tail, so every path through fillBytes() is taken
+    unsigned char bytes[1000];
+    rng.fillBytes(bytes + 1, 997);
+
+    prng_instrumentation::Snapshot totals = prng_instrumentation::snapshot();
+    EXPECT_EQ(1u, totals.calls[prng_instrumentation::callFillBytes]);
+    EXPECT_EQ(0u, totals.calls[prng_instrumentation::callFillUint64]);
+    EXPECT_EQ(125u, totals.steps);
+}
+
+TEST(Instrumentation, test_fill_bytes_counts_one_call)
+{
+    PRNG rng(constexprSeed);
+    expectFillBytesCountedOnce(rng);
+    ChaCha20PRNG chacha(constexprSeed);
+    expectFillBytesCountedOnce(chacha);
+}
+
+#ifdef __SIZEOF_INT128__
+TEST(Instrumentation, test_fill_uint128_counts_one_call)
+{
+    PRNG rng(constexprSeed);
+    prng_instrumentation::reset();
+    // More than one block of 32
+    PRNG::uint128 numbers[100];
+    rng.fillUint128(numbers, 100);
+
+    prng_instrumentation::Snapshot totals = prng_instrumentation::snapshot();
+    EXPECT_EQ(1u, totals.calls[prng_instrumentation::callFillUint128]);
+    EXPECT_EQ(0u, totals.calls[prng_instrumentation::callFillUint64]);
+    EXPECT_EQ(200u, totals.steps);
+}
+#endif
+
+TEST(Instrumentation, test_json_export)
+{
+    PRNG rng(constexprSeed);
+    prng_instrumentation::reset();
+    rng.getRandomUint64();
+    rng.getRandomUint64();
+    prng_instrumentation::Snapshot totals = prng_instrumentation::snapshot();
+    EXPECT_EQ("{\"steps\": 2, \"calls\": {\"getRandomUint64()\": 2}, \"bounded\": []}", totals.toJson());
+
+    totals.boundedCalls[3] = 4;
+    totals.boundedDraws[3] = 6;
+    string json = totals.toJson();
+    EXPECT_NE(string::npos, json.find("{\"bits\": 3, \"calls\": 4, \"draws\": 6, \"rejections\": 2}"));
+}
+
+}
@@ -20,8 +20,39 @@
 #include "gtest/gtest.h"
 
 #include<PRNG.h>
-
+#include<ConstexprPRNG.h>
+#include<RandomPermutation.h>
+#include<Distributions.h>
+#include<Geometry.h>
+#include<PrefetchingPRNG.h>
+#include<PRNGEnsemble.h>
+#include<ChaChaPRNG.h>
+#include<QuasiRandom.h>
+#include<RecordingPRNG.h>
+#include<Substreams.h>
+#include<SharedPool.h>
+#include<Tokens.h>
+#include<StochasticRounding.h>
+#include<MonteCarlo.h>
+#include<Dispatch.h>
+
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <sys/resource.h>
 
 using namespace std;
 
@@ -309,6 +340,40 @@ TEST_F(PRNGTest, test_uniform_results_min_max_long_double)
     EXPECT_GT(totalLow, 19000);
 }
 
+TEST_F(PRNGTest, test_uniform_results_compile_time_bounds)
+{
+    int bins[5]{0};
+    for(unsigned int i = 0; i < 100000; i++) {
+        bins[rng.uniform<int, 3, 7>() - 3]++;
+    }
+    EXPECT_LT(bins[0], 21000);
+    EXPECT_GT(bins[0], 19000);
+    EXPECT_LT(bins[1], 21000);
+    EXPECT_GT(bins[1], 19000);
+    EXPECT_LT(bins[2], 21000);
+    EXPECT_GT(bins[2], 19000);
+    EXPECT_LT(bins[3], 21000);
+    EXPECT_GT(bins[3], 19000);
+    EXPECT_LT(bins[4], 21000);
+    EXPECT_GT(bins[4], 19000);
+}
+
+TEST_F(PRNGTest, test_uniform_results_compile_time_power_of_two)
+{
+    int bins[4]{0};
+    for(unsigned int i = 0; i < 100000; i++) {
+        bins[rng.uniform<unsigned int, 0, 3>()]++;
+    }
+    EXPECT_LT(bins[0], 26000);
+    EXPECT_GT(bins[0], 24000);
+    EXPECT_LT(bins[1], 26000);
+    EXPECT_GT(bins[1], 24000);
+    EXPECT_LT(bins[2], 26000);
+    EXPECT_GT(bins[2], 24000);
+    EXPECT_LT(bins[3], 26000);
+    EXPECT_GT(bins[3], 24000);
+}
+
 /*
  * This basically just tests that modulo wasn't used
  */
@@ -590,6 +655,27 @@ TEST_F(PRNGTest, test_max_bound_long_long_half_negative)
     cout << endl;
 }
 
+TEST_F(PRNGTest, test_bounds_compile_time)
+{
+    for(unsigned int i = 0; i < 100; i++) {
+        int dice = rng.uniform<int, 1, 6>();
+        EXPECT_GE(dice, 1);
+        EXPECT_LE(dice, 6);
+        long negative = rng.uniform<long, -3, -1>();
+        EXPECT_GE(negative, -3);
+        EXPECT_LE(negative, -1);
+        EXPECT_LE((rng.uniform<unsigned char, 0, 2>()), 2);
+        EXPECT_LE((rng.uniform<unsigned int, 0, 1023>()), 1023u);
+    }
+}
+
+TEST_F(PRNGTest, test_degenerate_compile_time_bounds_do_not_draw)
+{
+    array<uint64_t, 16> before = rng.getState();
+    EXPECT_EQ(5, (rng.uniform<int, 5, 5>()));
+    EXPECT_EQ(before, rng.getState());
+}
+
 /*
  * The upper bound on the chance of a false negative here is (2^64 - 1) / 2^64
  * which unfortunately doesn't tell us much. The tests have been included anyway
@@ -680,6 +766,173 @@ TEST_F(PRNGTest, test_min_bound_long_double_2)
     }
 }
 
+/*
+ * PRNG should plug straight into the standard library.
+ */
+TEST_F(PRNGTest, test_standard_shuffle)
+{
+    static_assert(PRNG::min() == 0, "PRNG should cover the whole uint64_t range");
+    static_assert(PRNG::max() == numeric_limits<uint64_t>::max(), "PRNG should cover the whole uint64_t range");
+    vector<int> values(100);
+    iota(values.begin(), values.end(), 0);
+    shuffle(values.begin(), values.end(), rng);
+    vector<int> sorted(values);
+    sort(sorted.begin(), sorted.end());
+    for(int i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(i, sorted[i]);
+    }
+    EXPECT_FALSE(is_sorted(values.begin(), values.end()));
+}
+
+TEST_F(PRNGTest, test_standard_distribution)
+{
+    uniform_int_distribution<int> dice(1, 6);
+    for(unsigned int i = 0; i < 100; i++) {
+        int roll = dice(rng);
+        EXPECT_GE(roll, 1);
+        EXPECT_LE(roll, 6);
+    }
+}
+
+TEST_F(PRNGTest, test_move_keeps_sequence)
+{
+    PRNG copy(rng.getState());
+    vector<PRNG> pool;
+    pool.push_back(std::move(copy));
+    pool.emplace_back();
+    for(unsigned int i = 0; i < 100; i++) {
+        EXPECT_EQ(rng(), pool[0]());
+    }
+}
+
+/*
+ * The bulk and view interfaces have to give exactly what the scalar calls do.
+ */
+TEST_F(PRNGTest, test_fill_matches_scalar)
+{
+    PRNG scalar(rng.getState());
+    uint64_t block[37];
+    rng.fillUint64(block, 37);
+    for(uint64_t value : block)
+    {
+        EXPECT_EQ(scalar.getRandomUint64(), value);
+    }
+    EXPECT_EQ(scalar.getRandomUint64(), rng.getRandomUint64());
+}
+
+// Whether or not the buffer is aligned, the bytes are those of the words, with the rest of the last dropped
+TEST_F(PRNGTest, test_fill_bytes_matches_words)
+{
+    for(size_t offset : {0, 3})
+    {
+        PRNG words(rng.getState());
+        PRNG bytes(rng.getState());
+        uint64_t expected[6];
+        words.fillUint64(expected, 6);
+        uint64_t buffer[7] = {};
+        unsigned char *start = reinterpret_cast<unsigned char *>(buffer) + offset;
+        bytes.fillBytes(start, 45);
+        EXPECT_EQ(0, memcmp(expected, start, 45));
+        EXPECT_EQ(0, start[45]);
+        EXPECT_EQ(words.getRandomUint64(), bytes.getRandomUint64());
+    }
+}
+
+#ifdef __SIZEOF_INT128__
+TEST_F(PRNGTest, test_uint128_takes_two_words)
+{
+    PRNG words(rng.getState());
+    PRNG filled(rng.getState());
+    vector<PRNG::uint128> block(77);
+    filled.fillUint128(block.data(), block.size());
+    for(PRNG::uint128 value : block)
+    {
+        uint64_t low = words.getRandomUint64();
+        PRNG::uint128 expected = static_cast<PRNG::uint128>(words.getRandomUint64()) << 64 | low;
+        EXPECT_TRUE(expected == value);
+        EXPECT_TRUE(rng.getRandomUint128() == value);
+    }
+    EXPECT_EQ(words.getRandomUint64(), filled.getRandomUint64());
+
+    // A range wider than 64 bits still costs two words a draw when nothing is rejected
+    PRNG bounded(rng.getState());
+    PRNG twin(rng.getState());
+    const PRNG::uint128 maxValue = static_cast<PRNG::uint128>(1000000000000000ULL) * 1000000000000000ULL;
+    for(int i = 0; i < 1000; i++)
+    {
+        EXPECT_TRUE(bounded.getRandomUint128(maxValue) <= maxValue);
+        twin.getRandomUint128();
+    }
+    EXPECT_EQ(twin.getRandomUint64(), bounded.getRandomUint64());
+}
+
+// Ranges where the multiply's high half is known exactly check both the 128x64 and 128x128 paths
+TEST_F(PRNGTest, test_uint128_multiply)
+{
+    const PRNG::uint128 all = ~static_cast<PRNG::uint128>(0);
+    PRNG raw(rng.getState());
+    for(int i = 0; i < 1000; i++)
+    {
+        // x * 2^64 / 2^128 is the high word of x
+        raw.getRandomUint64();
+        EXPECT_EQ(raw.getRandomUint64(), static_cast<uint64_t>(rng.getRandomUint128(UINT64_MAX)));
+        // x * (2^128 - 1) / 2^128 is x - 1, and only x = 0 is rejected
+        PRNG::uint128 x = raw.getRandomUint128();
+        EXPECT_TRUE(x - 1 == rng.getRandomUint128(all - 1));
+    }
+    EXPECT_TRUE(rng.getRandomUint128(all) == raw.getRandomUint128());
+    EXPECT_TRUE(rng.getRandomInt128(0, 0) == 0);
+}
+
+// The thirds of a range wider than 64 bits, and a range of three, come up equally often
+TEST_F(PRNGTest, test_uint128_bounded_is_uniform)
+{
+    const PRNG::uint128 third = static_cast<PRNG::uint128>(1) << 100;
+    const PRNG::int128 lowest = -static_cast<PRNG::int128>(third);
+    const int draws = 30000;
+    int wide[3] = {};
+    int narrow[3] = {};
+    for(int i = 0; i < draws; i++)
+    {
+        PRNG::int128 value = rng.getRandomInt128(lowest, 2 * static_cast<PRNG::int128>(third) - 1);
+        ASSERT_TRUE(value >= lowest && value < 2 * static_cast<PRNG::int128>(third));
+        wide[static_cast<int>((value - lowest) >> 100)]++;
+        PRNG::uint128 small = rng.getRandomUint128(10, 12);
+        ASSERT_TRUE(small >= 10 && small <= 12);
+        narrow[static_cast<int>(small - 10)]++;
+    }
+    for(int i = 0; i < 3; i++)
+    {
+        // Over 5 standard deviations
+        EXPECT_NEAR(draws / 3, wide[i], 450);
+        EXPECT_NEAR(draws / 3, narrow[i], 450);
+    }
+}
+#endif
+
+TEST_F(PRNGTest, test_int_view_matches_scalar)
+{
+    PRNG scalar(rng.getState());
+    auto view = rng.ints(-3, 7);
+    auto it = view.begin();
+    for(unsigned int i = 0; i < 100; i++, ++it)
+    {
+        EXPECT_EQ(scalar.getRandomInt(-3, 7), *it);
+    }
+}
+
+TEST_F(PRNGTest, test_double_view_matches_scalar)
+{
+    PRNG scalar(rng.getState());
+    auto view = rng.doubles();
+    auto it = view.begin();
+    for(unsigned int i = 0; i < 100; i++, ++it)
+    {
+        EXPECT_EQ(scalar.getRandomDouble(), *it);
+    }
+}
+
 /*
  * Test the constructor generates different seeds
  *
@@ -735,4 +988,1635 @@ TEST(PRNG_constructor, test_all_seed_bits_can_be_unset)
     }
 }
 
+/*
+ * A permutation has to hit every value in [0, size) exactly once.
+ */
+TEST(RandomPermutation, test_is_bijection)
+{
+    PRNG rng;
+    for(uint64_t size : {1, 2, 3, 5, 64, 1000, 1025})
+    {
+        RandomPermutation permutation(size, rng);
+        vector<bool> seen(size, false);
+        for(uint64_t i = 0; i < size; i++)
+        {
+            uint64_t mapped = permutation[i];
+            ASSERT_LT(mapped, size);
+            EXPECT_FALSE(seen[mapped]);
+            seen[mapped] = true;
+        }
+    }
+}
+
+TEST(RandomPermutation, test_same_seed_same_permutation)
+{
+    static const array<uint64_t, 16> seed
+            = {{0x374be26ee31f1e78, 0xd4eef394f72f149b, 0x91cb5a7001068c8b, 0x718ef6c2be5efbe7,
+                0xbb0dd94396008d70, 0x4f0996d1cd72d2d8, 0x2419b74e0b39e9b3, 0x0da693cf50e1396e,
+                0xcaec0e7f4cae7ffa, 0x350b63e4717957c6, 0xbe8460185de680dc, 0xff18c7a0efbcec26,
+                0xff1a72bb0ca9ac7f, 0x3b4818e046188158, 0xcac3e320230a44ba, 0xcaf9544740fbd288}};
+    const uint64_t size = uint64_t(1) << 40;
+    RandomPermutation first(size, seed), second(size, seed);
+    for(uint64_t i = 0; i < 1000; i++)
+    {
+        uint64_t mapped = first[i * 1000003];
+        EXPECT_LT(mapped, size);
+        EXPECT_EQ(mapped, second[i * 1000003]);
+    }
+}
+
+TEST(RandomPermutation, test_map_matches_lookup)
+{
+    PRNG rng;
+    RandomPermutation permutation(1000, rng);
+    uint64_t indices[1000];
+    for(uint64_t i = 0; i < 1000; i++)
+    {
+        indices[i] = i;
+    }
+    permutation.map(indices, indices, 1000);
+    uint64_t i = 0;
+    for(uint64_t mapped : permutation)
+    {
+        EXPECT_EQ(permutation[i], mapped);
+        EXPECT_EQ(indices[i], mapped);
+        i++;
+    }
+    EXPECT_EQ(1000, i);
+}
+
+constexpr array<uint64_t, 16> constexprSeed
+        = {{0x374be26ee31f1e78, 0xd4eef394f72f149b, 0x91cb5a7001068c8b, 0x718ef6c2be5efbe7,
+            0xbb0dd94396008d70, 0x4f0996d1cd72d2d8, 0x2419b74e0b39e9b3, 0x0da693cf50e1396e,
+            0xcaec0e7f4cae7ffa, 0x350b63e4717957c6, 0xbe8460185de680dc, 0xff18c7a0efbcec26,
+            0xff1a72bb0ca9ac7f, 0x3b4818e046188158, 0xcac3e320230a44ba, 0xcaf9544740fbd288}};
+
+/*
+ * The compile time generator has to produce exactly what the run time one does.
+ */
+TEST(ConstexprPRNG, test_table_matches_runtime)
+{
+    constexpr auto table = makeRandomTable<4096>(constexprSeed);
+    static_assert(table.size() == 4096, "table should be built at compile time");
+    PRNG rng(constexprSeed);
+    for(uint64_t value : table)
+    {
+        EXPECT_EQ(rng.getRandomUint64(), value);
+    }
+}
+
+TEST(ConstexprPRNG, test_bounded_table_matches_runtime)
+{
+    constexpr auto table = makeRandomTable<1000>(constexprSeed, 5);
+    PRNG rng(constexprSeed);
+    for(uint64_t value : table)
+    {
+        EXPECT_EQ(rng.getRandomUint64(5), value);
+    }
+}
+
+TEST(ConstexprPRNG, test_floats_match_runtime)
+{
+    ConstexprPRNG compileTime(constexprSeed);
+    PRNG runTime(constexprSeed);
+    for(unsigned int i = 0; i < 1000; i++)
+    {
+        EXPECT_EQ(runTime.getRandomDouble(), compileTime.getRandomDouble());
+        EXPECT_EQ(runTime.getRandomFloat(), compileTime.getRandomFloat());
+    }
+}
+
+TEST(FastMath, test_matches_std)
+{
+    const double twoPi = 6.28318530717958647692;
+    PRNG rng(constexprSeed);
+    for(unsigned int i = 0; i < 10000; i++)
+    {
+        double positive = rng.getRandomDouble(1e-300, 1e300);
+        double unit = rng.getRandomDouble();
+        double exponent = rng.getRandomDouble(-700, 700);
+        EXPECT_NEAR(log(positive), fastmath::log(positive), 1e-15 * fabs(log(positive)) + 1e-15);
+        EXPECT_NEAR(exp(exponent), fastmath::exp(exponent), 1e-15 * exp(exponent));
+        EXPECT_NEAR(sqrt(positive), fastmath::sqrt(positive), 1e-15 * sqrt(positive));
+        double sine, cosine;
+        fastmath::sinCosTurns(unit, sine, cosine);
+        EXPECT_NEAR(sin(twoPi * unit), sine, 1e-15);
+        EXPECT_NEAR(cos(twoPi * unit), cosine, 1e-15);
+
+        float positiveFloat = rng.getRandomFloat(1e-30f, 1e30f);
+        float exponentFloat = rng.getRandomFloat(-80, 80);
+        EXPECT_NEAR(log(positiveFloat), fastmath::log(positiveFloat), 1e-6f * fabs(log(positiveFloat)) + 1e-6f);
+        EXPECT_NEAR(exp(exponentFloat), fastmath::exp(exponentFloat), 1e-6f * exp(exponentFloat));
+    }
+    EXPECT_EQ(0.0, fastmath::exp(-1000.0));
+    EXPECT_EQ(numeric_limits<double>::infinity(), fastmath::exp(1000.0));
+}
+
+/*
+ * Kolmogorov-Smirnov distance between the samples and the normal CDF.
+ */
+template <class T>
+double normalDistance(vector<T> samples, double mean, double standardDeviation)
+{
+    sort(samples.begin(), samples.end());
+    double distance = 0;
+    for(size_t i = 0; i < samples.size(); i++)
+    {
+        double cdf = 0.5 * erfc(-(samples[i] - mean) / (standardDeviation * sqrt(2.0)));
+        distance = max(distance, fabs(cdf - double(i) / samples.size()));
+        distance = max(distance, fabs(cdf - double(i + 1) / samples.size()));
+    }
+    return distance;
+}
+
+TEST(Distributions, test_normal_matches_cdf)
+{
+    PRNG rng(constexprSeed);
+    const size_t count = 100000;
+    // The 0.1% critical value of the KS statistic is 1.95 / sqrt(n)
+    const double critical = 1.95 / sqrt(double(count));
+    vector<double> doubles(count);
+    fillNormal(rng, doubles.data(), count);
+    EXPECT_LT(normalDistance(doubles, 0, 1), critical);
+    fillNormal(rng, doubles.data(), count, 5.0, 0.5);
+    EXPECT_LT(normalDistance(doubles, 5, 0.5), critical);
+
+    vector<float> floats(count);
+    fillNormal(rng, floats.data(), count);
+    EXPECT_LT(normalDistance(floats, 0, 1), critical);
+    fillNormal(rng, floats.data(), count, -3.0f, 2.0f);
+    EXPECT_LT(normalDistance(floats, -3, 2), critical);
+}
+
+TEST(Distributions, test_log_normal_matches_cdf)
+{
+    PRNG rng(constexprSeed);
+    const size_t count = 100000;
+    const double critical = 1.95 / sqrt(double(count));
+    vector<double> doubles(count);
+    fillLogNormal(rng, doubles.data(), count, 1.0, 0.5);
+    for(double &value : doubles)
+    {
+        ASSERT_GT(value, 0);
+        value = log(value);
+    }
+    EXPECT_LT(normalDistance(doubles, 1, 0.5), critical);
+
+    vector<float> floats(count);
+    fillLogNormal(rng, floats.data(), count);
+    for(float &value : floats)
+    {
+        ASSERT_GT(value, 0);
+        value = log(value);
+    }
+    EXPECT_LT(normalDistance(floats, 0, 1), critical);
+}
+
+/*
+ * Odd counts and counts that don't fill a whole pass must write every element and nothing past it.
+ */
+TEST(Distributions, test_normal_fills_exactly)
+{
+    PRNG rng(constexprSeed);
+    for(size_t count : {0, 1, 2, 3, 127, 255, 257, 1001})
+    {
+        vector<double> doubles(count + 1, 1e300);
+        vector<float> floats(count + 1, 1e30f);
+        fillNormal(rng, doubles.data(), count);
+        fillNormal(rng, floats.data(), count);
+        for(size_t i = 0; i < count; i++)
+        {
+            EXPECT_LT(fabs(doubles[i]), 10);
+            EXPECT_LT(fabs(floats[i]), 10);
+        }
+        EXPECT_EQ(1e300, doubles[count]);
+        EXPECT_EQ(1e30f, floats[count]);
+    }
+}
+
+/*
+ * Checks the sample mean and variance are within 5 standard errors of what they should be.
+ */
+template <class Distribution>
+void expectMoments(const Distribution &distribution, double mean, double variance)
+{
+    PRNG rng(constexprSeed);
+    const int samples = 200000;
+    vector<double> deviations(samples);
+    double sum = 0;
+    for(double &deviation : deviations)
+    {
+        // Measured from the true mean so huge values don't swamp the variance
+        deviation = static_cast<double>(distribution(rng)) - mean;
+        sum += deviation;
+    }
+    double meanError = sum / samples;
+    double sampleVariance = 0;
+    double fourthMoment = 0;
+    for(double deviation : deviations)
+    {
+        double squared = (deviation - meanError) * (deviation - meanError);
+        sampleVariance += squared / samples;
+        fourthMoment += squared * squared / samples;
+    }
+    EXPECT_NEAR(0, meanError, 5 * sqrt(variance / samples) + 1e-9 * fabs(mean));
+    // Rare events may not turn up at all, so the sampled error is floored by a Poisson-like one
+    double varianceError = sqrt(max(fourthMoment - sampleVariance * sampleVariance, variance) / samples);
+    EXPECT_NEAR(variance, sampleVariance, 5 * varianceError + 1e-9 * variance);
+}
+
+TEST(Distributions, test_poisson_moments)
+{
+    for(double mean : {0.0, 0.01, 1.0, 9.99, 10.0, 55.5, 1e6})
+    {
+        expectMoments(PoissonDistribution(mean), mean, mean);
+    }
+}
+
+TEST(Distributions, test_binomial_moments)
+{
+    const uint64_t trials[] = {0, 1, 20, 1000, 1000000, uint64_t(1) << 40};
+    for(uint64_t n : trials)
+    {
+        for(double p : {0.0, 1e-9, 0.003, 0.3, 0.5, 0.9, 1.0})
+        {
+            double count = static_cast<double>(n);
+            expectMoments(BinomialDistribution(n, p), count * p, count * p * (1 - p));
+        }
+    }
+}
+
+TEST(Distributions, test_gamma_moments)
+{
+    for(double shape : {0.05, 0.5, 1.0, 2.5, 100.0})
+    {
+        expectMoments(GammaDistribution(shape, 3), 3 * shape, 9 * shape);
+    }
+}
+
+/*
+ * The small mean table and the rejection sampler either side of the switch over should agree
+ * with the exact probabilities.
+ */
+TEST(Distributions, test_poisson_probabilities)
+{
+    PRNG rng(constexprSeed);
+    const int samples = 200000;
+    for(double mean : {3.0, 25.0})
+    {
+        vector<int> counts(100);
+        for(int i = 0; i < samples; i++)
+        {
+            uint64_t value = getRandomPoisson(rng, mean);
+            counts[min<uint64_t>(value, 99)]++;
+        }
+        for(int k = 0; k < 60; k++)
+        {
+            double expected = samples * exp(k * log(mean) - mean - lgamma(k + 1.0));
+            EXPECT_NEAR(expected, counts[k], 5 * sqrt(expected) + 2);
+        }
+    }
+}
+
+TEST(Distributions, test_binomial_probabilities)
+{
+    PRNG rng(constexprSeed);
+    const int samples = 200000;
+    const int n = 60;
+    for(double p : {0.05, 0.4, 0.85})
+    {
+        vector<int> counts(n + 1);
+        for(int i = 0; i < samples; i++)
+        {
+            counts[getRandomBinomial(rng, n, p)]++;
+        }
+        for(int k = 0; k <= n; k++)
+        {
+            double logChoose = lgamma(n + 1.0) - lgamma(k + 1.0) - lgamma(n - k + 1.0);
+            double expected = samples * exp(logChoose + k * log(p) + (n - k) * log1p(-p));
+            EXPECT_NEAR(expected, counts[k], 5 * sqrt(expected) + 2);
+        }
+    }
+}
+
+const double pi = 3.14159265358979323846;
+
+/*
+ * Kolmogorov-Smirnov distance between the samples and a uniform distribution on [0, 1].
+ */
+double uniformDistance(vector<double> samples)
+{
+    sort(samples.begin(), samples.end());
+    double distance = 0;
+    for(size_t i = 0; i < samples.size(); i++)
+    {
+        distance = max(distance, fabs(samples[i] - double(i) / samples.size()));
+        distance = max(distance, fabs(samples[i] - double(i + 1) / samples.size()));
+    }
+    return distance;
+}
+
+TEST(Geometry, test_sphere_and_ball)
+{
+    PRNG rng(constexprSeed);
+    const size_t count = 50001;
+    const double critical = 1.95 / sqrt(double(count));
+    vector<double> x(count), y(count), z(count);
+    vector<double> heights(count), angles(count), volumes(count);
+
+    fillUnitSphere3(rng, x.data(), y.data(), z.data(), count);
+    for(size_t i = 0; i < count; i++)
+    {
+        EXPECT_NEAR(1, x[i] * x[i] + y[i] * y[i] + z[i] * z[i], 1e-12);
+        // On the sphere both the height and the angle around it are uniform
+        heights[i] = (z[i] + 1) / 2;
+        angles[i] = (atan2(y[i], x[i]) + pi) / (2 * pi);
+    }
+    EXPECT_LT(uniformDistance(heights), critical);
+    EXPECT_LT(uniformDistance(angles), critical);
+
+    fillUnitBall3(rng, x.data(), y.data(), z.data(), count);
+    for(size_t i = 0; i < count; i++)
+    {
+        double radius = sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+        EXPECT_LE(radius, 1 + 1e-12);
+        // The fraction of the volume inside the radius
+        volumes[i] = radius * radius * radius;
+        heights[i] = (z[i] / radius + 1) / 2;
+    }
+    EXPECT_LT(uniformDistance(volumes), critical);
+    EXPECT_LT(uniformDistance(heights), critical);
+}
+
+TEST(Geometry, test_disc)
+{
+    PRNG rng(constexprSeed);
+    const size_t count = 50001;
+    const double critical = 1.95 / sqrt(double(count));
+    vector<float> x(count), y(count);
+    vector<double> areas(count), angles(count);
+    fillUnitDisc(rng, x.data(), y.data(), count);
+    for(size_t i = 0; i < count; i++)
+    {
+        areas[i] = double(x[i]) * x[i] + double(y[i]) * y[i];
+        EXPECT_LE(areas[i], 1 + 1e-6);
+        angles[i] = (atan2(double(y[i]), double(x[i])) + pi) / (2 * pi);
+    }
+    EXPECT_LT(uniformDistance(areas), critical);
+    EXPECT_LT(uniformDistance(angles), critical);
+}
+
+TEST(Geometry, test_simplex)
+{
+    PRNG rng(constexprSeed);
+    const size_t count = 50001;
+    const double critical = 1.95 / sqrt(double(count));
+    for(size_t dimensions : {1, 2, 5})
+    {
+        vector<vector<float>> columns(dimensions, vector<float>(count));
+        vector<float *> coordinates;
+        for(vector<float> &column : columns)
+        {
+            coordinates.push_back(column.data());
+        }
+        fillSimplex(rng, coordinates.data(), dimensions, count);
+
+        vector<double> marginal(count);
+        for(size_t i = 0; i < count; i++)
+        {
+            double sum = 0;
+            for(size_t d = 0; d < dimensions; d++)
+            {
+                EXPECT_GE(columns[d][i], 0);
+                sum += columns[d][i];
+            }
+            EXPECT_NEAR(1, sum, 1e-5);
+            // Each coordinate is Beta(1, dimensions - 1), turned uniform by its CDF
+            marginal[i] = 1 - pow(1 - double(columns[dimensions - 1][i]), double(dimensions - 1));
+        }
+        if(dimensions > 1)
+        {
+            EXPECT_LT(uniformDistance(marginal), critical);
+        }
+    }
+}
+
+/*
+ * Jumping is a linear function of the state, so it has to commute with stepping the generator.
+ */
+TEST(Jump, test_commutes_with_stepping)
+{
+    PRNG jumpedFirst(constexprSeed);
+    PRNG steppedFirst(constexprSeed);
+    jumpedFirst.jump();
+    for(int i = 0; i < 37; i++)
+    {
+        jumpedFirst.getRandomUint64();
+        steppedFirst.getRandomUint64();
+    }
+    steppedFirst.jump();
+    for(int i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(jumpedFirst.getRandomUint64(), steppedFirst.getRandomUint64());
+    }
+}
+
+TEST(Jump, test_changes_stream)
+{
+    PRNG original(constexprSeed);
+    PRNG jumped(constexprSeed);
+    jumped.jump();
+    int matches = 0;
+    for(int i = 0; i < 1000; i++)
+    {
+        matches += original.getRandomUint64() == jumped.getRandomUint64();
+    }
+    EXPECT_EQ(0, matches);
+}
+
+TEST(Shared, test_threads_get_distinct_numbers)
+{
+    PRNG::Shared &shared = PRNG::shared();
+    EXPECT_EQ(&shared, &PRNG::shared());
+    EXPECT_GE(shared.shardCount(), 1u);
+
+    const int threadCount = 8;
+    const int draws = 10000;
+    vector<vector<uint64_t> > results(threadCount);
+    vector<thread> threads;
+    for(int t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&results, t]() {
+            for(int i = 0; i < draws; i++)
+            {
+                results[t].push_back(PRNG::shared().getRandomUint64());
+            }
+        });
+    }
+    for(thread &t : threads)
+    {
+        t.join();
+    }
+
+    // Any repeat would mean two threads were handed the same state
+    set<uint64_t> seen;
+    for(const vector<uint64_t> &values : results)
+    {
+        seen.insert(values.begin(), values.end());
+    }
+    EXPECT_EQ(size_t(threadCount * draws), seen.size());
+}
+
+TEST(Shared, test_draw_and_bounds)
+{
+    PRNG::Shared &shared = PRNG::shared();
+    int total = shared.draw([](PRNG &rng) { return rng.getRandomInt(1, 6) + rng.getRandomInt(1, 6); });
+    EXPECT_GE(total, 2);
+    EXPECT_LE(total, 12);
+    for(int i = 0; i < 1000; i++)
+    {
+        EXPECT_LE(shared.getRandomUint64(9), 9u);
+        double unit = shared.getRandomDouble();
+        EXPECT_GE(unit, 0);
+        EXPECT_LT(unit, 1);
+    }
+    vector<int> data(100);
+    iota(data.begin(), data.end(), 0);
+    shuffle(data.begin(), data.end(), shared);
+    sort(data.begin(), data.end());
+    for(int i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(i, data[i]);
+    }
+}
+
+// Only returns if the refill threshold is one less than the capacity, so any draw wakes the producer
+void waitUntilFull(const PrefetchingPRNG &rng)
+{
+    while(rng.available() < rng.capacity())
+    {
+        this_thread::yield();
+    }
+}
+
+/*
+ * While the producer keeps up the words are exactly the ones PRNG would have produced.
+ */
+TEST(PrefetchingPRNG, test_matches_prng_when_prefetched)
+{
+    PrefetchingPRNG prefetching(constexprSeed, 1000, 1023);
+    EXPECT_EQ(1024u, prefetching.capacity());
+    PRNG rng(constexprSeed);
+    for(int pass = 0; pass < 5; pass++)
+    {
+        waitUntilFull(prefetching);
+        for(int i = 0; i < 1000; i++)
+        {
+            EXPECT_EQ(rng.getRandomUint64(), prefetching.getRandomUint64());
+        }
+    }
+}
+
+/*
+ * Draining a tiny ring faster than it's refilled falls back to generating inline, which must
+ * still give good numbers and let the producer catch up afterwards.
+ */
+TEST(PrefetchingPRNG, test_falls_back_when_empty)
+{
+    PrefetchingPRNG prefetching(constexprSeed, 4, 3);
+    set<uint64_t> seen;
+    const int draws = 100000;
+    for(int i = 0; i < draws; i++)
+    {
+        seen.insert(prefetching.getRandomUint64());
+    }
+    EXPECT_EQ(size_t(draws), seen.size());
+    waitUntilFull(prefetching);
+    EXPECT_EQ(4u, prefetching.available());
+}
+
+TEST(PrefetchingPRNG, test_typed_draws)
+{
+    PrefetchingPRNG prefetching;
+    for(int i = 0; i < 10000; i++)
+    {
+        int roll = prefetching.getRandomInt(1, 6);
+        EXPECT_GE(roll, 1);
+        EXPECT_LE(roll, 6);
+        double unit = prefetching.getRandomDouble();
+        EXPECT_GE(unit, 0);
+        EXPECT_LT(unit, 1);
+    }
+}
+
+TEST(PRNGEnsemble, test_step_all_matches_single_streams)
+{
+    PRNGEnsemble all(1000, 42);
+    PRNGEnsemble single(1000, 42);
+    vector<uint64_t> output(1000);
+    for(int round = 0; round < 10; round++)
+    {
+        all.stepAll(output.data());
+        for(size_t i = 0; i < 1000; i++)
+        {
+            EXPECT_EQ(single.getRandomUint64(i), output[i]);
+        }
+    }
+}
+
+/*
+ * A stream must depend only on the seed and its index, not on the ensemble size or batching.
+ */
+TEST(PRNGEnsemble, test_streams_independent_of_batching)
+{
+    PRNGEnsemble small(10, 7);
+    PRNGEnsemble large(100000, 7);
+    vector<uint64_t> smallOutput(10);
+    vector<uint64_t> largeOutput(100000);
+    for(int round = 0; round < 5; round++)
+    {
+        small.stepAll(smallOutput.data());
+        for(size_t first = 0; first < large.size(); first += 333)
+        {
+            size_t count = min<size_t>(333, large.size() - first);
+            large.stepRange(first, count, largeOutput.data() + first);
+        }
+        for(size_t i = 0; i < 10; i++)
+        {
+            EXPECT_EQ(smallOutput[i], largeOutput[i]);
+        }
+    }
+    EXPECT_NE(largeOutput[0], largeOutput[1]);
+}
+
+TEST(PRNGEnsemble, test_masked_steps_only_active)
+{
+    PRNGEnsemble masked(100, 3);
+    PRNGEnsemble reference(100, 3);
+    vector<uint8_t> active(100);
+    vector<uint64_t> output(100, 0);
+    for(int round = 0; round < 20; round++)
+    {
+        for(size_t i = 0; i < 100; i++)
+        {
+            active[i] = (i + round) % 3 == 0;
+        }
+        vector<uint64_t> previous = output;
+        masked.stepMasked(active.data(), output.data());
+        for(size_t i = 0; i < 100; i++)
+        {
+            EXPECT_EQ(active[i] ? reference.getRandomUint64(i) : previous[i], output[i]);
+        }
+    }
+}
+
+
+/*
+ * Runs fill at every level the CPU supports and checks each matches the generic kernels. Only
+ * rounding may differ, since the wider levels can contract multiplies and adds into FMAs.
+ */
+template <class T, class Fill>
+void expectSameAtEveryLevel(Fill fill, double tolerance)
+{
+    prng_dispatch::Level original = prng_dispatch::activeLevel();
+    prng_dispatch::setLevel(prng_dispatch::generic);
+    vector<T> expected = fill();
+    for(int level = prng_dispatch::avx2; level <= prng_dispatch::supportedLevel(); level++)
+    {
+        prng_dispatch::setLevel(static_cast<prng_dispatch::Level>(level));
+        vector<T> actual = fill();
+        ASSERT_EQ(expected.size(), actual.size());
+        for(size_t i = 0; i < expected.size(); i++)
+        {
+            EXPECT_NEAR(expected[i], actual[i], tolerance * max(1.0, fabs(double(expected[i]))))
+                << prng_dispatch::levelName(static_cast<prng_dispatch::Level>(level)) << " at " << i;
+        }
+    }
+    prng_dispatch::setLevel(original);
+}
+
+TEST(Dispatch, test_set_level_is_clamped)
+{
+    prng_dispatch::Level original = prng_dispatch::activeLevel();
+    EXPECT_EQ(prng_dispatch::generic, prng_dispatch::setLevel(prng_dispatch::generic));
+    EXPECT_EQ(prng_dispatch::generic, prng_dispatch::activeLevel());
+    EXPECT_EQ(prng_dispatch::supportedLevel(), prng_dispatch::setLevel(prng_dispatch::avx512));
+    EXPECT_LE(original, prng_dispatch::supportedLevel());
+    prng_dispatch::setLevel(original);
+}
+
+TEST(Dispatch, test_distributions_match_generic)
+{
+    expectSameAtEveryLevel<double>([]()
+    {
+        PRNG rng(constexprSeed);
+        vector<double> output(1001);
+        fillLogNormal(rng, output.data(), output.size(), 0.5, 2.0);
+        return output;
+    }, 1e-12);
+    expectSameAtEveryLevel<float>([]()
+    {
+        PRNG rng(constexprSeed);
+        vector<float> output(1001);
+        fillLogNormal(rng, output.data(), output.size(), 0.5f, 2.0f);
+        return output;
+    }, 1e-5);
+}
+
+TEST(Dispatch, test_geometry_matches_generic)
+{
+    expectSameAtEveryLevel<double>([]()
+    {
+        PRNG rng(constexprSeed);
+        const size_t count = 700;
+        vector<double> output(8 * count);
+        double *coordinates[2] = {&output[6 * count], &output[7 * count]};
+        fillUnitSphere3(rng, &output[0], &output[count], &output[2 * count], count);
+        fillUnitBall3(rng, &output[3 * count], &output[4 * count], &output[5 * count], count);
+        fillSimplex(rng, coordinates, 2, count);
+        return output;
+    }, 1e-12);
+    expectSameAtEveryLevel<float>([]()
+    {
+        PRNG rng(constexprSeed);
+        const size_t count = 700;
+        vector<float> output(2 * count);
+        fillUnitDisc(rng, &output[0], &output[count], count);
+        return output;
+    }, 1e-5);
+}
+
+TEST(Dispatch, test_ensemble_matches_generic)
+{
+    expectSameAtEveryLevel<uint64_t>([]()
+    {
+        PRNGEnsemble ensemble(1000, 11);
+        vector<uint8_t> active(1000);
+        vector<uint64_t> output(2000, 0);
+        for(size_t i = 0; i < active.size(); i++)
+        {
+            active[i] = i % 5 != 0;
+        }
+        ensemble.stepAll(output.data());
+        ensemble.stepMasked(active.data(), output.data() + 1000);
+        return output;
+    }, 0);
+}
+
+
+// The first words of keystream from the all zero key and nonce, as published for each round count
+TEST(ChaChaPRNG, test_zero_key_vectors)
+{
+    const array<uint64_t, 4> zeroKey = {{0, 0, 0, 0}};
+    ChaCha8PRNG chacha8(zeroKey, 0);
+    ChaCha12PRNG chacha12(zeroKey, 0);
+    ChaCha20PRNG chacha20(zeroKey, 0);
+    const uint64_t expected8[4] = {0xd6405f892fef003e, 0xa1a5091fe8b85b7f, 0x3b7f9acec30e842c, 0x1e1a71ef88e11b18};
+    const uint64_t expected12[4] = {0x53f955076a9af49b, 0xd583265f12ce1f81, 0x1474e049bbc32904, 0x5f15ae2ea589007e};
+    const uint64_t expected20[4] = {0x903df1a0ade0b876, 0x28bd8653e56a5d40, 0x1aed8da0b819d2bd, 0xc70d778bccef36a8};
+    for(int i = 0; i < 4; i++)
+    {
+        EXPECT_EQ(expected8[i], chacha8.getRandomUint64());
+        EXPECT_EQ(expected12[i], chacha12.getRandomUint64());
+        EXPECT_EQ(expected20[i], chacha20.getRandomUint64());
+    }
+}
+
+// Block 1000 of a keyed stream, checked for ChaCha20 against OpenSSL's chacha20
+TEST(ChaChaPRNG, test_seek_keyed_vectors)
+{
+    const array<uint64_t, 4> key = {{0x0123456789abcdef, 0xfedcba9876543210, 0x0f1e2d3c4b5a6978, 0x8796a5b4c3d2e1f0}};
+    const uint64_t stream = 0x1122334455667788;
+    ChaCha8PRNG chacha8(key, stream);
+    ChaCha12PRNG chacha12(key, stream);
+    ChaCha20PRNG chacha20(key, stream);
+    chacha8.seek(1000);
+    chacha12.seek(1000);
+    chacha20.seek(1000);
+    const uint64_t expected8[4] = {0x987a52cd47ddcd91, 0x97e136fecb7f84c9, 0x2f342a9fe9aa153d, 0x9bfc59a3d0453caa};
+    const uint64_t expected12[4] = {0x53e4ebac474eb428, 0x878c30d5dd187d3b, 0xe9d8f81cb07e6c4a, 0xdb3400259ed71a76};
+    const uint64_t expected20[4] = {0xe1e211bf97908843, 0xa6a5aa643fb0e5ae, 0x04f7d1d8f40bc630, 0x44d3eb32adeffce2};
+    for(int i = 0; i < 4; i++)
+    {
+        EXPECT_EQ(expected8[i], chacha8.getRandomUint64());
+        EXPECT_EQ(expected12[i], chacha12.getRandomUint64());
+        EXPECT_EQ(expected20[i], chacha20.getRandomUint64());
+    }
+}
+
+TEST(ChaChaPRNG, test_seek_matches_stepping)
+{
+    ChaCha8PRNG stepped(constexprSeed);
+    ChaCha8PRNG seeked(constexprSeed);
+    for(uint64_t block : {0, 3, 16, 37, 300})
+    {
+        stepped.setSeed(constexprSeed);
+        for(uint64_t i = 0; i < 8 * block; i++)
+        {
+            stepped.getRandomUint64();
+        }
+        seeked.seek(block);
+        for(int i = 0; i < 20; i++)
+        {
+            EXPECT_EQ(stepped.getRandomUint64(), seeked.getRandomUint64());
+        }
+    }
+}
+
+TEST(ChaChaPRNG, test_fill_matches_scalar)
+{
+    ChaCha12PRNG filled(constexprSeed);
+    ChaCha12PRNG scalar(constexprSeed);
+    vector<uint64_t> output(1000);
+    for(size_t count : {1, 5, 127, 128, 129, 300, 1000})
+    {
+        filled.fillUint64(output.data(), count);
+        for(size_t i = 0; i < count; i++)
+        {
+            EXPECT_EQ(scalar.getRandomUint64(), output[i]);
+        }
+    }
+}
+
+TEST(ChaChaPRNG, test_streams_and_typed_draws)
+{
+    array<uint64_t, 16> otherStream = constexprSeed;
+    otherStream[4]++;
+    ChaCha20PRNG rng(constexprSeed);
+    ChaCha20PRNG other(otherStream);
+    EXPECT_NE(rng.getRandomUint64(), other.getRandomUint64());
+
+    vector<int> deck(52);
+    iota(deck.begin(), deck.end(), 0);
+    shuffle(deck.begin(), deck.end(), rng);
+    EXPECT_FALSE(is_sorted(deck.begin(), deck.end()));
+    sort(deck.begin(), deck.end());
+    for(int i = 0; i < 52; i++)
+    {
+        EXPECT_EQ(i, deck[i]);
+    }
+    for(int i = 0; i < 1000; i++)
+    {
+        EXPECT_LE(rng.getRandomUint64(51), 51u);
+        double unit = rng.getRandomDouble();
+        EXPECT_GE(unit, 0);
+        EXPECT_LT(unit, 1);
+    }
+}
+
+TEST(Dispatch, test_chacha_matches_generic)
+{
+    expectSameAtEveryLevel<uint64_t>([]()
+    {
+        ChaCha8PRNG rng(constexprSeed);
+        vector<uint64_t> output(1000);
+        rng.fillUint64(output.data(), output.size());
+        return output;
+    }, 0);
+}
+
+
+TEST(QuasiRandom, test_first_points)
+{
+    SobolSequence sobol(2);
+    HaltonSequence halton(2);
+    const double expectedSobol[4][2] = {{0, 0}, {0.5, 0.5}, {0.75, 0.25}, {0.25, 0.75}};
+    const double expectedHalton[4][2] = {{0, 0}, {0.5, 1.0 / 3}, {0.25, 2.0 / 3}, {0.75, 1.0 / 9}};
+    for(int i = 0; i < 4; i++)
+    {
+        for(int d = 0; d < 2; d++)
+        {
+            EXPECT_EQ(expectedSobol[i][d], sobol.getRandomDouble());
+            EXPECT_NEAR(expectedHalton[i][d], halton.getRandomDouble(), 1e-15);
+        }
+    }
+}
+
+template <class Sequence>
+void expectRandomAccessMatches(Sequence &sequence)
+{
+    const size_t dimensions = sequence.dimensions();
+    vector<double> point(dimensions);
+    for(uint64_t start : {0, 1, 2, 1000, 12345})
+    {
+        sequence.seek(start);
+        for(uint64_t i = start; i < start + 100; i++)
+        {
+            EXPECT_EQ(i, sequence.index());
+            sequence.getPoint(i, point.data());
+            for(size_t d = 0; d < dimensions; d++)
+            {
+                EXPECT_EQ(point[d], sequence.getRandomDouble());
+            }
+        }
+    }
+}
+
+TEST(QuasiRandom, test_random_access_matches_sequential)
+{
+    PRNG rng(constexprSeed);
+    SobolSequence sobol(40);
+    SobolSequence scrambledSobol(40, rng);
+    HaltonSequence halton(40);
+    HaltonSequence scrambledHalton(40, rng);
+    expectRandomAccessMatches(sobol);
+    expectRandomAccessMatches(scrambledSobol);
+    expectRandomAccessMatches(halton);
+    expectRandomAccessMatches(scrambledHalton);
+}
+
+TEST(QuasiRandom, test_fill_points_matches_draws)
+{
+    PRNG rng1(constexprSeed), rng2(constexprSeed);
+    SobolSequence filled(3, rng1);
+    SobolSequence drawn(3, rng2);
+    vector<float> x(500), y(500), z(500);
+    float *coordinates[3] = {x.data(), y.data(), z.data()};
+    filled.fillPoints(coordinates, 500);
+    EXPECT_EQ(500u, filled.index());
+    for(size_t i = 0; i < 500; i++)
+    {
+        EXPECT_EQ(x[i], drawn.getRandomFloat());
+        EXPECT_EQ(y[i], drawn.getRandomFloat());
+        EXPECT_EQ(z[i], drawn.getRandomFloat());
+    }
+
+    // The unread coordinates of a partly drawn point are skipped
+    float point[3];
+    drawn.seek(0);
+    drawn.getRandomFloat();
+    drawn.fillPoints(coordinates, 1);
+    drawn.getPoint(1, point);
+    EXPECT_EQ(point[0], x[0]);
+    EXPECT_EQ(point[2], z[0]);
+}
+
+/*
+ * Owen scrambling must keep the sequence's stratification: the first 2^k points of every
+ * dimension have exactly one point in each interval of width 2^-k.
+ */
+TEST(QuasiRandom, test_scrambled_sobol_is_stratified)
+{
+    PRNG rng(constexprSeed);
+    SobolSequence unscrambled(10);
+    SobolSequence scrambled(10, rng);
+    const size_t points = 256;
+    vector<double> point(10);
+    vector<vector<int> > counts(10, vector<int>(points));
+    bool changed = false;
+    for(size_t i = 0; i < points; i++)
+    {
+        scrambled.getPoint(i, point.data());
+        for(size_t d = 0; d < 10; d++)
+        {
+            ASSERT_GE(point[d], 0);
+            ASSERT_LT(point[d], 1);
+            counts[d][static_cast<size_t>(point[d] * points)]++;
+            changed = changed || point[d] != unscrambled.getRandomDouble();
+        }
+    }
+    EXPECT_TRUE(changed);
+    for(size_t d = 0; d < 10; d++)
+    {
+        EXPECT_EQ(vector<int>(points, 1), counts[d]);
+    }
+}
+
+/*
+ * The integral over [0, 1]^5 of the product of (pi / 2) sin(pi x) is 1. The quasi-random estimates
+ * should be far closer than the roughly 2e-2 error of 4096 pseudo-random samples.
+ */
+template <class Sequence>
+double sineProductIntegral(Sequence &sequence)
+{
+    double total = 0;
+    for(int i = 0; i < 4096; i++)
+    {
+        double product = 1;
+        for(int d = 0; d < 5; d++)
+        {
+            product *= pi / 2 * sin(pi * sequence.getRandomDouble());
+        }
+        total += product;
+    }
+    return total / 4096;
+}
+
+TEST(QuasiRandom, test_integration_converges)
+{
+    PRNG rng(constexprSeed);
+    SobolSequence sobol(5, rng);
+    HaltonSequence halton(5, rng);
+    EXPECT_NEAR(1, sineProductIntegral(sobol), 5e-3);
+    EXPECT_NEAR(1, sineProductIntegral(halton), 5e-3);
+}
+
+// Without PRNG_RECORDING, RecordingPRNG is PRNG and PRNG_DRAW is the plain call
+TEST(RecordingPRNG, test_compiles_out_by_default)
+{
+    static_assert(std::is_same<RecordingPRNG, PRNG>::value, "RecordingPRNG should be PRNG when not recording");
+    RecordingPRNG recording(constexprSeed);
+    PRNG plain(constexprSeed);
+    EXPECT_EQ(plain.getRandomDouble(), PRNG_DRAW(recording, 1, getRandomDouble()));
+    EXPECT_EQ(plain.getRandomInt(0, 6), PRNG_DRAW(recording, 2, getRandomInt(0, 6)));
+    EXPECT_EQ(plain.getRandomUint64(), recording.getRandomUint64());
+}
+
+TEST(Substreams, test_workers_are_jumps_apart)
+{
+    for(uint32_t worker = 0; worker < 6; worker++)
+    {
+        PRNG jumped(constexprSeed);
+        for(uint32_t i = 0; i < worker; i++)
+        {
+            jumped.jump();
+        }
+        PRNG derived = substream(constexprSeed, StreamId{0, 0, worker});
+        for(int i = 0; i < 20; i++)
+        {
+            EXPECT_EQ(jumped.getRandomUint64(), derived.getRandomUint64());
+        }
+    }
+}
+
+TEST(Substreams, test_levels_are_independent)
+{
+    // Jumping by 2^32 streams one at a time is out of the question, so check the polynomials
+    // compose instead: node 1 is 2^32 worker streams along, i.e. worker 2^31 jumped twice over
+    PRNG halfway = substream(constexprSeed, StreamId{0, 0, 1u << 31});
+    halfway.jump(prng_detail::streamJumps()[31]);
+    EXPECT_EQ(substream(constexprSeed, StreamId{0, 1, 0}).getState(), halfway.getState());
+
+    set<uint64_t> firsts;
+    for(uint32_t job = 0; job < 3; job++)
+    {
+        for(uint32_t node = 0; node < 3; node++)
+        {
+            for(uint32_t worker = 0; worker < 3; worker++)
+            {
+                firsts.insert(substream(constexprSeed, StreamId{job, node, worker}).getRandomUint64());
+            }
+        }
+    }
+    EXPECT_EQ(27u, firsts.size());
+}
+
+TEST(Substreams, test_coordinator_hands_out_workers)
+{
+    const string name = "/prng-tests-coordinator";
+    StreamCoordinator::remove(name);
+    {
+        StreamCoordinator first(name, 7, 2);
+        StreamCoordinator second(name, 7, 2);
+        EXPECT_EQ(first.seed(), second.seed());
+        StreamId a = first.claim();
+        StreamId b = second.claim();
+        EXPECT_EQ(7u, a.job);
+        EXPECT_EQ(2u, a.node);
+        EXPECT_EQ(0u, a.worker);
+        EXPECT_EQ(1u, b.worker);
+        PRNG stream = first.claimStream();
+        EXPECT_EQ(substream(first.seed(), StreamId{7, 2, 2}).getState(), stream.getState());
+        EXPECT_THROW(StreamCoordinator(name, constexprSeed, 7), std::system_error);
+    }
+    StreamCoordinator::remove(name);
+
+    StreamCoordinator seeded(name, constexprSeed, 0);
+    EXPECT_EQ(constexprSeed, seeded.seed());
+    EXPECT_EQ(0u, seeded.claim().worker);
+    StreamCoordinator::remove(name);
+}
+
+// A creator that fails part way must remove the segment, or later processes wait on it and give up
+TEST(Substreams, test_failed_coordinator_is_removed)
+{
+    const string name = "/prng-tests-coordinator-failed";
+    StreamCoordinator::remove(name);
+    // Shared memory counts as a file, so a zero size limit makes sizing it fail
+    rlimit original;
+    ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &original));
+    rlimit none = original;
+    none.rlim_cur = 0;
+    void (*handler)(int) = signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &none));
+    EXPECT_THROW(StreamCoordinator(name, 7, 0), std::system_error);
+    setrlimit(RLIMIT_FSIZE, &original);
+    signal(SIGXFSZ, handler);
+
+    StreamCoordinator coordinator(name, constexprSeed, 7);
+    EXPECT_EQ(constexprSeed, coordinator.seed());
+    StreamCoordinator::remove(name);
+}
+
+TEST(SharedPool, test_stream_at_matches_stepping)
+{
+    PRNG stepped(constexprSeed);
+    for(uint64_t position = 0; position < 40; position++)
+    {
+        EXPECT_EQ(stepped.getRandomUint64(), streamAt(constexprSeed, position).getRandomUint64());
+    }
+}
+
+TEST(SharedPool, test_consumers_get_reproducible_chunks)
+{
+    string path = testing::TempDir() + "prng_pool";
+    const size_t chunkWords = 100;
+    SharedRandomPool producer(path, constexprSeed, chunkWords, 4, 1000);
+    SharedRandomPool first(path);
+    SharedRandomPool second(path);
+    EXPECT_EQ(constexprSeed, second.seed());
+    EXPECT_EQ(1000u, second.offset());
+    EXPECT_EQ(chunkWords, second.chunkWords());
+
+    producer.produce(4);
+    set<uint64_t> indices;
+    for(int round = 0; round < 3; round++)
+    {
+        for(SharedRandomPool *consumer : {&first, &second, &first, &second})
+        {
+            SharedRandomPool::Chunk chunk = consumer->acquire();
+            indices.insert(chunk.index());
+            ASSERT_EQ(chunkWords, chunk.size());
+            PRNG expected = streamAt(constexprSeed, consumer->chunkPosition(chunk.index()));
+            for(size_t i = 0; i < chunk.size(); i++)
+            {
+                EXPECT_EQ(expected.getRandomUint64(), chunk.data()[i]);
+            }
+        }
+        producer.produce(4);
+    }
+    {
+        // Moving hands the slot over and leaves nothing to read in the original
+        SharedRandomPool::Chunk original = first.acquire();
+        SharedRandomPool::Chunk moved(std::move(original));
+        EXPECT_EQ(0u, original.size());
+        EXPECT_TRUE(original.data() == nullptr);
+        EXPECT_EQ(chunkWords, moved.size());
+        EXPECT_EQ(12u, moved.index());
+    }
+    EXPECT_EQ(12u, indices.size());
+    EXPECT_EQ(11u, *indices.rbegin());
+    remove(path.c_str());
+    EXPECT_THROW(SharedRandomPool(testing::TempDir() + "no/such/dir/pool"), std::system_error);
+}
+
+TEST(SharedPool, test_concurrent_consumers)
+{
+    string path = testing::TempDir() + "prng_pool_threads";
+    const size_t chunkWords = 64;
+    const int chunksEach = 200;
+    SharedRandomPool producer(path, constexprSeed, chunkWords, 8);
+    vector<vector<uint64_t> > sums(3);
+    vector<thread> consumers;
+    for(int t = 0; t < 3; t++)
+    {
+        consumers.emplace_back([&, t]() {
+            SharedRandomPool pool(path);
+            for(int i = 0; i < chunksEach; i++)
+            {
+                SharedRandomPool::Chunk chunk = pool.acquire();
+                sums[t].push_back(chunk.index() << 32 | accumulate(chunk.data(), chunk.data() + chunk.size(), uint64_t(0)) >> 32);
+            }
+        });
+    }
+    producer.produce(3 * chunksEach);
+    for(thread &consumer : consumers)
+    {
+        consumer.join();
+    }
+
+    // Every chunk went to exactly one consumer and holds its stretch of the stream
+    vector<uint64_t> all;
+    for(const vector<uint64_t> &consumerSums : sums)
+    {
+        all.insert(all.end(), consumerSums.begin(), consumerSums.end());
+    }
+    sort(all.begin(), all.end());
+    PRNG stream(constexprSeed);
+    vector<uint64_t> words(chunkWords);
+    for(uint64_t index = 0; index < all.size(); index++)
+    {
+        stream.fillUint64(words.data(), chunkWords);
+        EXPECT_EQ(index << 32 | accumulate(words.begin(), words.end(), uint64_t(0)) >> 32, all[index]);
+    }
+    remove(path.c_str());
+}
+
+TEST(Tokens, test_uuid4_format)
+{
+    PRNG rng(constexprSeed);
+    ChaCha20PRNG cipher(constexprSeed);
+    const size_t count = 100;
+    vector<char> output(2 * count * uuid4Length + 1, '#');
+    uuid4Bulk(rng, output.data(), count);
+    uuid4Bulk(cipher, output.data() + count * uuid4Length, count);
+    EXPECT_EQ('#', output.back());
+
+    set<string> seen;
+    for(size_t i = 0; i < 2 * count; i++)
+    {
+        string uuid(output.data() + i * uuid4Length, uuid4Length);
+        for(size_t j = 0; j < uuid4Length; j++)
+        {
+            if(j == 8 || j == 13 || j == 18 || j == 23)
+            {
+                EXPECT_EQ('-', uuid[j]) << uuid;
+            }
+            else
+            {
+                EXPECT_TRUE(isdigit(uuid[j]) || (uuid[j] >= 'a' && uuid[j] <= 'f')) << uuid;
+            }
+        }
+        EXPECT_EQ('4', uuid[14]) << uuid;
+        EXPECT_NE(string::npos, string("89ab").find(uuid[19])) << uuid;
+        seen.insert(uuid);
+    }
+    EXPECT_EQ(2 * count, seen.size());
+}
+
+// Every character of the alphabet comes up about equally often, whichever way it's mapped
+TEST(Tokens, test_random_strings_are_uniform)
+{
+    const string alphabets[] = {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", "0123456789abcdef",
+                                "qwertyuiopasdfghjklzxcvbnm", "xy"};
+    for(const string &alphabet : alphabets)
+    {
+        PRNG rng(constexprSeed);
+        const size_t length = 23;
+        const size_t count = 3001;
+        vector<char> output(length * count + 1, '#');
+        randomStrings(rng, alphabet, length, count, output.data());
+        EXPECT_EQ('#', output.back());
+
+        vector<double> frequencies(256);
+        for(size_t i = 0; i < length * count; i++)
+        {
+            ASSERT_NE(string::npos, alphabet.find(output[i])) << alphabet;
+            frequencies[static_cast<unsigned char>(output[i])]++;
+        }
+        double expected = double(length * count) / alphabet.size();
+        double chiSquared = 0;
+        for(char character : alphabet)
+        {
+            double difference = frequencies[static_cast<unsigned char>(character)] - expected;
+            chiSquared += difference * difference / expected;
+        }
+        // Far beyond the 99.99th percentile for these degrees of freedom
+        EXPECT_LT(chiSquared, alphabet.size() + 6 * sqrt(2.0 * alphabet.size()) + 10) << alphabet;
+    }
+}
+
+TEST(Dispatch, test_tokens_match_generic)
+{
+    expectSameAtEveryLevel<char>([]()
+    {
+        PRNG rng(constexprSeed);
+        const size_t count = 300;
+        vector<char> output(count * (uuid4Length + 22 + 26));
+        uuid4Bulk(rng, output.data(), count);
+        randomStrings(rng, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", 22, count,
+                      output.data() + count * uuid4Length);
+        randomStrings(rng, "abcdefghijklmnopqrstuvwxyz234567", 26, count, output.data() + count * (uuid4Length + 22));
+        return output;
+    }, 0);
+}
+
+// Stochastic rounding is the input on average, and exact values come back unchanged
+TEST(StochasticRounding, test_rounding_is_unbiased)
+{
+    const float values[] = {1.33333333f, -3.14159265f, 1e-6f, -3e-7f, 6.1e-5f, 65000.5f};
+    const size_t count = 1 << 16;
+    for(float value : values)
+    {
+        PRNG rng(constexprSeed);
+        vector<float> input(count, value);
+        vector<BFloat16> bfloats(count);
+        vector<Half> halves(count);
+        stochasticRound(rng, input.data(), bfloats.data(), count);
+        stochasticRound(rng, input.data(), halves.data(), count);
+        double bfloatTotal = 0;
+        double halfTotal = 0;
+        for(size_t i = 0; i < count; i++)
+        {
+            bfloatTotal += toFloat(bfloats[i]);
+            halfTotal += toFloat(halves[i]);
+        }
+        // Each result is one of the two neighbours, a place or less apart, so the mean's error is a fraction of that
+        EXPECT_NEAR(value, bfloatTotal / count, fabs(value) * 1e-4) << value;
+        EXPECT_NEAR(value, halfTotal / count, max(fabs(value) * 2e-5, 1e-9)) << value;
+    }
+
+    PRNG rng(constexprSeed);
+    vector<float> input(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        input[i] = (static_cast<float>(i) - count / 2) / 3000.0f;
+    }
+    vector<int8_t> quantized(count);
+    stochasticRound(rng, input.data(), quantized.data(), count, 3.0f);
+    double error = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        EXPECT_LE(fabs(quantized[i] - input[i] * 3.0), 1.0) << input[i];
+        error += quantized[i] - input[i] * 3.0;
+    }
+    EXPECT_NEAR(0, error / count, 0.01);
+
+    const float exact[] = {0, 1, -2.5f, 1024, 0.0009765625f, -65280, 5.9604644775390625e-8f};
+    for(float value : exact)
+    {
+        BFloat16 bfloat;
+        Half half;
+        int8_t integer;
+        stochasticRound(rng, &value, &bfloat, 1);
+        stochasticRound(rng, &value, &half, 1);
+        EXPECT_EQ(value, toFloat(bfloat));
+        EXPECT_EQ(value, toFloat(half));
+        float scaled = value / 1024;
+        stochasticRound(rng, &scaled, &integer, 1, 8192);
+        if(value * 8 == floor(value * 8))
+        {
+            EXPECT_EQ(max(-128.0f, min(127.0f, value * 8)), integer);
+        }
+    }
+}
+
+TEST(StochasticRounding, test_special_values)
+{
+    PRNG rng(constexprSeed);
+    const float infinity = numeric_limits<float>::infinity();
+    const float input[] = {infinity, -infinity, numeric_limits<float>::quiet_NaN(), -0.0f, 1e30f, -70000, 200, -200};
+    const size_t count = sizeof(input) / sizeof(input[0]);
+    BFloat16 bfloats[count];
+    Half halves[count];
+    int8_t integers[count];
+    stochasticRound(rng, input, bfloats, count);
+    stochasticRound(rng, input, halves, count);
+    stochasticRound(rng, input, integers, count);
+
+    const uint16_t expectedHalves[] = {0x7c00, 0xfc00, 0x7e00, 0x8000, 0x7c00, 0xfc00, 0x5a40, 0xda40};
+    const int8_t expectedIntegers[] = {127, -128, 0, 0, 127, -128, 127, -128};
+    for(size_t i = 0; i < count; i++)
+    {
+        EXPECT_EQ(expectedHalves[i], halves[i].bits) << input[i];
+        EXPECT_EQ(expectedIntegers[i], integers[i]) << input[i];
+    }
+    EXPECT_EQ(0x7f80, bfloats[0].bits);
+    EXPECT_EQ(0xff80, bfloats[1].bits);
+    EXPECT_TRUE(std::isnan(toFloat(bfloats[2])));
+    EXPECT_EQ(0x8000, bfloats[3].bits);
+    EXPECT_TRUE(std::isnan(toFloat(Half{0x7e00})));
+    EXPECT_EQ(-infinity, toFloat(Half{0xfc00}));
+}
+
+// Values a format holds exactly, including both zeros, must come back unchanged every time
+TEST(StochasticRounding, test_exact_values_are_deterministic)
+{
+    PRNG rng(constexprSeed);
+    const size_t count = 1 << 18;
+    vector<float> input(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        input[i] = i % 4 == 0 ? 0.0f : i % 4 == 1 ? -0.0f : static_cast<float>(static_cast<int>(i % 256) - 128);
+    }
+    vector<int8_t> integers(count);
+    vector<Half> halves(count);
+    vector<BFloat16> bfloats(count);
+    stochasticRound(rng, input.data(), integers.data(), count);
+    stochasticRound(rng, input.data(), halves.data(), count);
+    stochasticRound(rng, input.data(), bfloats.data(), count);
+    for(size_t i = 0; i < count; i++)
+    {
+        ASSERT_EQ(input[i], integers[i]) << i;
+        ASSERT_EQ(fastmath::toBits(input[i]), fastmath::toBits(toFloat(halves[i]))) << i;
+        ASSERT_EQ(fastmath::toBits(input[i]), fastmath::toBits(toFloat(bfloats[i]))) << i;
+    }
+
+    // Scaled, the integers are halves of what they round to
+    vector<float> scaled(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        scaled[i] = input[i] / 2;
+    }
+    stochasticRound(rng, scaled.data(), integers.data(), count, 2);
+    for(size_t i = 0; i < count; i++)
+    {
+        ASSERT_EQ(input[i], integers[i]) << i;
+    }
+}
+
+// The results depend only on the seed, however the array is split into calls of multiples of 4
+TEST(StochasticRounding, test_chunking_is_reproducible)
+{
+    const size_t count = 5003;
+    vector<float> input(count);
+    PRNG values(constexprSeed);
+    for(float &value : input)
+    {
+        value = values.getRandomFloat(-100, 100);
+    }
+
+    PRNG whole(constexprSeed);
+    vector<Half> expected(count);
+    stochasticRound(whole, input.data(), expected.data(), count);
+
+    PRNG chunked(constexprSeed);
+    vector<Half> actual(count);
+    const size_t splits[] = {0, 4, 1028, 4100, count};
+    for(size_t i = 0; i + 1 < sizeof(splits) / sizeof(splits[0]); i++)
+    {
+        stochasticRound(chunked, input.data() + splits[i], actual.data() + splits[i], splits[i + 1] - splits[i]);
+    }
+    for(size_t i = 0; i < count; i++)
+    {
+        EXPECT_EQ(expected[i].bits, actual[i].bits) << i;
+    }
+}
+
+TEST(Dispatch, test_stochastic_rounding_matches_generic)
+{
+    expectSameAtEveryLevel<int>([]()
+    {
+        PRNG rng(constexprSeed);
+        const size_t count = 3000;
+        vector<float> input(count);
+        for(size_t i = 0; i < count; i++)
+        {
+            // Every binade from subnormal halves up to past the largest, and some out of range
+            input[i] = rng.getRandomFloat(-1, 1) * ldexp(1.0f, static_cast<int>(i % 60) - 30);
+        }
+        vector<BFloat16> bfloats(count);
+        vector<Half> halves(count);
+        vector<int8_t> integers(count);
+        stochasticRound(rng, input.data(), bfloats.data(), count);
+        stochasticRound(rng, input.data(), halves.data(), count);
+        stochasticRound(rng, input.data(), integers.data(), count, 50);
+        vector<int> output;
+        for(size_t i = 0; i < count; i++)
+        {
+            output.push_back(bfloats[i].bits);
+            output.push_back(halves[i].bits);
+            output.push_back(integers[i]);
+        }
+        return output;
+    }, 0);
+}
+
+TEST(MonteCarlo, test_estimates_with_standard_error)
+{
+    // The fraction of the unit square inside the quarter circle is pi / 4
+    MonteCarloResult result = monteCarlo(1000000, constexprSeed, [](PRNG &rng)
+    {
+        double x = rng.getRandomDouble();
+        double y = rng.getRandomDouble();
+        return x * x + y * y < 1 ? 1.0 : 0.0;
+    }, 2, 10000);
+    const double quarterPi = atan(1.0);
+    double variance = quarterPi * (1 - quarterPi);
+    EXPECT_EQ(1000000U, result.samples);
+    EXPECT_NEAR(variance, result.variance, 1e-3);
+    EXPECT_NEAR(sqrt(variance / 1e6), result.standardError, 1e-6);
+    EXPECT_NEAR(quarterPi, result.mean, 5 * result.standardError);
+    EXPECT_GT(result.samplesPerSecond, 0);
+
+    // Chunk k runs on PRNG(seed) jumped k times
+    PRNG rng(constexprSeed);
+    rng.jump();
+    double second = 0;
+    for(int i = 0; i < 5; i++)
+    {
+        second += rng.getRandomDouble();
+    }
+    MonteCarloResult chunks = monteCarlo(10, constexprSeed, [](PRNG &chunkRng)
+    {
+        return chunkRng.getRandomDouble();
+    }, 1, 5);
+    PRNG first(constexprSeed);
+    double total = second;
+    for(int i = 0; i < 5; i++)
+    {
+        total += first.getRandomDouble();
+    }
+    EXPECT_NEAR(total / 10, chunks.mean, 1e-15);
+}
+
+// The chunks' moments are combined in a fixed order, so threads and stealing can't change a bit of the result
+TEST(MonteCarlo, test_results_are_identical_for_any_thread_count)
+{
+    auto sample = [](PRNG &rng)
+    {
+        return 1e6 + rng.getRandomDouble(-1, 1) * rng.getRandomDouble();
+    };
+    MonteCarloResult expected = monteCarlo(300001, constexprSeed, sample, 1, 1000);
+    for(unsigned threads : {2U, 3U, 8U, 0U})
+    {
+        MonteCarloResult result = monteCarlo(300001, constexprSeed, sample, threads, 1000);
+        EXPECT_EQ(expected.mean, result.mean) << threads;
+        EXPECT_EQ(expected.variance, result.variance) << threads;
+        EXPECT_EQ(expected.standardError, result.standardError) << threads;
+    }
+    // The variance of the product is 1/9, which the shift keeps from being lost beside the mean of 10^6
+    EXPECT_NEAR(1.0 / 9, expected.variance, 2e-3);
+}
+
+TEST(MonteCarlo, test_exceptions_are_rethrown)
+{
+    atomic<int> calls(0);
+    EXPECT_THROW(monteCarlo(1000000, constexprSeed, [&calls](PRNG &rng)
+    {
+        if(calls++ == 5000)
+        {
+            throw runtime_error("sample failed");
+        }
+        return rng.getRandomDouble();
+    }, 4, 1000), runtime_error);
+}
+
+float getRandomBetween(PRNG &rng, float a, float b)
+{
+    return rng.getRandomFloat(a, b);
+}
+
+double getRandomBetween(PRNG &rng, double a, double b)
+{
+    return rng.getRandomDouble(a, b);
+}
+
+long double getRandomBetween(PRNG &rng, long double a, long double b)
+{
+    return rng.getRandomLongDouble(a, b);
+}
+
+// The extreme words with bounds whose difference rounds up, or spans several binades, must all stay inside them
+template <class T>
+void expectFloatRangeInBounds()
+{
+    PRNG rng(constexprSeed);
+    const uint64_t words[] = {0, 1, UINT64_MAX, UINT64_MAX >> 1, UINT64_MAX << 11, UINT64_MAX << 40};
+    for(int i = 0; i < 20000; i++)
+    {
+        T a = static_cast<T>(ldexp(rng.getRandomDouble(-1, 1), rng.getRandomInt(-30, 30)));
+        T b = static_cast<T>(ldexp(rng.getRandomDouble(-1, 1), rng.getRandomInt(-30, 30)));
+        if(i % 3 == 0)
+        {
+            b = nextafter(a, numeric_limits<T>::infinity());
+        }
+        FloatRange<T> range(a, b);
+        ASSERT_EQ(min(a, b), range.min());
+        ASSERT_EQ(max(a, b), range.max());
+        for(uint64_t word : words)
+        {
+            T value = range.fromWord(word);
+            ASSERT_GE(value, range.min()) << a << " " << b << " " << word;
+            ASSERT_LE(value, range.max()) << a << " " << b << " " << word;
+        }
+        T value = getRandomBetween(rng, a, b);
+        ASSERT_GE(value, range.min());
+        ASSERT_LE(value, range.max());
+    }
+}
+
+TEST(FloatRange, test_stays_in_bounds)
+{
+    expectFloatRangeInBounds<float>();
+    expectFloatRangeInBounds<double>();
+    expectFloatRangeInBounds<long double>();
+
+    // Reversed bounds used to give numbers between minValue and 2 * minValue - maxValue
+    PRNG rng(constexprSeed);
+    for(int i = 0; i < 1000; i++)
+    {
+        double value = rng.getRandomDouble(3, 1);
+        EXPECT_GE(value, 1);
+        EXPECT_LE(value, 3);
+    }
+    EXPECT_EQ(-3e-8f, FloatRange<float>(1.0f, -3e-8f).fromWord(0));
+}
+
+// Where long double is double, or a 113 bit quad, it's converted from as many top bits as fit
+TEST(FloatRange, test_converted_unit_fits_mantissa)
+{
+    PRNG rng(constexprSeed);
+    for(int i = 0; i < 10000; i++)
+    {
+        uint64_t word = i < 2 ? UINT64_MAX * i : rng.getRandomUint64();
+        ASSERT_EQ(prng_detail::unitFromTopBits(word, double()), prng_detail::unitFromConvertedBits<double>(word));
+        ASSERT_EQ(prng_detail::unitFromTopBits(word, float()), prng_detail::unitFromConvertedBits<float>(word));
+    }
+    EXPECT_LT(prng_detail::unitFromConvertedBits<long double>(UINT64_MAX), 1);
+    EXPECT_GT(prng_detail::unitFromConvertedBits<long double>(UINT64_MAX), 0.999L);
+    for(int i = 0; i < 1000; i++)
+    {
+        long double value = rng.getRandomLongDouble(0.0L, 1.0L);
+        ASSERT_GE(value, 0);
+        ASSERT_LE(value, 1);
+    }
+}
+
+// Ranges whose difference overflows still cover both halves and stay finite
+template <class T>
+void expectWideFloatRange()
+{
+    const T largest = numeric_limits<T>::max();
+    FloatRange<T> range(largest, -largest);
+    for(uint64_t word : {uint64_t(0), UINT64_MAX, UINT64_MAX >> 1, UINT64_MAX << 40})
+    {
+        T value = range.fromWord(word);
+        EXPECT_GE(value, -largest);
+        EXPECT_LE(value, largest);
+    }
+    PRNG rng(constexprSeed);
+    vector<T> output(2000);
+    range.fill(rng, output.data(), output.size());
+    int positive = 0;
+    for(T value : output)
+    {
+        ASSERT_GE(value, -largest);
+        ASSERT_LE(value, largest);
+        positive += value > 0;
+    }
+    EXPECT_NEAR(1000, positive, 150);
+}
+
+TEST(FloatRange, test_wide_range)
+{
+    expectWideFloatRange<float>();
+    expectWideFloatRange<double>();
+    expectWideFloatRange<long double>();
+}
+
+TEST(FloatRange, test_fill_matches_draws)
+{
+    prng_dispatch::Level original = prng_dispatch::activeLevel();
+    prng_dispatch::setLevel(prng_dispatch::generic);
+    FloatRange<double> range(-3, 7);
+    PRNG drawn(constexprSeed);
+    PRNG filled(constexprSeed);
+    vector<double> output(1000);
+    range.fill(filled, output.data(), output.size());
+    double total = 0;
+    for(double value : output)
+    {
+        EXPECT_EQ(range(drawn), value);
+        total += value;
+    }
+    EXPECT_NEAR(2, total / output.size(), 0.3);
+    EXPECT_EQ(drawn.getRandomUint64(), filled.getRandomUint64());
+    prng_dispatch::setLevel(original);
+}
+
+TEST(Dispatch, test_float_range_matches_generic)
+{
+    expectSameAtEveryLevel<double>([]()
+    {
+        PRNG rng(constexprSeed);
+        vector<float> floats(1000);
+        vector<double> doubles(1000);
+        FloatRange<float>(-1e-3f, 5).fill(rng, floats.data(), floats.size());
+        FloatRange<double>(1e10, -1e-10).fill(rng, doubles.data(), doubles.size());
+        doubles.insert(doubles.end(), floats.begin(), floats.end());
+        return doubles;
+    }, 1e-6);
+}
+
 }